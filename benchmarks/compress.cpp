@@ -1,5 +1,7 @@
 #include <fstream>
+#include <functional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 
 #include <CLI/App.hpp>
@@ -13,6 +15,9 @@
 #include "sfkit/bp/BPForestCompressor.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
 #include "sfkit/dag/DAGForestCompressor.hpp"
+#include "sfkit/dag/DAGNodeRelabeling.hpp"
+#include "sfkit/dag/LowMemoryDAGForestCompressor.hpp"
+#include "sfkit/graph/CompressionStats.hpp"
 #include "sfkit/io/CompressedForestIO.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
 #include "sfkit/stats/AlleleFrequencySpectrum.hpp"
@@ -23,6 +28,10 @@ void compress(
     std::string const& trees_file,
     std::string const& forest_file,
     std::string const& bp_forest_file,
+    std::string const& trace_file,
+    size_t             memory_budget,
+    bool               relabel_nodes,
+    bool               compress_with_dag,
     ResultsPrinter&    results_printer
 ) {
     constexpr uint16_t iteration = 0;
@@ -39,6 +48,27 @@ void compress(
             results_printer.print_memory(warmup, section, variant, trees_file, report, iteration);
         };
 
+    // Print the summed up per-phase counters of a compressor.
+    auto log_stats = [&results_printer, &trees_file](std::string const& variant, auto const& stats) {
+        auto print = [&](std::string const& variable, auto const& value, std::string const& unit) {
+            results_printer.print(warmup, "compress_trace", variant, trees_file, variable, value, unit, iteration);
+        };
+        auto const& total = stats.total();
+        print("num_trees", stats.num_trees(), "count");
+        print("visited_nodes", total.num_visited_nodes, "count");
+        print("invalidated_nodes", total.num_invalidated_nodes, "count");
+        print("new_subtrees", total.num_new_subtrees, "count");
+        print("reused_subtrees", total.num_reused_subtrees, "count");
+        print("map_size", total.map_size, "count");
+        print("map_load_factor", total.map_load_factor, "ratio");
+        print("advance_time", total.advance_time.count(), "ns");
+        print("hashing_time", total.hashing_time.count(), "ns");
+        print("map_time", total.map_time.count(), "ns");
+        print("mutations_time", total.mutations_time.count(), "ns");
+    };
+
+    bool const trace = !trace_file.empty();
+
     sfkit::tskit::TSKitTreeSequence tree_sequence(trees_file);
 
     Timer       timer;
@@ -50,6 +80,9 @@ void compress(
 
     sfkit::sequence::GenomicSequenceFactory dag_sequence_factory(tree_sequence);
     sfkit::dag::DAGForestCompressor         dag_forest_compressor(tree_sequence);
+    if (trace) {
+        dag_forest_compressor.collect_stats();
+    }
     sfkit::dag::DAGCompressedForest         dag_forest   = dag_forest_compressor.compress(dag_sequence_factory);
     sfkit::sequence::GenomicSequence        dag_sequence = dag_sequence_factory.move_storage();
     do_not_optimize(dag_forest);
@@ -58,6 +91,49 @@ void compress(
     log_time("compress_forest_and_sequence", "sfkit_dag", timer.stop());
     log_mem("compress_forest_and_sequence", "sfkit_dag", memory_usage.stop());
 
+    // If requested, renumber the nodes of the DAG in post-order; the relabeled forest is then the one we save. Measure
+    // a post-order sweep over the DAG's edges before and after relabeling to quantify the effect on the cache misses.
+    CacheMissCounter cache_misses;
+    auto             log_sweep = [&](std::string const& variant) {
+        sfkit::samples::SampleSet const all_samples = dag_forest.all_samples();
+
+        if (cache_misses.available()) {
+            cache_misses.start();
+        }
+        timer.start();
+        sfkit::samples::NumSamplesBelow<sfkit::dag::DAGCompressedForest, 1> num_samples_below(
+            dag_forest,
+            sfkit::samples::SetOfSampleSets<1>{std::cref(all_samples)}
+        );
+        do_not_optimize(num_samples_below);
+        log_time("num_samples_below", variant, timer.stop());
+        if (cache_misses.available()) {
+            results_printer.print(
+                warmup,
+                "num_samples_below",
+                variant,
+                trees_file,
+                "cache_misses",
+                cache_misses.stop(),
+                "count",
+                iteration
+            );
+        }
+    };
+
+    if (relabel_nodes) {
+        log_sweep("sfkit_dag_first_seen");
+
+        memory_usage.start();
+        timer.start();
+
+        sfkit::dag::relabel_nodes_in_postorder(dag_forest, dag_sequence);
+
+        log_time("relabel_nodes", "sfkit_dag", timer.stop());
+        log_mem("relabel_nodes", "sfkit_dag", memory_usage.stop());
+        log_sweep("sfkit_dag_relabeled");
+    }
+
     // Save the compressed forest and sequence to a .forest file
     memory_usage.start();
     timer.start();
@@ -67,6 +143,42 @@ void compress(
     log_time("save_forest_file", "sfkit_dag", timer.stop());
     log_mem("save_forest_file", "sfkit_dag", memory_usage.stop());
 
+    // Compress the .trees to a DAG with bounded peak memory. The forest is not saved; if subtrees had to be dropped
+    // from the hash map, it is larger than the one above.
+    if (memory_budget > 0) {
+        memory_usage.start();
+        timer.start();
+
+        sfkit::sequence::GenomicSequenceFactory  low_memory_sequence_factory(tree_sequence);
+        sfkit::dag::LowMemoryDAGForestCompressor low_memory_compressor(tree_sequence, memory_budget);
+
+        auto low_memory_forest   = low_memory_compressor.compress(low_memory_sequence_factory);
+        auto low_memory_sequence = low_memory_sequence_factory.move_storage();
+        do_not_optimize(low_memory_forest);
+        do_not_optimize(low_memory_sequence);
+
+        log_time("compress_forest_and_sequence", "sfkit_dag_low_memory", timer.stop());
+        log_mem("compress_forest_and_sequence", "sfkit_dag_low_memory", memory_usage.stop());
+
+        auto print = [&](std::string const& variable, auto const& value, std::string const& unit) {
+            results_printer.print(
+                warmup,
+                "compress_low_memory",
+                "sfkit_dag_low_memory",
+                trees_file,
+                variable,
+                value,
+                unit,
+                iteration
+            );
+        };
+        print("memory_budget", memory_budget, "bytes");
+        print("subtree_map_memory", low_memory_compressor.subtree_map_memory_usage(), "bytes");
+        print("dropped_subtrees", low_memory_compressor.num_dropped_subtrees(), "count");
+        print("num_nodes", low_memory_forest.num_nodes(), "count");
+        print("num_nodes_unbounded", dag_forest.num_nodes(), "count");
+    }
+
     // Compress the .trees to .bpforest file
 
     memory_usage.start();
@@ -75,6 +187,9 @@ void compress(
     using SetOfSampleSets = sfkit::samples::SetOfSampleSets<1>;
     sfkit::bp::BPForestCompressor           bp_forest_compressor(tree_sequence);
     sfkit::sequence::GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    if (trace) {
+        bp_forest_compressor.collect_stats();
+    }
     sfkit::bp::BPCompressedForest           bp_forest   = bp_forest_compressor.compress(bp_sequence_factory);
     sfkit::sequence::GenomicSequence        bp_sequence = bp_sequence_factory.move_storage();
 
@@ -89,4 +204,37 @@ void compress(
 
     log_time("save_forest_file", "sfkit_bp", timer.stop());
     log_mem("save_forest_file", "sfkit_bp", memory_usage.stop());
+
+    // If requested, compress the .trees to both, the DAG- and the BP-compressed forest in a single pass. Both forests
+    // share the node ids and thus the genomic sequence.
+    if (compress_with_dag) {
+        memory_usage.start();
+        timer.start();
+
+        sfkit::bp::BPForestCompressor           joint_forest_compressor(tree_sequence);
+        sfkit::sequence::GenomicSequenceFactory joint_sequence_factory(tree_sequence);
+        auto [joint_bp_forest, joint_dag_forest] = joint_forest_compressor.compress_with_dag(joint_sequence_factory);
+        sfkit::sequence::GenomicSequence joint_sequence = joint_sequence_factory.move_storage();
+        do_not_optimize(joint_bp_forest);
+        do_not_optimize(joint_dag_forest);
+        do_not_optimize(joint_sequence);
+
+        log_time("compress_forest_and_sequence", "sfkit_joint", timer.stop());
+        log_mem("compress_forest_and_sequence", "sfkit_joint", memory_usage.stop());
+    }
+
+    // Write the per-tree counters of both compressors to the trace file. Collecting them slows down the compression,
+    // the timings above are thus not representative if tracing is enabled.
+    if (trace) {
+        log_stats("sfkit_dag", *dag_forest_compressor.stats());
+        log_stats("sfkit_bp", *bp_forest_compressor.stats());
+
+        std::ofstream trace_stream(trace_file);
+        if (!trace_stream) {
+            throw std::runtime_error("Could not open trace file " + trace_file);
+        }
+        sfkit::graph::CompressionStats::write_csv_header(trace_stream);
+        dag_forest_compressor.stats()->write_csv(trace_stream, "dag");
+        bp_forest_compressor.stats()->write_csv(trace_stream, "bp");
+    }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 #include "ResultsPrinter.hpp"
@@ -8,5 +9,9 @@ void compress(
     std::string const& trees_file,
     std::string const& forest_file,
     std::string const& bp_forest_file,
+    std::string const& trace_file,
+    size_t             memory_budget,
+    bool               relabel_nodes,
+    bool               compress_with_dag,
     ResultsPrinter&    results_printer
 );
@@ -2,6 +2,7 @@
 // Adapted from: https://muehe.org/posts/profiling-only-parts-of-your-code-with-perf/
 #pragma once
 
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <iostream>
@@ -10,8 +11,11 @@
 
 #include <fcntl.h>
 #include <kassert/kassert.hpp>
+#include <linux/perf_event.h>
 #include <signal.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -85,3 +89,54 @@ inline void profile(std::string name, std::function<void()> body) {
 inline void profile(std::function<void()> body) {
     profile("perf.data", body);
 }
+
+// Counts the last-level cache misses of this thread between start() and stop() using the perf_event_open syscall.
+// Counting might not be permitted (see /proc/sys/kernel/perf_event_paranoid), check available() before use.
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        _fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    CacheMissCounter(CacheMissCounter const&)            = delete;
+    CacheMissCounter& operator=(CacheMissCounter const&) = delete;
+
+    ~CacheMissCounter() {
+        if (available()) {
+            close(_fd);
+        }
+    }
+
+    [[nodiscard]] bool available() const {
+        return _fd >= 0;
+    }
+
+    void start() {
+        KASSERT(available(), "Cache miss counting is not available.");
+        ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+        KASSERT(available(), "Cache miss counting is not available.");
+        ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t      num_cache_misses = 0;
+        ssize_t const bytes_read       = read(_fd, &num_cache_misses, sizeof(num_cache_misses));
+        if (bytes_read == -1 || static_cast<size_t>(bytes_read) != sizeof(num_cache_misses)) {
+            // Reading failed (-1, errno is set) or returned a partial value; report no measurement.
+            num_cache_misses = 0;
+        }
+        return num_cache_misses;
+    }
+
+private:
+    int _fd;
+};
@@ -20,6 +20,7 @@
 #include "compress.hpp"
 #include "dataset_stats.hpp"
 #include "perf.hpp"
+#include "subtree_hashing.hpp"
 #include "timer.hpp"
 
 int main(int argc, char** argv) {
@@ -52,13 +53,53 @@ int main(int argc, char** argv) {
     compress_sub->add_option("-b,--bp-forest-file", bp_forest_file, "Input file for the BP-compressed forest")
         ->check(CLI::NonexistentPath);
 
+    std::string trace_file = "";
+    compress_sub
+        ->add_option(
+            "-t,--trace",
+            trace_file,
+            "Write per-tree counters and timings of the compressors to this CSV file"
+        )
+        ->check(CLI::NonexistentPath);
+
+    size_t memory_budget = 0;
+    compress_sub
+        ->add_option(
+            "--memory-budget",
+            memory_budget,
+            "Additionally compress to a DAG with bounded peak memory, limiting the subtree hash map to about this many "
+            "bytes"
+        )
+        ->check(CLI::PositiveNumber);
+
+    bool relabel_nodes = false;
+    compress_sub->add_flag(
+        "--relabel-nodes",
+        relabel_nodes,
+        "Renumber the nodes of the DAG in post-order before saving it; by default, they are saved in first-seen order"
+    );
+
+    bool compress_with_dag = false;
+    compress_sub->add_flag(
+        "--compress-with-dag",
+        compress_with_dag,
+        "Additionally measure building the BP- and the DAG-compressed forest in a single pass; the result is not saved"
+    );
+
     compress_sub->add_option("-r,--revision", revision, "Revision of this software (unique id, e.g. git commit hash)")
         ->default_val("undefined");
 
     compress_sub->add_option("-m,--machine", machine_id, "Identifier of this computer (e.g. hostname)")
         ->default_val("undefined");
 
-    compress_sub->callback([&trees_file, &forest_file, &bp_forest_file, &setup_results_printer]() {
+    compress_sub->callback([&trees_file,
+                            &forest_file,
+                            &bp_forest_file,
+                            &trace_file,
+                            &memory_budget,
+                            &relabel_nodes,
+                            &compress_with_dag,
+                            &setup_results_printer]() {
         if (forest_file == "" && bp_forest_file == "") {
             std::cerr << "Please provide one or both of --forest-file or --bp-forest-file" << std::endl;
             return EXIT_FAILURE;
@@ -67,7 +108,16 @@ int main(int argc, char** argv) {
         std::cerr << "Compressing tree sequence " << trees_file << std::endl;
 
         auto results_printer = setup_results_printer();
-        compress(trees_file, forest_file, bp_forest_file, results_printer);
+        compress(
+            trees_file,
+            forest_file,
+            bp_forest_file,
+            trace_file,
+            memory_budget,
+            relabel_nodes,
+            compress_with_dag,
+            results_printer
+        );
     
         return EXIT_SUCCESS;
     });
@@ -168,6 +218,34 @@ int main(int argc, char** argv) {
         dataset_stats(trees_file, forest_file, bp_forest_file, results_printer);
     });
 
+    // Subtree hashing subcommand
+    auto hashing_sub =
+        app.add_subcommand("hashing", "Compare the subtree hashing policies of the compressors on a tree sequence.");
+
+    // std::string trees_file = "";
+    hashing_sub->add_option("-f,--trees-file", trees_file, "The tree sequence file")
+        ->check(CLI::ExistingFile)
+        ->required();
+
+    // std::string revision = "";
+    hashing_sub->add_option("-r,--revision", revision, "Revision of this software (unique id, e.g. git commit hash)")
+        ->default_val("undefined");
+
+    // std::string machine_id = "";
+    hashing_sub->add_option("-m,--machine", machine_id, "Identifier of this computer (e.g. hostname)")
+        ->default_val("undefined");
+
+    // size_t num_iterations = 1;
+    hashing_sub->add_option("-n,--iterations", num_iterations, "The number of times to run each benchmark")
+        ->check(CLI::PositiveNumber)
+        ->default_val(1);
+
+    hashing_sub->callback([&trees_file, &num_iterations, &setup_results_printer]() {
+        auto results_printer = setup_results_printer();
+
+        subtree_hashing(trees_file, static_cast<uint16_t>(num_iterations), results_printer);
+    });
+
     // Require exactly one subcommand
     app.require_subcommand(1);
 
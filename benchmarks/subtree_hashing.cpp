@@ -0,0 +1,78 @@
+#include <string>
+
+#include "ResultsPrinter.hpp"
+#include "perf.hpp"
+#include "sfkit/bp/BPForestCompressor.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/dag/DAGForestCompressor.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+#include "sfkit/sequence/GenomicSequence.hpp"
+#include "sfkit/sequence/GenomicSequenceFactory.hpp"
+#include "sfkit/tskit/tskit.hpp"
+#include "subtree_hashing.hpp"
+#include "timer.hpp"
+
+// Compare the throughput and hash map footprint of the compressors using the different subtree hashing policies.
+void subtree_hashing(std::string const& trees_file, uint16_t const num_iterations, ResultsPrinter& results_printer) {
+    constexpr bool warmup = false;
+
+    sfkit::tskit::TSKitTreeSequence tree_sequence(trees_file);
+
+    Timer       timer;
+    MemoryUsage memory_usage;
+
+    auto run = [&]<typename HashPolicy>(std::string const& variant) {
+        auto log_time = [&](std::string const& section, Timer::duration duration, uint16_t iteration) {
+            results_printer.print_timer(warmup, section, variant, trees_file, duration, iteration);
+        };
+        auto log_mem = [&](std::string const& section, MemoryUsage::Report const& report, uint16_t iteration) {
+            results_printer.print_memory(warmup, section, variant, trees_file, report, iteration);
+        };
+        auto log_stat =
+            [&](std::string const& variable, auto const value, std::string const& unit, uint16_t iteration) {
+                results_printer.print(warmup, "subtree_hashing", variant, trees_file, variable, value, unit, iteration);
+            };
+
+        for (uint16_t iteration = 0; iteration < num_iterations; ++iteration) {
+            { // DAG
+                memory_usage.start();
+                timer.start();
+
+                sfkit::graph::ForestCompressor<sfkit::dag::DAGCompressedForest, HashPolicy> compressor(tree_sequence);
+                sfkit::sequence::GenomicSequenceFactory sequence_factory(tree_sequence);
+                sfkit::dag::DAGCompressedForest         forest = compressor.compress(sequence_factory);
+                do_not_optimize(forest);
+
+                log_time("compress_dag", timer.stop(), iteration);
+                log_mem(
+                    "compress_dag",
+                    memory_usage.stop().data_structure_bytes(compressor.subtree_map_memory_usage()),
+                    iteration
+                );
+                log_stat("dag_num_nodes", forest.num_nodes(), "1", iteration);
+            }
+
+            { // BP
+                memory_usage.start();
+                timer.start();
+
+                sfkit::graph::ForestCompressor<sfkit::bp::BPCompressedForest, HashPolicy> compressor(tree_sequence);
+                sfkit::sequence::GenomicSequenceFactory sequence_factory(tree_sequence);
+                sfkit::bp::BPCompressedForest           forest = compressor.compress(sequence_factory);
+                do_not_optimize(forest);
+
+                log_time("compress_bp", timer.stop(), iteration);
+                log_mem(
+                    "compress_bp",
+                    memory_usage.stop().data_structure_bytes(compressor.subtree_map_memory_usage()),
+                    iteration
+                );
+                log_stat("bp_num_nodes", forest.num_nodes(), "1", iteration);
+            }
+        }
+    };
+
+    run.template operator()<sfkit::graph::XXH3_128HashPolicy>("xxh3_128");
+    run.template operator()<sfkit::graph::Mix128HashPolicy>("mix128");
+    run.template operator()<sfkit::graph::MultiplyXorShift64HashPolicy>("multiply_xorshift64");
+}
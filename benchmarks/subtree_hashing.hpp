@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+#include "ResultsPrinter.hpp"
+
+void subtree_hashing(std::string const& trees_file, uint16_t num_iterations, ResultsPrinter& results_printer);
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,6 +16,7 @@
 #include "sfkit/dag/DAGCompressedForest.hpp"
 #include "sfkit/dag/DAGForestCompressor.hpp"
 #include "sfkit/graph/ForestCompressor.hpp"
+#include "sfkit/samples/DescendantBitmaps.hpp"
 #include "sfkit/samples/NumSamplesBelowFactory.hpp"
 #include "sfkit/sequence/AlleleFrequencies.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
@@ -61,8 +66,9 @@ public:
     }
 
     // TODO Pass by reference
+    template <typename NumSamplesBelowBaseType = SampleId>
     auto allele_frequencies(SampleSet const samples) {
-        using NumSamplesBelowT = NumSamplesBelow<CompressedForest, 1, SampleId>;
+        using NumSamplesBelowT = NumSamplesBelow<CompressedForest, 1, NumSamplesBelowBaseType>;
         auto num_samples_below = NumSamplesBelowAccessor<NumSamplesBelowT>(
             std::make_shared<NumSamplesBelowT>(
                 _forest,
@@ -83,10 +89,11 @@ public:
     }
 
     // TODO Pass by reference
+    template <typename NumSamplesBelowBaseType = SampleId>
     auto allele_frequencies(SampleSet const samples_0, SampleSet const samples_1) {
         return sfkit::utils::tuple_transform(
             [this](auto&& e) { return allele_frequencies(e); },
-            NumSamplesBelowFactory::build(_forest, samples_0, samples_1)
+            NumSamplesBelowFactory::build<CompressedForest, NumSamplesBelowBaseType>(_forest, samples_0, samples_1)
         );
     }
 
@@ -126,6 +133,39 @@ public:
         );
     }
 
+    // Any number of sample sets, e.g. one per population; a single pass over the DAG computes the number of samples
+    // below each node for all of them. Only supported by the DAGCompressedForest.
+    template <typename NumSamplesBelowBaseType = SampleId>
+    auto allele_frequencies(std::vector<SampleSet> const& sample_sets) {
+        DynamicSetOfSampleSets const sample_set_refs(sample_sets.begin(), sample_sets.end());
+        auto const                   num_samples_below =
+            NumSamplesBelowFactory::build<CompressedForest, NumSamplesBelowBaseType>(_forest, sample_set_refs);
+
+        std::vector<decltype(allele_frequencies(num_samples_below.front()))> allele_freqs;
+        allele_freqs.reserve(num_samples_below.size());
+        for (auto const& num_samples_below_set: num_samples_below) {
+            allele_freqs.push_back(allele_frequencies(num_samples_below_set));
+        }
+        return allele_freqs;
+    }
+
+    // Store the samples below each node with a mutation as a bitmap (see DescendantBitmaps). Afterwards,
+    // allele_frequencies_from_bitmaps() computes the allele frequencies of any sample set without traversing the DAG.
+    // Only supported by the DAGCompressedForest; meant for tree sequences with up to a few thousand samples.
+    void build_descendant_bitmaps() {
+        _descendant_bitmaps =
+            std::make_shared<DescendantBitmaps const>(_forest.postorder_edges(), _sequence.subtrees_with_mutations());
+    }
+
+    [[nodiscard]] bool descendant_bitmaps_are_built() const {
+        return _descendant_bitmaps != nullptr;
+    }
+
+    auto allele_frequencies_from_bitmaps(SampleSet const& samples) {
+        KASSERT(descendant_bitmaps_are_built(), "The descendant bitmaps have not been built.", sfkit::assert::light);
+        return allele_frequencies(DescendantBitmapNumSamplesBelow(_descendant_bitmaps, samples));
+    }
+
     // TODO Make this const
     [[nodiscard]] double diversity() {
         return diversity(_forest.all_samples());
@@ -139,8 +179,10 @@ public:
     // TODO Pass by reference
     [[nodiscard]] double diversity(SampleSet const sample_set) {
         SampleId const num_samples = sample_set.popcount();
-        auto const     freqs       = allele_frequencies(sample_set);
-        return diversity(num_samples, freqs);
+        return _with_subtree_size_type(num_samples, [this, &sample_set, num_samples]<typename BaseType>() {
+            auto const freqs = allele_frequencies<BaseType>(sample_set);
+            return diversity(num_samples, freqs);
+        });
     }
 
     [[nodiscard]] auto allele_frequency_spectrum() {
@@ -164,45 +206,52 @@ public:
 
     // TODO Pass by reference?
     [[nodiscard]] double divergence(SampleSet const sample_set_0, SampleSet const sample_set_1) {
-        auto [allele_freqs_0, allele_freqs_1] = allele_frequencies(sample_set_0, sample_set_1);
-        auto const num_samples_0              = sample_set_0.popcount();
-        auto const num_samples_1              = sample_set_1.popcount();
-        return divergence(num_samples_0, allele_freqs_0, num_samples_1, allele_freqs_1);
+        auto const num_samples_0 = sample_set_0.popcount();
+        auto const num_samples_1 = sample_set_1.popcount();
+        return _with_subtree_size_type(
+            std::max(num_samples_0, num_samples_1),
+            [this, &sample_set_0, &sample_set_1, num_samples_0, num_samples_1]<typename BaseType>() {
+                auto [allele_freqs_0, allele_freqs_1] = allele_frequencies<BaseType>(sample_set_0, sample_set_1);
+                return divergence(num_samples_0, allele_freqs_0, num_samples_1, allele_freqs_1);
+            }
+        );
     }
 
     // TODO Pass by reference?
     [[nodiscard]] double f2(SampleSet const sample_set_0, SampleSet const sample_set_1) {
-        auto const [allele_freqs_0, allele_freqs_1] = allele_frequencies(sample_set_0, sample_set_1);
-        return stats::PattersonsF::f2(allele_freqs_0, allele_freqs_1);
+        SampleId const max_num_samples = std::max(sample_set_0.popcount(), sample_set_1.popcount());
+        return _with_subtree_size_type(max_num_samples, [this, &sample_set_0, &sample_set_1]<typename BaseType>() {
+            auto const [allele_freqs_0, allele_freqs_1] = allele_frequencies<BaseType>(sample_set_0, sample_set_1);
+            return stats::PattersonsF::f2(allele_freqs_0, allele_freqs_1);
+        });
     }
 
     // TODO Pass by reference?
     [[nodiscard]] double f3(SampleSet const samples_0, SampleSet const samples_1, SampleSet const samples_2) {
-        if (samples_0.popcount() <= UINT16_MAX && samples_1.popcount() <= UINT16_MAX
-            && samples_2.popcount() <= UINT16_MAX) [[likely]] {
-            auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2] =
-                allele_frequencies<uint16_t>(samples_0, samples_1, samples_2);
-            return stats::PattersonsF::f3(allele_freqs_0, allele_freqs_1, allele_freqs_2);
-        } else {
-            auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2] =
-                allele_frequencies<SampleId>(samples_0, samples_1, samples_2);
-            return stats::PattersonsF::f3(allele_freqs_0, allele_freqs_1, allele_freqs_2);
-        }
+        SampleId const max_num_samples = std::max({samples_0.popcount(), samples_1.popcount(), samples_2.popcount()});
+        return _with_subtree_size_type(
+            max_num_samples,
+            [this, &samples_0, &samples_1, &samples_2]<typename BaseType>() {
+                auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2] =
+                    allele_frequencies<BaseType>(samples_0, samples_1, samples_2);
+                return stats::PattersonsF::f3(allele_freqs_0, allele_freqs_1, allele_freqs_2);
+            }
+        );
     }
 
     // TODO Pass by reference?
     [[nodiscard]] double
     f4(SampleSet const samples_0, SampleSet const samples_1, SampleSet const samples_2, SampleSet const samples_3) {
-        if (samples_0.popcount() <= UINT16_MAX && samples_1.popcount() <= UINT16_MAX
-            && samples_2.popcount() <= UINT16_MAX && samples_3.popcount() <= UINT16_MAX) [[likely]] {
-            auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3] =
-                allele_frequencies<uint16_t>(samples_0, samples_1, samples_2, samples_3);
-            return stats::PattersonsF::f4(allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3);
-        } else {
-            auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3] =
-                allele_frequencies<SampleId>(samples_0, samples_1, samples_2, samples_3);
-            return stats::PattersonsF::f4(allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3);
-        }
+        SampleId const max_num_samples =
+            std::max({samples_0.popcount(), samples_1.popcount(), samples_2.popcount(), samples_3.popcount()});
+        return _with_subtree_size_type(
+            max_num_samples,
+            [this, &samples_0, &samples_1, &samples_2, &samples_3]<typename BaseType>() {
+                auto const [allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3] =
+                    allele_frequencies<BaseType>(samples_0, samples_1, samples_2, samples_3);
+                return stats::PattersonsF::f4(allele_freqs_0, allele_freqs_1, allele_freqs_2, allele_freqs_3);
+            }
+        );
     }
 
     [[nodiscard]] std::vector<NodeId> lca(SampleId const u, SampleId const v) {
@@ -215,6 +264,9 @@ public:
 
     [[nodiscard]] std::vector<NodeId> lca(SampleSet const& samples) {
         if constexpr (std::is_same_v<CompressedForest, DAGCompressedForest>) {
+            if (_forest.csr_edges_are_computed()) {
+                return stats::DAGLowestCommonAncestor(_forest.postorder_edges(), _forest.csr_edges()).lca(samples);
+            }
             stats::DAGLowestCommonAncestor lca(_forest.postorder_edges());
             return lca.lca(samples);
         } else {
@@ -233,8 +285,10 @@ public:
     // TODO Pass by reference?
     [[nodiscard]] SiteId num_segregating_sites(SampleSet const sample_set) {
         auto const num_samples = sample_set.popcount();
-        auto const freqs       = allele_frequencies(sample_set);
-        return num_segregating_sites(num_samples, freqs);
+        return _with_subtree_size_type(num_samples, [this, &sample_set, num_samples]<typename BaseType>() {
+            auto const freqs = allele_frequencies<BaseType>(sample_set);
+            return num_segregating_sites(num_samples, freqs);
+        });
     }
 
     [[nodiscard]] SiteId num_segregating_sites() {
@@ -242,15 +296,20 @@ public:
     }
 
     [[nodiscard]] double tajimas_d() {
-        auto const allele_freqs = allele_frequencies(_forest.all_samples());
-        return stats::TajimasD::tajimas_d(num_samples(), allele_freqs);
+        return _with_subtree_size_type(num_samples(), [this]<typename BaseType>() {
+            auto const allele_freqs = allele_frequencies<BaseType>(_forest.all_samples());
+            return stats::TajimasD::tajimas_d(num_samples(), allele_freqs);
+        });
     }
 
     // This is per sequence length, the other statistics are not
     // TODO Pass by reference?
     [[nodiscard]] double fst(SampleSet const sample_set_0, SampleSet const sample_set_1) {
-        auto [allele_freqs_0, allele_freqs_1] = allele_frequencies(sample_set_0, sample_set_1);
-        return stats::Fst::fst(_sequence.num_sites(), allele_freqs_0, allele_freqs_1);
+        SampleId const max_num_samples = std::max(sample_set_0.popcount(), sample_set_1.popcount());
+        return _with_subtree_size_type(max_num_samples, [this, &sample_set_0, &sample_set_1]<typename BaseType>() {
+            auto [allele_freqs_0, allele_freqs_1] = allele_frequencies<BaseType>(sample_set_0, sample_set_1);
+            return stats::Fst::fst(_sequence.num_sites(), allele_freqs_0, allele_freqs_1);
+        });
     }
 
     [[nodiscard]] SiteId num_sites() const {
@@ -290,8 +349,9 @@ public:
     }
 
 private:
-    CompressedForest _forest;
-    GenomicSequence  _sequence;
+    CompressedForest                         _forest;
+    GenomicSequence                          _sequence;
+    std::shared_ptr<DescendantBitmaps const> _descendant_bitmaps;
 
     void _init(TSKitTreeSequence& tree_sequence) {
         ForestCompressor<CompressedForest> forest_compressor(tree_sequence);
@@ -299,6 +359,20 @@ private:
         _forest   = forest_compressor.compress(sequence_factory);
         _sequence = sequence_factory.move_storage();
     }
+
+    // Calls compute.template operator()<BaseType>() with the narrowest type for the subtree sizes which can count
+    // max_num_samples samples. Narrower lanes fit more subtree sizes into each SIMD register and cache line when
+    // computing the number of samples below each node.
+    template <typename Compute>
+    static auto _with_subtree_size_type(SampleId const max_num_samples, Compute&& compute) {
+        if (max_num_samples <= std::numeric_limits<uint8_t>::max()) {
+            return compute.template operator()<uint8_t>();
+        } else if (max_num_samples <= std::numeric_limits<uint16_t>::max()) {
+            return compute.template operator()<uint16_t>();
+        } else {
+            return compute.template operator()<SampleId>();
+        }
+    }
 };
 
 using DAGSuccinctForest        = SuccinctForest<DAGCompressedForest, PerfectDNAHasher>;
@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <memory>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <fmt/core.h>
 #include <fmt/format.h>
@@ -17,6 +19,7 @@
 #include "sfkit/graph/SubtreeHashToNodeMapper.hpp"
 #include "sfkit/graph/SubtreeHasher.hpp"
 #include "sfkit/graph/primitives.hpp"
+#include "sfkit/samples/SampleIdMap.hpp"
 #include "sfkit/samples/SampleSet.hpp"
 #include "sfkit/tskit/tskit.hpp"
 #include "sfkit/utils/checking_casts.hpp"
@@ -25,6 +28,7 @@
 namespace sfkit::bp {
 using namespace sfkit::graph;
 using sfkit::samples::SampleId;  // TODO Remove this dependency
+using sfkit::samples::SampleIdMap;
 using sfkit::samples::SampleSet; // TODO Remove this dependency
 
 class BPCompressedForest {
@@ -32,6 +36,20 @@ public:
     static constexpr bool PARENS_OPEN  = bp::PARENS_OPEN;
     static constexpr bool PARENS_CLOSE = bp::PARENS_CLOSE;
 
+    // The state of a left-to-right pass over the balanced parenthesis sequence at the start of a tree.
+    struct TreeStart {
+        size_t   bp_idx;        // The opening parenthesis of the tree (or of the reference to it)
+        TreeId   tree_id;       // The number of trees described before
+        SampleId leaf_rank;     // The number of leaves before
+        size_t   ref_rank;      // The number of references before
+        NodeId   inner_node_id; // The id of the next inner node to be closed
+
+        [[nodiscard]] bool operator==(TreeStart const& other) const = default;
+    };
+
+    // The default minimum distance in bits between two sampled tree starts (see build_tree_start_index()).
+    static constexpr size_t TREE_START_SAMPLING_DISTANCE = 64 * 1024;
+
     // TODO Cereal has a proper way to construct a class which has no default constructor
     BPCompressedForest() = default;
 
@@ -46,7 +64,8 @@ public:
         sdsl::int_vector<NodeId_bitwidth> const& leaves,
         NodeId const                             num_nodes,
         NodeId const                             num_leaves,
-        TreeId const                             num_trees
+        TreeId const                             num_trees,
+        SampleIdMap                              sample_ids = {}
     )
         : _is_reference(is_reference),
           _is_leaf(is_leaf),
@@ -55,7 +74,8 @@ public:
           _leaves(leaves),
           _num_nodes(num_nodes),
           _num_leaves(num_leaves),
-          _num_trees(num_trees) {
+          _num_trees(num_trees),
+          _sample_ids(std::move(sample_ids)) {
         sdsl::util::init_support(_is_reference_rank, &_is_reference);
         sdsl::util::init_support(_is_leaf_rank, &_is_leaf);
         sdsl::util::init_support(_balanced_parenthesis_rank, &_balanced_parenthesis);
@@ -85,6 +105,11 @@ public:
         return _num_leaves;
     }
 
+    // Maps the sample ids of this forest to the node ids in the tree sequence it has been compressed from.
+    [[nodiscard]] SampleIdMap const& sample_ids() const {
+        return _sample_ids;
+    }
+
     [[nodiscard]] NodeId num_unique_subtrees() const {
         return _num_nodes;
     }
@@ -136,6 +161,22 @@ public:
     NodeId node_id_ref_by_rank(size_t const ref_rank) const {
         return _references[ref_rank];
     }
+    // Sample the starts of the trees: The first tree and then the first tree starting at least sampling_distance bits
+    // after the previously sampled one. Decoding can start at each sampled tree (see tree_starts()), e.g. to process
+    // blocks of trees in parallel. Only the parallel computations need the index; it is thus built on first use.
+    void build_tree_start_index(size_t const sampling_distance = TREE_START_SAMPLING_DISTANCE) {
+        _build_tree_start_index(sampling_distance);
+    }
+
+    // The sampled tree starts in increasing order; empty only if the forest contains no trees. Builds the index with
+    // the default sampling distance on the first call; this first call must thus not race with other accesses.
+    [[nodiscard]] std::vector<TreeStart> const& tree_starts() const {
+        if (_tree_starts.empty()) [[unlikely]] {
+            _build_tree_start_index(TREE_START_SAMPLING_DISTANCE);
+        }
+        return _tree_starts;
+    }
+
     // This function is accessible mainly for unit-testing. It is not part of the public API.
     auto const& is_reference() const {
         return _is_reference;
@@ -191,6 +232,7 @@ public:
         os.write(reinterpret_cast<char const*>(&_num_nodes), sizeof(_num_nodes));
         os.write(reinterpret_cast<char const*>(&_num_leaves), sizeof(_num_leaves));
         os.write(reinterpret_cast<char const*>(&_num_trees), sizeof(_num_trees));
+        _sample_ids.save(os);
     }
 
     void load(std::istream& is) {
@@ -206,18 +248,20 @@ public:
         is.read(reinterpret_cast<char*>(&_num_nodes), sizeof(_num_nodes));
         is.read(reinterpret_cast<char*>(&_num_leaves), sizeof(_num_leaves));
         is.read(reinterpret_cast<char*>(&_num_trees), sizeof(_num_trees));
+        _sample_ids.load(is);
 
         // TODO Can't these be serialized and deserialized?
         sdsl::util::init_support(_is_reference_rank, &_is_reference);
         sdsl::util::init_support(_is_leaf_rank, &_is_leaf);
         sdsl::util::init_support(_balanced_parenthesis_rank, &_balanced_parenthesis);
+        _tree_starts.clear();
     }
 
-    [[nodiscard]] bool operator==(BPCompressedForest const& other) {
+    [[nodiscard]] bool operator==(BPCompressedForest const& other) const {
         return _is_reference == other._is_reference && _is_leaf == other._is_leaf
                && _balanced_parenthesis == other._balanced_parenthesis && _references == other._references
                && _leaves == other._leaves && _num_nodes == other._num_nodes && _num_leaves == other._num_leaves
-               && _num_trees == other._num_trees;
+               && _num_trees == other._num_trees && _sample_ids == other._sample_ids;
     }
 
 private:
@@ -235,6 +279,51 @@ private:
     NodeId                            _num_nodes;
     SampleId                          _num_leaves;
     TreeId                            _num_trees;
+    SampleIdMap                       _sample_ids;
+    mutable std::vector<TreeStart>    _tree_starts; // Built on first use, see tree_starts().
+
+    void _build_tree_start_index(size_t const sampling_distance) const {
+        KASSERT(sampling_distance > 0ul, "The sampling distance has to be positive.", sfkit::assert::light);
+        KASSERT(_balanced_parenthesis.size() == _is_reference.size());
+        _tree_starts.clear();
+
+        size_t   level         = 0;
+        bool     last_was_open = false;
+        TreeId   tree_id       = 0;
+        SampleId leaf_rank     = 0;
+        size_t   ref_rank      = 0;
+        NodeId   inner_node_id = _num_leaves;
+        size_t   next_sample   = 0;
+        for (size_t bp_idx = 0; bp_idx < _balanced_parenthesis.size(); bp_idx++) {
+            bool const is_open = _balanced_parenthesis[bp_idx] == PARENS_OPEN;
+            bool const is_ref  = _is_reference[bp_idx];
+            if (is_open) {
+                if (level == 0) {
+                    if (bp_idx >= next_sample) {
+                        _tree_starts.push_back({bp_idx, tree_id, leaf_rank, ref_rank, inner_node_id});
+                        next_sample = bp_idx + sampling_distance;
+                    }
+                    ++tree_id;
+                }
+                ref_rank += is_ref;
+                ++level;
+            } else {
+                KASSERT(level > 0ul, "The parentheses are not balanced.", sfkit::assert::light);
+                --level;
+                if (!is_ref) {
+                    if (last_was_open) {
+                        ++leaf_rank;
+                    } else {
+                        ++inner_node_id;
+                    }
+                }
+            }
+            last_was_open = is_open;
+        }
+        KASSERT(level == 0ul, "The parentheses are not balanced.", sfkit::assert::light);
+        KASSERT(leaf_rank <= _num_leaves, "Too many leaves in the BP sequence.", sfkit::assert::light);
+        KASSERT(inner_node_id <= _num_nodes, "Too many inner nodes in the BP sequence.", sfkit::assert::light);
+    }
 };
 
 } // namespace sfkit::bp
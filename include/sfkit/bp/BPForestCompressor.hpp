@@ -1,7 +1,11 @@
 #pragma once
 
 // #include <sparsehash/dense_hash_map>
+#include <optional>
+#include <tuple>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <kassert/kassert.hpp>
 #include <sfkit/include-redirects/hopscotch_map.hpp>
@@ -10,11 +14,16 @@
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/bp/BPCompressedForest.hpp"
 #include "sfkit/bp/Parens.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/graph/CompressionStats.hpp"
+#include "sfkit/graph/Edge.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/ForestCompressor.hpp"
+#include "sfkit/graph/SubtreeCollisionVerifier.hpp"
 #include "sfkit/graph/SubtreeHashToNodeMapper.hpp"
 #include "sfkit/graph/SubtreeHasher.hpp"
 #include "sfkit/graph/TsToSfNodeMapper.hpp"
+#include "sfkit/samples/SampleIdMap.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
 #include "sfkit/sequence/GenomicSequenceFactory.hpp"
 #include "sfkit/tskit/tskit.hpp"
@@ -24,46 +33,137 @@
 namespace sfkit::graph {
 
 using sfkit::bp::BPCompressedForest;
+using sfkit::dag::DAGCompressedForest;
 using sfkit::tskit::TSKitTree;
 using sfkit::tskit::TSKitTreeSequence;
 
-template <>
-class ForestCompressor<BPCompressedForest> {
+template <typename HashPolicy>
+class ForestCompressor<BPCompressedForest, HashPolicy> {
 public:
-    ForestCompressor(TSKitTreeSequence& tree_sequence)
+    using SubtreeHash             = typename HashPolicy::SubtreeHash;
+    using SubtreeHasher           = BasicSubtreeHasher<HashPolicy>;
+    using SubtreeHashToNodeMapper = BasicSubtreeHashToNodeMapper<SubtreeHash>;
+
+    ForestCompressor(
+        TSKitTreeSequence& tree_sequence, HashCollisionHandling collision_handling = HashCollisionHandling::Trust
+    )
         : _num_trees(tree_sequence.num_trees()),
-          _ts_tree(tree_sequence) {
-        if (!tree_sequence.sample_ids_are_consecutive()) {
-            throw std::runtime_error("Sample IDs of the tree sequence are not consecutive.");
-        }
-        _ts_node_to_subtree.resize(_ts_tree.max_node_id());
+          _sample_ids(tree_sequence),
+          _ts_tree(tree_sequence),
+          _collision_handling(collision_handling) {
+        // The last entry is used by the virtual root of trees with multiple roots (see TSKitTree::root()).
+        _ts_node_to_subtree.resize(_ts_tree.max_node_id() + 1);
         _register_samples(tree_sequence);
         KASSERT(_subtree_to_sf_node.num_nodes() == tree_sequence.num_samples());
     }
 
     template <typename GenomicSequenceFactoryT>
     BPCompressedForest compress(GenomicSequenceFactoryT& genomic_sequence_factory) {
+        return _compress<false>(genomic_sequence_factory);
+    }
+
+    // Build the BP- and the DAG-compressed forest in a single pass over the tree sequence. Both share the subtree
+    // hashes and the node ids of the BP-compressed forest; the mutations processed by the genomic sequence factory are
+    // thus valid for both forests.
+    // In contrast to the DAGForestCompressor, roots whose subtree has already been encountered are not assigned a node
+    // id in first-seen order but are appended after all other nodes. Identical subtrees always map to the node created
+    // first. This keeps the ids of all other nodes identical to the ones in the BP-compressed forest.
+    template <typename GenomicSequenceFactoryT>
+    std::pair<BPCompressedForest, DAGCompressedForest>
+    compress_with_dag(GenomicSequenceFactoryT& genomic_sequence_factory) {
+        BPCompressedForest bp_forest = _compress<true>(genomic_sequence_factory);
+        return {std::move(bp_forest), std::move(_dag_forest)};
+    }
+
+    // Collect statistics on the next calls to compress() and compress_with_dag().
+    void collect_stats(bool const keep_per_tree_stats = true) {
+        _stats.emplace(keep_per_tree_stats);
+    }
+
+    [[nodiscard]] std::optional<CompressionStats> const& stats() const {
+        return _stats;
+    }
+
+    // Refer to subtrees which did not change since the previous tree without descending into them (default). Turning
+    // this off hashes every subtree bottom-up; the resulting forest is the same.
+    void skip_unchanged_subtrees(bool const skip = true) {
+        _skip_unchanged_subtrees = skip;
+    }
+
+    // The (approximate) memory used by the hash maps from subtree hashes to node ids and to the encoded subtrees.
+    [[nodiscard]] size_t subtree_map_memory_usage() const {
+        return _subtree_to_sf_node.memory_usage() + _subtrees.bucket_count() * sizeof(typename Subtrees::value_type);
+    }
+
+    // The number of hash hits for which the subtrees turned out to be different. Only counted if the hash collisions
+    // are not trusted; with HashCollisionHandling::Report, the first collision throws.
+    [[nodiscard]] size_t num_hash_collisions() const {
+        return _num_hash_collisions;
+    }
+
+private:
+    template <bool build_dag, typename GenomicSequenceFactoryT>
+    BPCompressedForest _compress(GenomicSequenceFactoryT& genomic_sequence_factory) {
         _num_samples = 0;
+        if constexpr (build_dag) {
+            // Only the samples are registered yet; they have the node ids 0 ... num_samples - 1.
+            KASSERT(_subtrees.empty(), "The compressor has already been used.", sfkit::assert::light);
+            for (SampleId sample_id = 0; sample_id < _subtree_to_sf_node.num_nodes(); ++sample_id) {
+                _dag_forest.insert_leaf(sample_id);
+            }
+            _dag_forest.sample_ids(_sample_ids);
+        }
+
+        using Clock        = CompressionStats::Clock;
+        auto last_tree_end = _stats ? Clock::now() : Clock::time_point{};
 
         // TODO Rewrite this, once we have the tree_sequence iterator
         for (_ts_tree.first(); _ts_tree.is_tree(); _ts_tree.next()) {
+            // Mark the nodes whose subtree changed compared to the previous tree.
+            bool const is_first_tree = _ts_tree.tree_id() == 0;
+            std::ignore              = _ts_tree.invalidated_nodes();
+
+            if (_stats) [[unlikely]] {
+                _stats->start_tree(asserting_cast<TreeId>(_ts_tree.tree_id()), _ts_tree.left(), _ts_tree.right());
+                _stats->current().advance_time = Clock::now() - last_tree_end;
+            }
+            size_t num_visited_nodes = 0;
+
             auto const eulertour = _ts_tree.eulertour();
             auto       node_it   = eulertour.begin();
             while (node_it != eulertour.end()) {
                 auto const ts_node_id = node_it.node_id();
+                num_visited_nodes += node_it.is_sample() || node_it.first_visit();
                 if (node_it.is_sample()) {
-                    if (_ts_tree.tree_id() == 0) {
-                        _add_sample(asserting_cast<SampleId>(ts_node_id));
+                    if (is_first_tree) {
+                        _add_sample(_sample_ids.sample_id(ts_node_id));
                     } else {
                         auto const subtree_id   = _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)];
                         auto const reference_it = _subtrees.find(subtree_id);
                         _refer_to(reference_it);
                     }
+                } else if (_skip_unchanged_subtrees && node_it.first_visit() && !is_first_tree
+                           && !_ts_tree.is_invalidated(ts_node_id)) {
+                    // This subtree did not change since the previous tree; thus, it is already encoded and the ts
+                    // nodes inside it are already mapped. Refer to it right away instead of descending into it,
+                    // hashing it bottom-up, and rolling it back afterwards.
+                    auto const subtree_id   = _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)];
+                    auto const reference_it = _subtrees.find(subtree_id);
+                    _refer_to(reference_it);
+                    if constexpr (build_dag) {
+                        if (_ts_tree.is_root(ts_node_id)) {
+                            _collect_children_sf_node_ids(ts_node_id);
+                            _insert_dag_existing_root(subtree_id);
+                        }
+                    }
+                    node_it.skip_subtree();
                 } else if (node_it.first_visit()) {
                     // Add the subtree to the BP forest.
                     _open_subtree();
                 } else {
                     KASSERT(node_it.second_visit());
+                    auto const hashing_start = _stats ? Clock::now() : Clock::time_point{};
+
                     // Compute the subtree ID of this inner node by hashing the XOR of the subtree IDs of its children.
                     _subtree_hash_factory.reset();
 
@@ -72,36 +172,83 @@ public:
 
                         _subtree_hash_factory.append_child(childs_subtree_id);
                     }
-                    auto const subtree_id = _subtree_hash_factory.hash();
+                    auto subtree_id = _subtree_hash_factory.hash();
+
+                    if (build_dag || _collision_handling != HashCollisionHandling::Trust) {
+                        _collect_children_sf_node_ids(ts_node_id);
+                    }
+
+                    auto const map_start = _stats ? Clock::now() : Clock::time_point{};
 
                     // Did we already encounter this subtree and can refer to its encoding?
-                    auto const reference_it = _subtrees.find(subtree_id);
-                    if (reference_it != _subtrees.end()) {
+                    auto const reference_it   = _find_subtree(subtree_id);
+                    bool const subtree_exists = reference_it != _subtrees.end();
+                    if (subtree_exists) {
                         // The referenced node (== subtree) has already been added to the BP, reference it.
                         _rollback_subtree();
                         _refer_to(reference_it);
+                        if constexpr (build_dag) {
+                            if (_ts_tree.is_root(ts_node_id)) {
+                                _insert_dag_existing_root(subtree_id);
+                            }
+                        }
                     } else {
                         // This is no subtree not encoded before, close and store if for future reference.
-                        _close_and_commit_subtree(subtree_id);
+                        NodeId const node_id = _close_and_commit_subtree(subtree_id);
+                        _verifier_add_node(node_id);
+                        if constexpr (build_dag) {
+                            for (NodeId const child_sf_node_id: _children_sf_node_ids) {
+                                _dag_forest.insert_edge(node_id, child_sf_node_id);
+                            }
+                            if (_ts_tree.is_root(ts_node_id)) {
+                                _dag_roots.push_back({node_id, false});
+                                _dag_last_root_subtree = subtree_id;
+                            }
+                        }
                     }
 
                     // Multiple inner nodes in the tskit tree sequence might describe the same subtree. We recognize
                     // this and refer back to the already encoded node. We thus have to store the mapping ts node ->
                     // subtree (and thus ts node) if we encode a new subtree AND if we refer to an existing subtree.
                     _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)] = subtree_id;
+
+                    if (_stats) [[unlikely]] {
+                        auto& tree_stats = _stats->current();
+                        tree_stats.hashing_time += map_start - hashing_start;
+                        tree_stats.map_time += Clock::now() - map_start;
+                        if (subtree_exists) {
+                            ++tree_stats.num_reused_subtrees;
+                        } else {
+                            ++tree_stats.num_new_subtrees;
+                        }
+                    }
                 }
                 ++node_it;
             }
 
             // Process the mutations of this tree
+            auto const mutations_start = _stats ? Clock::now() : Clock::time_point{};
             genomic_sequence_factory.process_mutations(
                 asserting_cast<TreeId>(_ts_tree.tree_id()),
                 TsToSfNodeMapper(_ts_node_to_subtree, _subtree_to_sf_node)
             );
+
+            if (_stats) [[unlikely]] {
+                last_tree_end                    = Clock::now();
+                auto& tree_stats                 = _stats->current();
+                tree_stats.mutations_time        = last_tree_end - mutations_start;
+                tree_stats.num_visited_nodes     = num_visited_nodes;
+                tree_stats.num_invalidated_nodes = is_first_tree ? num_visited_nodes : _ts_tree.num_invalidated_nodes();
+                _stats->finish_tree(_subtrees.size(), _subtrees.load_factor());
+            }
         }
 
         genomic_sequence_factory.finalize();
 
+        if constexpr (build_dag) {
+            _finalize_dag();
+        }
+
         _is_reference.shrink_to_fit();
         _is_leaf.shrink_to_fit();
         _balanced_parenthesis.shrink_to_fit();
@@ -120,11 +267,11 @@ public:
             _leaves.underlying(),
             asserting_cast<NodeId>(_subtrees.size()),
             _num_samples, // TODO Do I need this if I have the leaves vector?
-            _num_trees
+            _num_trees,
+            _sample_ids
         );
     }
 
-private:
     struct Reference {
         size_t start;
         size_t length;
@@ -192,6 +339,7 @@ private:
 
     SampleId                 _num_samples = 0;
     TreeId                   _num_trees   = 0;
+    samples::SampleIdMap     _sample_ids;
     TSKitTree                _ts_tree;
     std::vector<SubtreeHash> _ts_node_to_subtree;
     SubtreeHashToNodeMapper  _subtree_to_sf_node;
@@ -204,10 +352,27 @@ private:
     SubtreeStarts            _subtree_starts;
     Subtrees                 _subtrees;
 
-    // The sample ids are consecutive: 0 ... num_samples - 1
-    inline bool is_sample(tsk_id_t ts_node_id) const {
-        return ts_node_id < asserting_cast<tsk_id_t>(_num_samples);
-    }
+    // Only used when building the DAG-compressed forest alongside the BP-compressed one.
+    struct DAGRoot {
+        // For duplicate roots, this is the index among the duplicate roots; the final node id is assigned in
+        // _finalize_dag(), once the number of unique subtrees is known.
+        NodeId node_id;
+        bool   is_duplicate;
+    };
+
+    DAGCompressedForest  _dag_forest;
+    std::vector<DAGRoot> _dag_roots; // One per tree; consecutive equal entries are merged into runs by the DAG.
+    SubtreeHash          _dag_last_root_subtree{};
+    std::vector<Edge>    _dag_duplicate_root_edges;
+    NodeId               _num_dag_duplicate_roots = 0;
+    std::vector<NodeId>  _children_sf_node_ids;
+
+    HashCollisionHandling    _collision_handling;
+    SubtreeCollisionVerifier _collision_verifier;
+    size_t                   _num_hash_collisions = 0;
+
+    std::optional<CompressionStats> _stats;
+    bool                            _skip_unchanged_subtrees = true;
 
     void _add_sample(SampleId const sample_id) {
         _open_subtree(sample_id);
@@ -232,7 +397,7 @@ private:
         KASSERT(_balanced_parenthesis.index() == _is_leaf.index());
     }
 
-    void _close_and_commit_subtree(SubtreeHash subtree_id, bool is_leaf = false) {
+    NodeId _close_and_commit_subtree(SubtreeHash subtree_id, bool is_leaf = false) {
         KASSERT(_balanced_parenthesis.index() == _is_reference.index());
         KASSERT(_balanced_parenthesis.index() == _is_leaf.index());
         _is_reference.push_back(false);
@@ -253,6 +418,82 @@ private:
         auto const start  = _subtree_starts.back().bp_start;
         auto const length = _balanced_parenthesis.index() - start;
         _subtrees.emplace(subtree_id, Reference{start, length, node_id});
+        return node_id;
+    }
+
+    // Look up the subtree among the already encoded ones. Unless we trust the hash, check that the subtree found has
+    // the same children (_children_sf_node_ids). On a collision, either throw or probe the secondary hashes of the
+    // subtree until we find the identical subtree or an unused hash. The hash used is returned in subtree_id.
+    typename Subtrees::const_iterator _find_subtree(SubtreeHash& subtree_id) {
+        auto reference_it = _subtrees.find(subtree_id);
+        if (_collision_handling == HashCollisionHandling::Trust) [[likely]] {
+            return reference_it;
+        }
+
+        SubtreeHash const primary_subtree_id = subtree_id;
+        for (XXH64_hash_t probe = 1;
+             reference_it != _subtrees.end()
+             && !_collision_verifier.matches(reference_it->second.node_id, _children_sf_node_ids);
+             ++probe) {
+            ++_num_hash_collisions;
+            if (_collision_handling == HashCollisionHandling::Report) {
+                throw std::runtime_error("Subtree hash collision: two different subtrees have the same hash.");
+            }
+            subtree_id   = _subtree_hash_factory.probe(primary_subtree_id, probe);
+            reference_it = _subtrees.find(subtree_id);
+        }
+        return reference_it;
+    }
+
+    void _verifier_add_node(NodeId const node_id) {
+        if (_collision_handling != HashCollisionHandling::Trust) [[unlikely]] {
+            _collision_verifier.add_node(node_id, _children_sf_node_ids);
+        }
+    }
+
+    void _collect_children_sf_node_ids(tsk_id_t const ts_node_id) {
+        _children_sf_node_ids.clear();
+        for (auto child_ts_id: _ts_tree.children(ts_node_id)) {
+            SubtreeHash const childs_subtree_id = _ts_node_to_subtree[asserting_cast<size_t>(child_ts_id)];
+            _children_sf_node_ids.push_back(_subtree_to_sf_node[childs_subtree_id]);
+        }
+    }
+
+    // The root of the current tree has been encountered before. If the tree is identical to the previous one, it
+    // shares the previous tree's root (as in the DAGForestCompressor). Otherwise, the root is a duplicate.
+    void _insert_dag_existing_root(SubtreeHash const subtree_id) {
+        if (!_dag_roots.empty() && subtree_id == _dag_last_root_subtree) {
+            _dag_roots.push_back(_dag_roots.back());
+        } else {
+            _insert_dag_duplicate_root();
+        }
+        _dag_last_root_subtree = subtree_id;
+    }
+
+    // The DAG stores a root node for each tree which is not identical to its predecessor, even if the tree is
+    // identical to an earlier one. Roots are never referred to, so we can defer assigning their node id and emitting
+    // their edges until all other nodes are known.
+    void _insert_dag_duplicate_root() {
+        NodeId const duplicate_idx = _num_dag_duplicate_roots++;
+        for (NodeId const child_sf_node_id: _children_sf_node_ids) {
+            _dag_duplicate_root_edges.emplace_back(duplicate_idx, child_sf_node_id);
+        }
+        _dag_roots.push_back({duplicate_idx, true});
+    }
+
+    void _finalize_dag() {
+        NodeId const num_unique_nodes = _subtree_to_sf_node.num_nodes();
+        for (auto const& edge: _dag_duplicate_root_edges) {
+            _dag_forest.insert_edge(num_unique_nodes + edge.from(), edge.to());
+        }
+        for (auto const& root: _dag_roots) {
+            _dag_forest.insert_root(root.is_duplicate ? num_unique_nodes + root.node_id : root.node_id);
+        }
+        _dag_forest.num_nodes(num_unique_nodes + _num_dag_duplicate_roots);
+        _dag_forest.postorder_edges().traversal_order(TraversalOrder::Postorder);
+
+        KASSERT(_dag_forest.num_trees() == _num_trees, "Not exactly one root per tree.", sfkit::assert::light);
+        KASSERT(_dag_forest.postorder_edges().check_postorder(), "DAG is not in postorder.", sfkit::assert::heavy);
     }
 
     void _rollback_subtree() {
@@ -269,7 +510,7 @@ private:
         KASSERT(_balanced_parenthesis.index() == _is_leaf.index());
     }
 
-    void _refer_to(decltype(_subtrees)::const_iterator reference_it) {
+    void _refer_to(typename Subtrees::const_iterator reference_it) {
         KASSERT(_balanced_parenthesis.index() == _is_reference.index());
         KASSERT(_balanced_parenthesis.index() == _is_leaf.index());
         _is_reference.push_back(true);
@@ -297,19 +538,22 @@ private:
     // Assign subtree-ids to the samples. Do this first, before adding any other nodes, ensuring that samples always map
     // to the same subtree-ids.
     void _register_samples(TSKitTreeSequence& tree_sequence) {
-        KASSERT(tree_sequence.sample_ids_are_consecutive(), "Sample IDs are not consecutive.");
         for (SampleId sample_id = 0; sample_id < tree_sequence.num_samples(); sample_id++) {
-            KASSERT(tree_sequence.is_sample(asserting_cast<tsk_id_t>(sample_id)));
+            tsk_id_t const ts_node_id = _sample_ids.ts_node_id(sample_id);
+            KASSERT(tree_sequence.is_sample(ts_node_id));
 
             // Compute the subtree ID of this sample (leaf) node by hashing its label.
             auto subtree_hash = _subtree_hash_factory.hash_sample(sample_id);
 
             // Cache the subtree ID for this ts node
-            KASSERT(asserting_cast<size_t>(sample_id) < _ts_node_to_subtree.size());
-            _ts_node_to_subtree[asserting_cast<size_t>(sample_id)] = subtree_hash;
+            KASSERT(asserting_cast<size_t>(ts_node_id) < _ts_node_to_subtree.size());
+            _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)] = subtree_hash;
 
             // Map the subtree ID to the corresponding node ID in the DAG.
-            _subtree_to_sf_node.insert_node(subtree_hash);
+            NodeId const node_id = _subtree_to_sf_node.insert_node(subtree_hash);
+            if (_collision_handling != HashCollisionHandling::Trust) {
+                _collision_verifier.add_node(node_id, {});
+            }
         }
     }
 };
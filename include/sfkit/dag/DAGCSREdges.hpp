@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/cereal.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::dag {
+
+using sfkit::graph::EdgeId;
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::INVALID_NODE_ID;
+using sfkit::graph::NodeId;
+using sfkit::utils::asserting_cast;
+
+// The post-ordered edges of a DAG in a compressed sparse row (CSR) like encoding. The consecutive edges of a parent
+// form a group; we store the parent and its number of children once per group, followed by the ids of its children.
+// This removes the parent ids repeated in the (from, to) pairs of an EdgeListGraph. The number of children takes one
+// byte per group. If the parents of the groups are consecutive ids -- which is the case after relabeling the nodes in
+// post-order (see DAGNodeRelabeling.hpp) -- only the first parent is stored. For binary trees, a sweep over all edges
+// thus reads about 4.5 instead of 8 bytes per edge.
+class DAGCSREdges {
+public:
+    using ChildCount = uint8_t;
+
+    DAGCSREdges() = default;
+
+    // The edges of the DAG have to be in post-order.
+    explicit DAGCSREdges(EdgeListGraph const& dag) : _num_nodes(dag.num_nodes()) {
+        KASSERT(dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+
+        std::vector<NodeId> parents;
+        std::vector<EdgeId> num_children;
+        _children.reserve(dag.num_edges());
+        for (auto const& edge: dag) {
+            if (parents.empty() || parents.back() != edge.from()) {
+                parents.push_back(edge.from());
+                num_children.push_back(0);
+            }
+            num_children.back()++;
+            _children.push_back(edge.to());
+        }
+
+        // Each group has at least one child; a count of zero thus marks counts too large for a single byte.
+        _child_counts.reserve(num_children.size());
+        for (EdgeId const count: num_children) {
+            if (count <= std::numeric_limits<ChildCount>::max()) {
+                _child_counts.push_back(asserting_cast<ChildCount>(count));
+            } else {
+                _child_counts.push_back(LARGE_CHILD_COUNT);
+                _large_child_counts.push_back(count);
+            }
+        }
+
+        bool parents_are_consecutive = true;
+        for (size_t group = 1; group < parents.size() && parents_are_consecutive; group++) {
+            parents_are_consecutive = parents[group] == parents[group - 1] + 1;
+        }
+        _first_parent = parents.empty() ? INVALID_NODE_ID : parents.front();
+        if (!parents_are_consecutive) {
+            _parents = std::move(parents);
+        }
+    }
+
+    // Calls visit(parent, children) for each group of edges in post-order; children is a std::span<NodeId const>.
+    template <typename Visitor>
+    void for_each_parent(Visitor&& visit) const {
+        if (parents_are_implicit()) {
+            auto const parent_of = [this](size_t const group) {
+                return _first_parent + asserting_cast<NodeId>(group);
+            };
+            _for_each_group(parent_of, visit);
+        } else {
+            _for_each_group([this](size_t const group) { return _parents[group]; }, visit);
+        }
+    }
+
+    // The children of all groups, in the order of the groups.
+    [[nodiscard]] std::span<NodeId const> children() const {
+        return _children;
+    }
+
+    [[nodiscard]] size_t num_groups() const {
+        return _child_counts.size();
+    }
+
+    [[nodiscard]] EdgeId num_edges() const {
+        return asserting_cast<EdgeId>(_children.size());
+    }
+
+    [[nodiscard]] NodeId num_nodes() const {
+        return _num_nodes;
+    }
+
+    // True if the parents of the groups are consecutive and thus not stored explicitly.
+    [[nodiscard]] bool parents_are_implicit() const {
+        return _parents.empty();
+    }
+
+    // True for a default-constructed object only.
+    [[nodiscard]] bool empty() const {
+        return _num_nodes == INVALID_NODE_ID;
+    }
+
+    [[nodiscard]] size_t memory_usage() const {
+        return _parents.size() * sizeof(NodeId) + _child_counts.size() * sizeof(ChildCount)
+               + _large_child_counts.size() * sizeof(EdgeId) + _children.size() * sizeof(NodeId);
+    }
+
+    [[nodiscard]] bool operator==(DAGCSREdges const& other) const = default;
+
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(_num_nodes, _first_parent, _parents, _child_counts, _large_child_counts, _children);
+    }
+
+private:
+    static constexpr ChildCount LARGE_CHILD_COUNT = 0; // The count is stored in _large_child_counts instead.
+
+    NodeId                  _num_nodes    = INVALID_NODE_ID;
+    NodeId                  _first_parent = INVALID_NODE_ID;
+    std::vector<NodeId>     _parents;            // The parent of each group; empty if they are consecutive.
+    std::vector<ChildCount> _child_counts;       // The number of children of each group or LARGE_CHILD_COUNT.
+    std::vector<EdgeId>     _large_child_counts; // In the order of the groups with LARGE_CHILD_COUNT.
+    std::vector<NodeId>     _children;
+
+    template <typename ParentOf, typename Visitor>
+    void _for_each_group(ParentOf const& parent_of, Visitor& visit) const {
+        std::span<NodeId const> const children         = _children;
+        size_t                        first_child      = 0;
+        size_t                        large_counts_idx = 0;
+        for (size_t group = 0; group < _child_counts.size(); group++) {
+            size_t num_children = _child_counts[group];
+            if (num_children == LARGE_CHILD_COUNT) [[unlikely]] {
+                num_children = _large_child_counts[large_counts_idx++];
+            }
+            visit(parent_of(group), children.subspan(first_child, num_children));
+            first_child += num_children;
+        }
+        KASSERT(first_child == _children.size(), "The child counts do not match the children.", sfkit::assert::light);
+    }
+};
+
+} // namespace sfkit::dag
@@ -1,16 +1,21 @@
 #pragma once
 
 // #include <sparsehash/dense_hash_map>
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <unordered_set>
 
 #include <kassert/kassert.hpp>
 #include <sfkit/include-redirects/cereal.hpp>
 
 #include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCSREdges.hpp"
+#include "sfkit/dag/DAGLevels.hpp"
 #include "sfkit/graph/AdjacencyArrayGraph.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/SubtreeHasher.hpp"
+#include "sfkit/samples/SampleIdMap.hpp"
 #include "sfkit/samples/SampleSet.hpp"
 #include "sfkit/tskit/tskit.hpp"
 #include "sfkit/utils/checking_casts.hpp"
@@ -23,8 +28,17 @@ using sfkit::graph::EdgeListGraph;
 using sfkit::graph::NodeId;
 using sfkit::graph::TreeId;
 using sfkit::samples::SampleId;
+using sfkit::samples::SampleIdMap;
 using sfkit::samples::SampleSet; // TODO Remove this dependency
 
+// How the ids of the inner nodes are assigned. The compressors hand them out in the order in which the subtrees are
+// first seen; relabel_nodes_in_postorder() (see DAGNodeRelabeling.hpp) renumbers them in post-order. The samples always
+// have the ids 0 ... num_samples - 1.
+enum class DAGNodeOrder : uint8_t {
+    FirstSeen,
+    Postorder,
+};
+
 class DAGCompressedForest {
 public:
     EdgeListGraph const& postorder_edges() const {
@@ -85,18 +99,31 @@ public:
         _dag_postorder_edges.insert_leaf(leaf);
     }
 
-    void insert_root(NodeId const root) {
-        _dag_postorder_edges.insert_root(root);
+    // Consecutive identical trees share their root (see EdgeListGraph::insert_root()).
+    void insert_root(NodeId const root, TreeId const num_trees = 1) {
+        _dag_postorder_edges.insert_root(root, num_trees);
     }
 
     void insert_edge(NodeId const from, NodeId const to) {
         _dag_postorder_edges.insert_edge(from, to);
     }
 
+    // One root per run of identical consecutive trees, in the order of the trees. If a tree of the tree sequence has
+    // multiple roots, its root in the DAG corresponds to tskit's virtual root, i.e. the roots of the tree are its
+    // children.
     [[nodiscard]] std::vector<NodeId> const& roots() const {
         return _dag_postorder_edges.roots();
     }
 
+    // The number of consecutive trees sharing roots()[root_idx].
+    [[nodiscard]] TreeId root_run_length(size_t const root_idx) const {
+        return _dag_postorder_edges.root_run_length(root_idx);
+    }
+
+    [[nodiscard]] NodeId root_of_tree(TreeId const tree_id) const {
+        return _dag_postorder_edges.root_of_tree(tree_id);
+    }
+
     [[nodiscard]] NodeId num_roots() const {
         return _dag_postorder_edges.num_roots();
     }
@@ -109,6 +136,15 @@ public:
         return _dag_postorder_edges.num_leaves();
     }
 
+    // Maps the sample ids of this forest to the node ids in the tree sequence it has been compressed from.
+    [[nodiscard]] SampleIdMap const& sample_ids() const {
+        return _sample_ids;
+    }
+
+    void sample_ids(SampleIdMap const& sample_ids) {
+        _sample_ids = sample_ids;
+    }
+
     [[nodiscard]] NodeId num_unique_subtrees() const {
         return _dag_postorder_edges.num_nodes();
     }
@@ -117,13 +153,102 @@ public:
         return _dag_postorder_edges.nodes();
     }
 
+    // Partition the edges by the height of their parent (see DAGLevels), e.g. to compute the number of samples below
+    // each node in parallel. Once computed, the levels are kept alongside the forest and stored in its archive, so
+    // that loading the forest is enough to process it in parallel; recompute them after modifying the edges.
+    void compute_levels() {
+        _levels = DAGLevels(_dag_postorder_edges);
+    }
+
+    [[nodiscard]] bool levels_are_computed() const {
+        return !_levels.empty();
+    }
+
+    [[nodiscard]] DAGLevels const& levels() const {
+        KASSERT(levels_are_computed(), "The levels have not been computed.", sfkit::assert::light);
+        KASSERT(_levels.num_edges() == num_edges(), "The levels are outdated.", sfkit::assert::light);
+        return _levels;
+    }
+
+    // Encode the edges in a CSR-like format (see DAGCSREdges), which a post-order sweep reads faster. This is an
+    // opt-in cache for queries, kept next to the edge list; it is neither computed nor stored automatically. Recompute
+    // it after modifying the edges.
+    void compute_csr_edges() {
+        _csr_edges = DAGCSREdges(_dag_postorder_edges);
+    }
+
+    [[nodiscard]] bool csr_edges_are_computed() const {
+        return !_csr_edges.empty();
+    }
+
+    [[nodiscard]] DAGCSREdges const& csr_edges() const {
+        KASSERT(csr_edges_are_computed(), "The CSR edges have not been computed.", sfkit::assert::light);
+        KASSERT(_csr_edges.num_edges() == num_edges(), "The CSR edges are outdated.", sfkit::assert::light);
+        return _csr_edges;
+    }
+
+    [[nodiscard]] DAGNodeOrder node_order() const {
+        return _node_order;
+    }
+
+    // Rename each node v to new_ids[v] (see EdgeListGraph::relabel_nodes()). The samples have to keep their ids. The
+    // mutations of the genomic sequence refer to the nodes, too; relabel them using the same ids.
+    void relabel_nodes(std::span<NodeId const> const new_ids, DAGNodeOrder const node_order) {
+        KASSERT(
+            [&]() {
+                for (SampleId sample = 0; sample < num_samples(); sample++) {
+                    if (new_ids[sample] != sample) {
+                        return false;
+                    }
+                }
+                return true;
+            }(),
+            "The samples have to keep their ids.",
+            sfkit::assert::light
+        );
+        _dag_postorder_edges.relabel_nodes(new_ids);
+        _node_order = node_order;
+        if (levels_are_computed()) {
+            compute_levels();
+        }
+        if (csr_edges_are_computed()) {
+            compute_csr_edges();
+        }
+    }
+
+    // The archive holds the edges in the more compact CSR encoding (see DAGCSREdges). When loading, we decode them into
+    // the edge list and keep only the latter.
     template <class Archive>
-    void serialize(Archive& ar) {
-        // The number of nodes in the DAG are computed during serialization of the EdgeListGraph object.
-        ar(_dag_postorder_edges);
+    void save(Archive& ar) const {
+        ar(_sample_ids, _levels, _node_order);
+        _dag_postorder_edges.save_without_edges(ar);
+        if (csr_edges_are_computed()) {
+            ar(_csr_edges);
+        } else {
+            ar(DAGCSREdges(_dag_postorder_edges));
+        }
+    }
+
+    template <class Archive>
+    void load(Archive& ar) {
+        ar(_sample_ids, _levels, _node_order);
+        _dag_postorder_edges.load_without_edges(ar);
+        _csr_edges = DAGCSREdges();
+
+        DAGCSREdges csr_edges;
+        ar(csr_edges);
+        csr_edges.for_each_parent([this](NodeId const parent, std::span<NodeId const> const children) {
+            for (NodeId const child: children) {
+                _dag_postorder_edges.insert_edge(parent, child);
+            }
+        });
     }
 
 private:
     EdgeListGraph _dag_postorder_edges;
+    SampleIdMap   _sample_ids;
+    DAGLevels     _levels;
+    DAGCSREdges   _csr_edges;
+    DAGNodeOrder  _node_order = DAGNodeOrder::FirstSeen;
 };
 } // namespace sfkit::dag
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <sfkit/include-redirects/cereal.hpp>
+
+#include "sfkit/graph/SubtreeCollisionVerifier.hpp"
+#include "sfkit/graph/SubtreeHashToNodeMapper.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+
+namespace sfkit::graph {
+
+// Everything the DAGForestCompressor needs in order to append further trees to a forest it compressed earlier (see
+// DAGForestCompressor::append()). It is stored alongside the .forest archive (see CompressedForestIO).
+template <typename SubtreeHash>
+struct BasicDAGCompressorState {
+    std::vector<SubtreeHash>                  sample_hashes;
+    BasicSubtreeHashToNodeMapper<SubtreeHash> subtree_to_sf_node;
+    SubtreeCollisionVerifier                  collision_verifier; // Empty if the hashes were trusted.
+
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(sample_hashes, subtree_to_sf_node, collision_verifier);
+    }
+};
+
+} // namespace sfkit::graph
+
+namespace sfkit::dag {
+using DAGCompressorState = sfkit::graph::BasicDAGCompressorState<sfkit::graph::SubtreeHash>;
+}
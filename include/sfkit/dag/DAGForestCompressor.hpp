@@ -1,42 +1,92 @@
 #pragma once
 
 // #include <sparsehash/dense_hash_map>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include <kassert/kassert.hpp>
 #include <sfkit/include-redirects/hopscotch_map.hpp>
 
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/dag/DAGCompressorState.hpp"
 #include "sfkit/graph/AdjacencyArrayGraph.hpp"
+#include "sfkit/graph/CompressionStats.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/ForestCompressor.hpp"
+#include "sfkit/graph/SubtreeCollisionVerifier.hpp"
 #include "sfkit/graph/SubtreeHashToNodeMapper.hpp"
 #include "sfkit/graph/SubtreeHasher.hpp"
 #include "sfkit/graph/TsToSfNodeMapper.hpp"
+#include "sfkit/samples/SampleIdMap.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
 #include "sfkit/sequence/GenomicSequenceFactory.hpp"
 #include "sfkit/tskit/tskit.hpp"
+#include "sfkit/utils/SPSCRingBuffer.hpp"
 #include "sfkit/utils/checking_casts.hpp"
 #include "sfkit/utils/concepts.hpp"
 
 namespace sfkit::graph {
 
 using sfkit::dag::DAGCompressedForest;
+using sfkit::dag::DAGNodeOrder;
 using sfkit::utils::asserting_cast;
 using namespace sfkit::graph;
 
-template <>
-class ForestCompressor<DAGCompressedForest> {
+template <typename HashPolicy>
+class ForestCompressor<DAGCompressedForest, HashPolicy> {
 public:
-    ForestCompressor(tskit::TSKitTreeSequence& tree_sequence)
+    using SubtreeHash             = typename HashPolicy::SubtreeHash;
+    using SubtreeHasher           = BasicSubtreeHasher<HashPolicy>;
+    using SubtreeHashToNodeMapper = BasicSubtreeHashToNodeMapper<SubtreeHash>;
+    using State                   = BasicDAGCompressorState<SubtreeHash>;
+
+    ForestCompressor(
+        tskit::TSKitTreeSequence& tree_sequence, HashCollisionHandling collision_handling = HashCollisionHandling::Trust
+    )
         : _tree_sequence(tree_sequence),
           _num_samples(tree_sequence.num_samples()),
-          _ts_tree(tree_sequence) {
-        if (!tree_sequence.sample_ids_are_consecutive()) {
-            throw std::runtime_error("Sample IDs of the tree sequence are not consecutive.");
+          _sample_ids(tree_sequence),
+          _ts_tree(tree_sequence),
+          _collision_handling(collision_handling) {
+        // The last entry is used by the virtual root of trees with multiple roots (see TSKitTree::root()).
+        _ts_node_to_subtree.resize(_ts_tree.max_node_id() + 1);
+    }
+
+    // Continue the compression of an earlier compressor (see release_state()), e.g. with a state loaded from disk. The
+    // tree sequence holds the trees to append (see append()); its samples have to be the ones of the earlier
+    // compression.
+    ForestCompressor(
+        tskit::TSKitTreeSequence& tree_sequence,
+        State&&                   state,
+        HashCollisionHandling     collision_handling = HashCollisionHandling::Trust
+    )
+        : ForestCompressor(tree_sequence, collision_handling) {
+        if (state.sample_hashes.size() != _num_samples) {
+            throw std::runtime_error("The number of samples differs from the one of the earlier compression.");
+        }
+        for (SampleId sample_id = 0; sample_id < _num_samples; sample_id++) {
+            if (state.sample_hashes[sample_id] != _subtree_hash_factory.hash_sample(sample_id)) {
+                throw std::runtime_error("The earlier compression used a different subtree hashing policy.");
+            }
+            _ts_node_to_subtree[asserting_cast<size_t>(_sample_ids.ts_node_id(sample_id))] =
+                state.sample_hashes[sample_id];
+        }
+
+        _subtree_to_sf_node = std::move(state.subtree_to_sf_node);
+        if (_collision_handling != HashCollisionHandling::Trust) {
+            if (state.collision_verifier.num_nodes() != _subtree_to_sf_node.num_nodes()) {
+                throw std::runtime_error("Cannot verify the subtree hashes, the earlier compression trusted them.");
+            }
+            _collision_verifier = std::move(state.collision_verifier);
         }
-        _ts_node_to_subtree.resize(_ts_tree.max_node_id());
     }
 
     template <typename GenomicSequenceFactoryT>
@@ -46,83 +96,531 @@ public:
         // Add the samples to the compressed forest here so they have the same ID in all trees.
         _register_samples(forest);
 
-        // TODO Rewrite this, once we have the tree_sequence iterator
-        for (_ts_tree.first(); _ts_tree.is_tree(); _ts_tree.next()) {
-            auto const invalidated_nodes = _ts_tree.invalidated_nodes();
+        _compress_trees(forest, genomic_sequence_factory, 0, _tree_sequence.num_trees());
 
-            for (auto const ts_node_id: _ts_tree.postorder()) {
-                // Samples are already mapped and added to the DAG before processing the first tree.
-                if (is_sample(ts_node_id)) [[unlikely]] {
-                    continue;
-                }
+        genomic_sequence_factory.finalize();
+        _finalize(forest);
+
+        return forest;
+    }
+
+    // Compress contiguous ranges of trees on num_threads threads and merge the partial DAGs afterwards. The resulting
+    // forest and genomic sequence are identical to the ones built by the sequential compress() above.
+    DAGCompressedForest compress(sequence::GenomicSequenceFactory& genomic_sequence_factory, size_t const num_threads) {
+        TreeId const num_trees  = _tree_sequence.num_trees();
+        size_t const num_chunks = std::min<size_t>(num_threads, num_trees);
+        if (num_chunks <= 1) {
+            return compress(genomic_sequence_factory);
+        }
+        if (_stats) {
+            throw std::runtime_error("The parallel compression does not collect statistics.");
+        }
 
-                // If this node (== subtree) didn't change, skip it.
-                if (!invalidated_nodes.contains(ts_node_id) && !_ts_tree.is_root(ts_node_id)) {
-                    continue;
+        // Each worker uses its own tree, hash map and genomic sequence factory; they share only the (read-only) tree
+        // sequence. The node ids of the partial DAGs are local to the respective range of trees.
+        std::vector<PartialForest>      partial_forests(num_chunks);
+        std::vector<std::exception_ptr> exceptions(num_chunks);
+        std::vector<std::thread>        workers;
+        workers.reserve(num_chunks);
+        for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+            TreeId const first_tree = asserting_cast<TreeId>(chunk * num_trees / num_chunks);
+            TreeId const end_tree   = asserting_cast<TreeId>((chunk + 1) * num_trees / num_chunks);
+            workers.emplace_back([this,
+                                  &partial_forests,
+                                  &exceptions,
+                                  &site_to_tree = genomic_sequence_factory.site_to_tree(),
+                                  chunk,
+                                  first_tree,
+                                  end_tree]() {
+                try {
+                    ForestCompressor compressor(_tree_sequence, _collision_handling);
+                    auto&            partial = partial_forests[chunk];
+                    partial.sequence_factory.emplace(_tree_sequence, first_tree, end_tree, site_to_tree);
+
+                    compressor._register_samples(partial.forest);
+                    compressor._compress_trees(partial.forest, *partial.sequence_factory, first_tree, end_tree);
+                    partial.num_nodes = compressor._subtree_to_sf_node.num_nodes();
+                } catch (...) {
+                    exceptions[chunk] = std::current_exception();
                 }
+            });
+        }
+        for (auto& worker: workers) {
+            worker.join();
+        }
+        for (auto const& exception: exceptions) {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
 
-                // Compute the subtree ID of this inner node by hashing the subtree IDs of its children.
-                _subtree_hash_factory.reset();
+        // Merge the partial DAGs in the order of their trees. This assigns the node ids in the same order as the
+        // sequential compression does.
+        DAGCompressedForest forest;
+        _register_samples(forest);
+        for (auto& partial: partial_forests) {
+            _merge(forest, partial, genomic_sequence_factory);
+            // Free the memory of the partial forest early.
+            partial.forest = DAGCompressedForest{};
+            partial.sequence_factory.reset();
+        }
 
-                // TODO Don't reserve memory for this. Save the current position in the edge list, add the target
-                // nodes without the from edge and fix the from edge at the end of this block.
-                std::vector<NodeId> children_sf_node_ids;
+        genomic_sequence_factory.finalize();
+        _finalize(forest);
 
-                for (auto child_ts_id: _ts_tree.children(ts_node_id)) {
-                    auto const childs_subtree_id = _ts_node_to_subtree[asserting_cast<size_t>(child_ts_id)];
+        return forest;
+    }
+
+    // Overlap advancing the tskit tree with compressing the trees. A producer thread advances the tskit tree and
+    // extracts the (invalidated) nodes of each tree together with their children. The calling thread consumes these
+    // work items, hashes the subtrees, inserts them into the DAG and processes the mutations. The work items are
+    // passed through a bounded ring buffer holding at most queue_capacity trees. The resulting forest and genomic
+    // sequence are identical to the ones built by the sequential compress() above.
+    //
+    // If collecting statistics, the producer measures the advance_time of each tree; it thus overlaps with the other
+    // phases, which the consumer measures.
+    template <typename GenomicSequenceFactoryT>
+    DAGCompressedForest
+    compress_pipelined(GenomicSequenceFactoryT& genomic_sequence_factory, size_t const queue_capacity = 16) {
+        DAGCompressedForest forest;
+        _register_samples(forest);
+
+        // The producer must not access _stats, which the consumer modifies.
+        bool const collect_stats = _stats.has_value();
 
-                    _subtree_hash_factory.append_child(childs_subtree_id);
+        utils::SPSCRingBuffer<TreeWorkItem> queue(queue_capacity);
+        std::atomic<bool>                   aborted = false;
+        std::exception_ptr                  producer_exception;
 
-                    KASSERT(_subtree_to_sf_node.contains(childs_subtree_id));
-                    children_sf_node_ids.emplace_back(_subtree_to_sf_node[childs_subtree_id]);
+        // Busy-wait for the next slot, until the other thread aborted the compression.
+        auto wait_for_slot = [&aborted](auto try_slot) -> TreeWorkItem* {
+            TreeWorkItem* slot = try_slot();
+            while (slot == nullptr) {
+                if (aborted.load(std::memory_order_relaxed)) {
+                    return nullptr;
                 }
-                SubtreeHash const subtree_id = _subtree_hash_factory.hash();
-
-                // Map the DAG subtree ID to the node ID in the DAG.
-                KASSERT(asserting_cast<size_t>(ts_node_id) < _ts_node_to_subtree.size());
-                _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)] = subtree_id;
-
-                // Add this node to the DAG if not already present. As the DAG is stored as a list of edges, we need to
-                // add an edge from this node to each of its children.  In the case that two trees in the tree sequence
-                // are exactly identical, we want wo root nodes in the DAG -- one for each of the two trees.
-                bool const subtree_is_root = _ts_tree.is_root(ts_node_id);
-                auto const sf_node_it      = _subtree_to_sf_node.find(subtree_id);
-                bool const subtree_in_dag  = sf_node_it != _subtree_to_sf_node.end();
-
-                // If the subtree is not in the DAG or if it is a root node, add it to the DAG.
-                if (!subtree_in_dag || subtree_is_root) [[unlikely]] {
-                    NodeId sf_node_id = INVALID_NODE_ID;
-
-                    // Root nodes can have the same ID (if both trees are identical), but don't have in edges. Thus,
-                    // we don't need to map their ID.
-                    if (subtree_is_root) [[unlikely]] {
-                        sf_node_id = _subtree_to_sf_node.insert_or_update_node(subtree_id);
-
-                        // If the node is a root node in the tree sequence, also add it to the DAG as a root node.
-                        forest.insert_root(sf_node_id);
-                    } else {
-                        sf_node_id = _subtree_to_sf_node.insert_node(subtree_id);
+                std::this_thread::yield();
+                slot = try_slot();
+            }
+            return slot;
+        };
+
+        std::thread producer([this, &queue, &aborted, &producer_exception, &wait_for_slot, collect_stats]() {
+            try {
+                auto try_writable_slot = [&queue]() {
+                    return queue.try_writable_slot();
+                };
+                using Clock                     = CompressionStats::Clock;
+                Clock::time_point advance_start = collect_stats ? Clock::now() : Clock::time_point{};
+                for (_ts_tree.first(); _ts_tree.is_tree(); _ts_tree.next()) {
+                    // Waiting for a free slot does not count towards the time spent advancing the tree.
+                    auto const    wait_start = collect_stats ? Clock::now() : Clock::time_point{};
+                    TreeWorkItem* work_item  = wait_for_slot(try_writable_slot);
+                    if (work_item == nullptr) {
+                        return;
+                    }
+                    auto const extract_start = collect_stats ? Clock::now() : Clock::time_point{};
+                    _extract_work_item(*work_item);
+                    if (collect_stats) [[unlikely]] {
+                        work_item->advance_time = (wait_start - advance_start) + (Clock::now() - extract_start);
                     }
-                    KASSERT(sf_node_id != INVALID_NODE_ID);
+                    queue.commit_write();
+                    if (collect_stats) [[unlikely]] {
+                        advance_start = Clock::now();
+                    }
+                }
 
-                    // Add the edges from this sf node to its children's sf nodes to the DAG
-                    for (auto&& child: children_sf_node_ids) {
-                        forest.insert_edge(sf_node_id, child);
+                TreeWorkItem* work_item = wait_for_slot(try_writable_slot);
+                if (work_item != nullptr) {
+                    work_item->is_end = true;
+                    queue.commit_write();
+                }
+            } catch (...) {
+                producer_exception = std::current_exception();
+                aborted.store(true, std::memory_order_relaxed);
+            }
+        });
+
+        try {
+            auto try_readable_slot = [&queue]() {
+                return queue.try_readable_slot();
+            };
+            for (TreeWorkItem* work_item = wait_for_slot(try_readable_slot); work_item != nullptr && !work_item->is_end;
+                 work_item               = wait_for_slot(try_readable_slot)) {
+                if (_stats) [[unlikely]] {
+                    _stats->start_tree(work_item->tree_id, work_item->left, work_item->right);
+                    auto& tree_stats                 = _stats->current();
+                    tree_stats.advance_time          = work_item->advance_time;
+                    tree_stats.num_visited_nodes     = work_item->num_visited_nodes;
+                    tree_stats.num_invalidated_nodes = work_item->num_invalidated_nodes;
+                }
+
+                if (work_item->is_identical_to_previous) [[unlikely]] {
+                    // This tree is identical to the previous one. It shares its root; there is nothing to hash.
+                    forest.insert_root(forest.roots().back());
+                } else {
+                    std::span<tsk_id_t const> const children(work_item->children);
+                    size_t                          children_begin = 0;
+                    for (auto const& node: work_item->nodes) {
+                        _compress_node(
+                            forest,
+                            node.ts_node_id,
+                            node.is_root,
+                            children.subspan(children_begin, node.children_end - children_begin)
+                        );
+                        children_begin = node.children_end;
                     }
                 }
+
+                // Process the mutations of this tree
+                auto const mutations_start =
+                    _stats ? CompressionStats::Clock::now() : CompressionStats::Clock::time_point{};
+                genomic_sequence_factory.process_mutations(
+                    work_item->tree_id,
+                    graph::TsToSfNodeMapper(_ts_node_to_subtree, _subtree_to_sf_node)
+                );
+                if (_stats) [[unlikely]] {
+                    _stats->current().mutations_time += CompressionStats::Clock::now() - mutations_start;
+                    _stats->finish_tree(_subtree_to_sf_node.size(), _subtree_to_sf_node.load_factor());
+                }
+                queue.release_read();
+            }
+        } catch (...) {
+            aborted.store(true, std::memory_order_relaxed);
+            producer.join();
+            throw;
+        }
+        producer.join();
+        if (producer_exception) {
+            std::rethrow_exception(producer_exception);
+        }
+
+        genomic_sequence_factory.finalize();
+        _finalize(forest);
+
+        return forest;
+    }
+
+    // Append the trees of the tree sequence to a forest compressed earlier. This compressor has to be constructed with
+    // the state of the compressor which built the forest. The tree sequence has to cover the genomic region directly
+    // following the one of the forest; its sites and mutations are appended to the genomic sequence. The time required
+    // is proportional to the size of the appended tree sequence only. The forest and sequence are the same as if the
+    // concatenated tree sequence had been compressed at once.
+    void append(DAGCompressedForest& forest, sequence::GenomicSequence& sequence) {
+        if (forest.num_nodes() != _subtree_to_sf_node.num_nodes() || forest.num_samples() != _num_samples) {
+            throw std::runtime_error("The compressed forest does not match the state of the compressor.");
+        }
+        if (forest.node_order() != DAGNodeOrder::FirstSeen) {
+            // The state maps the subtrees to the node ids assigned during compression.
+            throw std::runtime_error("Cannot append to a forest whose nodes have been relabeled.");
+        }
+        TreeId const num_trees_before = forest.num_trees();
+
+        sequence::GenomicSequenceFactory sequence_factory(_tree_sequence);
+        _compress_trees(forest, sequence_factory, 0, _tree_sequence.num_trees());
+        sequence_factory.finalize();
+        sequence.append(sequence_factory.move_storage(), num_trees_before);
+
+        KASSERT(forest.num_trees() == num_trees_before + _tree_sequence.num_trees());
+        forest.postorder_edges().unset_num_nodes();
+        forest.num_nodes(_subtree_to_sf_node.num_nodes());
+        if (forest.levels_are_computed()) {
+            forest.compute_levels();
+        }
+        if (forest.csr_edges_are_computed()) {
+            forest.compute_csr_edges();
+        }
+    }
+
+    // Hand out the state required to append further trees later on (see append()). The state can be saved alongside the
+    // compressed forest using CompressedForestIO. This compressor must not be used afterwards.
+    [[nodiscard]] State release_state() {
+        State state;
+        state.sample_hashes.reserve(_num_samples);
+        for (SampleId sample_id = 0; sample_id < _num_samples; sample_id++) {
+            auto const ts_node_id = _sample_ids.ts_node_id(sample_id);
+            state.sample_hashes.push_back(_ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)]);
+        }
+        state.subtree_to_sf_node = std::move(_subtree_to_sf_node);
+        state.collision_verifier = std::move(_collision_verifier);
+        return state;
+    }
+
+    // Collect statistics on the next calls to compress(GenomicSequenceFactoryT&) and compress_pipelined(). The
+    // parallel compression does not collect statistics and throws if asked to.
+    void collect_stats(bool const keep_per_tree_stats = true) {
+        _stats.emplace(keep_per_tree_stats);
+    }
+
+    [[nodiscard]] std::optional<CompressionStats> const& stats() const {
+        return _stats;
+    }
+
+    // The (approximate) memory used by the hash map from subtree hashes to node ids.
+    [[nodiscard]] size_t subtree_map_memory_usage() const {
+        return _subtree_to_sf_node.memory_usage();
+    }
+
+    // The number of hash hits for which the subtrees turned out to be different. Only counted if the hash collisions
+    // are not trusted; with HashCollisionHandling::Report, the first collision throws.
+    [[nodiscard]] size_t num_hash_collisions() const {
+        return _num_hash_collisions;
+    }
+
+private:
+    tskit::TSKitTreeSequence&           _tree_sequence;
+    tsk_size_t                          _num_samples;
+    samples::SampleIdMap                _sample_ids;
+    tskit::TSKitTree                    _ts_tree;
+    std::vector<SubtreeHash>            _ts_node_to_subtree;
+    SubtreeHashToNodeMapper             _subtree_to_sf_node;
+    SubtreeHasher                       _subtree_hash_factory;
+    std::vector<NodeId>                 _children_sf_node_ids;
+    HashCollisionHandling               _collision_handling;
+    SubtreeCollisionVerifier            _collision_verifier;
+    size_t                              _num_hash_collisions = 0;
+    std::optional<CompressionStats>     _stats;
+    CompressionStats::Clock::time_point _stats_last_tree_end;
+
+    // An inner node of a tree handed from the producer to the consumer of the pipelined compression. Its children are
+    // stored in TreeWorkItem::children, directly after the ones of the previous node.
+    struct PipelinedNode {
+        tsk_id_t ts_node_id;
+        bool     is_root;
+        size_t   children_end;
+    };
+
+    // Everything the consumer of the pipelined compression needs to know about a tree. The producer reuses the work
+    // items, thus, the vectors keep their capacity.
+    struct TreeWorkItem {
+        TreeId                     tree_id                  = 0;
+        bool                       is_end                   = false; // No more trees follow.
+        bool                       is_identical_to_previous = false; // Shares the root of the previous tree.
+        std::vector<PipelinedNode> nodes;                            // The nodes to compress, in postorder.
+        std::vector<tsk_id_t>      children;
+
+        // For the statistics only.
+        double                         left                  = 0;
+        double                         right                 = 0;
+        size_t                         num_visited_nodes     = 0;
+        size_t                         num_invalidated_nodes = 0;
+        TreeCompressionStats::Duration advance_time{0};
+    };
+
+    // The DAG built from a contiguous range of trees by a single worker of the parallel compression.
+    struct PartialForest {
+        DAGCompressedForest                             forest;
+        NodeId                                          num_nodes = 0;
+        std::optional<sequence::GenomicSequenceFactory> sequence_factory;
+    };
+
+    // Compress the trees [first_tree, end_tree) into the given forest.
+    template <typename GenomicSequenceFactoryT>
+    void _compress_trees(
+        DAGCompressedForest&     forest,
+        GenomicSequenceFactoryT& genomic_sequence_factory,
+        TreeId const             first_tree,
+        TreeId const             end_tree
+    ) {
+        if (_stats) [[unlikely]] {
+            _stats_last_tree_end = CompressionStats::Clock::now();
+        }
+
+        // TODO Rewrite this, once we have the tree_sequence iterator
+        for (_ts_tree.seek_index(asserting_cast<tsk_id_t>(first_tree));
+             _ts_tree.is_tree() && asserting_cast<TreeId>(_ts_tree.tree_id()) < end_tree;
+             _ts_tree.next()) {
+            // We did not process the predecessor of the first tree of this range; thus, all its nodes are new to us.
+            // For all other trees, we visit only the nodes whose subtree changed (and the root) -- derived from the
+            // edges inserted and removed when moving to this tree. All other nodes (== subtrees) are already mapped.
+            bool const is_first_tree = asserting_cast<TreeId>(_ts_tree.tree_id()) == first_tree;
+            if (!is_first_tree && _ts_tree.edge_diff_is_empty()) [[unlikely]] {
+                // This tree is identical to the previous one. It shares its root; there is nothing to hash.
+                if (_stats) [[unlikely]] {
+                    _stats_start_tree(0, 0);
+                }
+                forest.insert_root(forest.roots().back());
+            } else {
+                auto const ts_nodes = is_first_tree ? _ts_tree.postorder() : _ts_tree.invalidated_postorder();
+                if (_stats) [[unlikely]] {
+                    _stats_start_tree(
+                        ts_nodes.size(),
+                        is_first_tree ? ts_nodes.size() : _ts_tree.num_invalidated_nodes()
+                    );
+                }
+
+                for (auto const ts_node_id: ts_nodes) {
+                    // Samples are already mapped and added to the DAG before processing the first tree.
+                    if (is_sample(ts_node_id)) [[unlikely]] {
+                        continue;
+                    }
+                    _compress_node(forest, ts_node_id, _ts_tree.is_root(ts_node_id), _ts_tree.children(ts_node_id));
+                }
             }
 
             // Process the mutations of this tree
+            auto const mutations_start =
+                _stats ? CompressionStats::Clock::now() : CompressionStats::Clock::time_point{};
             genomic_sequence_factory.process_mutations(
                 asserting_cast<TreeId>(_ts_tree.tree_id()),
                 graph::TsToSfNodeMapper(_ts_node_to_subtree, _subtree_to_sf_node)
             );
+            if (_stats) [[unlikely]] {
+                _stats_last_tree_end = CompressionStats::Clock::now();
+                _stats->current().mutations_time += _stats_last_tree_end - mutations_start;
+                _stats->finish_tree(_subtree_to_sf_node.size(), _subtree_to_sf_node.load_factor());
+            }
         }
+    }
 
-        genomic_sequence_factory.finalize();
+    // The time between finishing the last tree and starting this one is spent advancing the tskit tree and computing
+    // the nodes to visit.
+    void _stats_start_tree(size_t const num_visited_nodes, size_t const num_invalidated_nodes) {
+        _stats->start_tree(asserting_cast<TreeId>(_ts_tree.tree_id()), _ts_tree.left(), _ts_tree.right());
+        auto& tree_stats                 = _stats->current();
+        tree_stats.advance_time          = CompressionStats::Clock::now() - _stats_last_tree_end;
+        tree_stats.num_visited_nodes     = num_visited_nodes;
+        tree_stats.num_invalidated_nodes = num_invalidated_nodes;
+    }
+
+    // Hash the subtree of an inner node from the subtrees of its children and add it to the DAG if it is new.
+    template <typename ChildrenT>
+    void _compress_node(
+        DAGCompressedForest& forest, tsk_id_t const ts_node_id, bool const subtree_is_root, ChildrenT&& children
+    ) {
+        auto const hashing_start = _stats ? CompressionStats::Clock::now() : CompressionStats::Clock::time_point{};
+
+        // Compute the subtree ID of this inner node by hashing the subtree IDs of its children.
+        _subtree_hash_factory.reset();
+
+        // Reuse the buffer for the children's sf node ids across nodes and trees to avoid allocations.
+        _children_sf_node_ids.clear();
+
+        for (auto child_ts_id: children) {
+            auto const childs_subtree_id = _ts_node_to_subtree[asserting_cast<size_t>(child_ts_id)];
+
+            _subtree_hash_factory.append_child(childs_subtree_id);
+
+            KASSERT(_subtree_to_sf_node.contains(childs_subtree_id));
+            _children_sf_node_ids.emplace_back(_subtree_to_sf_node[childs_subtree_id]);
+        }
+        SubtreeHash subtree_id = _subtree_hash_factory.hash();
+
+        auto const map_start = _stats ? CompressionStats::Clock::now() : CompressionStats::Clock::time_point{};
+
+        // Add this node to the DAG if not already present. As the DAG is stored as a list of edges, we need to
+        // add an edge from this node to each of its children.  In the case that two trees in the tree sequence
+        // are exactly identical, we want wo root nodes in the DAG -- one for each of the two trees.
+        auto const sf_node_it     = _find_subtree(subtree_id, _children_sf_node_ids);
+        bool const subtree_in_dag = sf_node_it != _subtree_to_sf_node.end();
+
+        // Map the DAG subtree ID to the node ID in the DAG.
+        KASSERT(asserting_cast<size_t>(ts_node_id) < _ts_node_to_subtree.size());
+        _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)] = subtree_id;
+
+        // If the subtree is not in the DAG or if it is a root node, add it to the DAG. A tree identical to the
+        // previous one shares its root; we store runs of trees with the same root only once.
+        if (subtree_is_root && subtree_in_dag && _is_last_root(forest, sf_node_it->second)) [[unlikely]] {
+            forest.insert_root(sf_node_it->second);
+        } else if (!subtree_in_dag || subtree_is_root) [[unlikely]] {
+            NodeId sf_node_id = INVALID_NODE_ID;
+
+            // Root nodes can have the same ID (if both trees are identical), but don't have in edges. Thus,
+            // we don't need to map their ID.
+            if (subtree_is_root) [[unlikely]] {
+                sf_node_id = _subtree_to_sf_node.insert_or_update_node(subtree_id);
+
+                // If the node is a root node in the tree sequence, also add it to the DAG as a root node.
+                forest.insert_root(sf_node_id);
+            } else {
+                sf_node_id = _subtree_to_sf_node.insert_node(subtree_id);
+            }
+            KASSERT(sf_node_id != INVALID_NODE_ID);
 
-        KASSERT(forest.roots().size() == _tree_sequence.num_trees());
-        KASSERT(forest.num_roots() == _tree_sequence.num_trees());
+            // Add the edges from this sf node to its children's sf nodes to the DAG
+            for (auto&& child: _children_sf_node_ids) {
+                forest.insert_edge(sf_node_id, child);
+            }
+            _verifier_add_node(sf_node_id, _children_sf_node_ids);
+        }
+
+        if (_stats) [[unlikely]] {
+            auto& tree_stats = _stats->current();
+            tree_stats.hashing_time += map_start - hashing_start;
+            tree_stats.map_time += CompressionStats::Clock::now() - map_start;
+            if (subtree_in_dag) {
+                ++tree_stats.num_reused_subtrees;
+            } else {
+                ++tree_stats.num_new_subtrees;
+            }
+        }
+    }
+
+    // Look up the subtree in the DAG. Unless we trust the hash, check that the subtree found has the same children. On
+    // a collision, either throw or probe the secondary hashes of the subtree until we find the identical subtree or
+    // an unused hash. The hash used is returned in subtree_id.
+    auto _find_subtree(SubtreeHash& subtree_id, std::span<NodeId const> const children_sf_node_ids) {
+        auto sf_node_it = _subtree_to_sf_node.find(subtree_id);
+        if (_collision_handling == HashCollisionHandling::Trust) [[likely]] {
+            return sf_node_it;
+        }
+
+        SubtreeHash const primary_subtree_id = subtree_id;
+        for (XXH64_hash_t probe = 1; sf_node_it != _subtree_to_sf_node.end()
+                                     && !_collision_verifier.matches(sf_node_it->second, children_sf_node_ids);
+             ++probe) {
+            ++_num_hash_collisions;
+            if (_collision_handling == HashCollisionHandling::Report) {
+                throw std::runtime_error("Subtree hash collision: two different subtrees have the same hash.");
+            }
+            subtree_id = _subtree_hash_factory.probe(primary_subtree_id, probe);
+            sf_node_it = _subtree_to_sf_node.find(subtree_id);
+        }
+        return sf_node_it;
+    }
+
+    void _verifier_add_node(NodeId const sf_node_id, std::span<NodeId const> const children_sf_node_ids) {
+        if (_collision_handling != HashCollisionHandling::Trust) [[unlikely]] {
+            _collision_verifier.add_node(sf_node_id, children_sf_node_ids);
+        }
+    }
+
+    // Extract the nodes of the current tree which the consumer of the pipelined compression has to process.
+    void _extract_work_item(TreeWorkItem& work_item) {
+        bool const is_first_tree = _ts_tree.tree_id() == 0;
+
+        work_item.tree_id                  = asserting_cast<TreeId>(_ts_tree.tree_id());
+        work_item.is_end                   = false;
+        work_item.is_identical_to_previous = !is_first_tree && _ts_tree.edge_diff_is_empty();
+        work_item.left                     = _ts_tree.left();
+        work_item.right                    = _ts_tree.right();
+        work_item.nodes.clear();
+        work_item.children.clear();
+        if (work_item.is_identical_to_previous) [[unlikely]] {
+            // There is nothing to hash; see _compress_trees().
+            work_item.num_visited_nodes     = 0;
+            work_item.num_invalidated_nodes = 0;
+            return;
+        }
+
+        auto const ts_nodes             = is_first_tree ? _ts_tree.postorder() : _ts_tree.invalidated_postorder();
+        work_item.num_visited_nodes     = ts_nodes.size();
+        work_item.num_invalidated_nodes = is_first_tree ? ts_nodes.size() : _ts_tree.num_invalidated_nodes();
+        for (auto const ts_node_id: ts_nodes) {
+            // Samples are already mapped and added to the DAG before processing the first tree.
+            if (is_sample(ts_node_id)) [[unlikely]] {
+                continue;
+            }
+            for (auto child_ts_id: _ts_tree.children(ts_node_id)) {
+                work_item.children.push_back(child_ts_id);
+            }
+            work_item.nodes.push_back({ts_node_id, _ts_tree.is_root(ts_node_id), work_item.children.size()});
+        }
+    }
+
+    void _finalize(DAGCompressedForest& forest) {
+        KASSERT(forest.num_trees() == _tree_sequence.num_trees());
+        KASSERT(forest.num_roots() <= _tree_sequence.num_trees());
         KASSERT(forest.num_leaves() == _tree_sequence.num_samples());
 
         // Set the number of nodes in the DAG so it does not have to be recomputed.
@@ -130,35 +628,107 @@ public:
 
         // As we build the tree edges by a postorder traversal on the tree, the from edges should be post-ordered, too.
         forest.postorder_edges().traversal_order(TraversalOrder::Postorder);
+    }
 
-        return forest;
+    // Add the nodes of a partial DAG to the forest, replaying the decisions the sequential compression would have made
+    // for them. The partial DAG created its nodes in the same order as the sequential compression would, but it also
+    // created the ones which are already present in one of the preceding ranges. The edges of each node are stored
+    // consecutively and in the order of increasing (local) node ids. The (local) subtree hashes are not stored but
+    // recomputed from the edges.
+    void _merge(
+        DAGCompressedForest& forest, PartialForest const& partial, sequence::GenomicSequenceFactory& sequence_factory
+    ) {
+        std::vector<NodeId>      local_to_global(partial.num_nodes, INVALID_NODE_ID);
+        std::vector<SubtreeHash> local_subtree_hashes(partial.num_nodes, SubtreeHash{});
+
+        // The samples have the same ids in all partial DAGs.
+        for (NodeId sample_id = 0; sample_id < _num_samples; ++sample_id) {
+            auto const ts_node_id           = _sample_ids.ts_node_id(sample_id);
+            local_to_global[sample_id]      = sample_id;
+            local_subtree_hashes[sample_id] = _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)];
+        }
+
+        auto       edge_it  = partial.forest.postorder_edges().begin();
+        auto const edge_end = partial.forest.postorder_edges().end();
+        auto       root_it  = partial.forest.roots().begin();
+        auto const root_end = partial.forest.roots().end();
+
+        for (NodeId local_id = asserting_cast<NodeId>(_num_samples); local_id < partial.num_nodes; ++local_id) {
+            _subtree_hash_factory.reset();
+            _children_sf_node_ids.clear();
+            while (edge_it != edge_end && edge_it->from() == local_id) {
+                _subtree_hash_factory.append_child(local_subtree_hashes[edge_it->to()]);
+                KASSERT(local_to_global[edge_it->to()] != INVALID_NODE_ID, "Child has not been mapped yet.");
+                _children_sf_node_ids.push_back(local_to_global[edge_it->to()]);
+                ++edge_it;
+            }
+            SubtreeHash subtree_id = _subtree_hash_factory.hash();
+
+            bool const is_root    = root_it != root_end && *root_it == local_id;
+            auto const sf_node_it = _find_subtree(subtree_id, _children_sf_node_ids);
+            local_subtree_hashes[local_id] = subtree_id;
+            bool const subtree_in_dag      = sf_node_it != _subtree_to_sf_node.end();
+            if (subtree_in_dag && (!is_root || _is_last_root(forest, sf_node_it->second))) {
+                // The subtree is already present in one of the preceding ranges. If it is a root, the first trees of
+                // this range are identical to the last tree of the preceding range and share its root.
+                local_to_global[local_id] = sf_node_it->second;
+                if (is_root) {
+                    forest.insert_root(sf_node_it->second, _root_run_length(partial.forest, root_it));
+                    ++root_it;
+                }
+                continue;
+            }
+
+            NodeId sf_node_id = INVALID_NODE_ID;
+            if (is_root) {
+                sf_node_id = _subtree_to_sf_node.insert_or_update_node(subtree_id);
+                forest.insert_root(sf_node_id, _root_run_length(partial.forest, root_it));
+                ++root_it;
+            } else {
+                sf_node_id = _subtree_to_sf_node.insert_node(subtree_id);
+            }
+            local_to_global[local_id] = sf_node_id;
+
+            for (NodeId const child: _children_sf_node_ids) {
+                forest.insert_edge(sf_node_id, child);
+            }
+            _verifier_add_node(sf_node_id, _children_sf_node_ids);
+        }
+        KASSERT(edge_it == edge_end, "The edges of the partial DAG are not grouped by their from node.");
+        KASSERT(root_it == root_end, "Not all roots of the partial DAG have been merged.");
+
+        sequence_factory.append(*partial.sequence_factory, local_to_global);
+    }
+
+    // Is the node the root of the last tree added to the forest?
+    static bool _is_last_root(DAGCompressedForest const& forest, NodeId const sf_node_id) {
+        return forest.num_roots() != 0 && forest.roots().back() == sf_node_id;
+    }
+
+    // The number of trees sharing the root the iterator points to.
+    static TreeId
+    _root_run_length(DAGCompressedForest const& forest, std::vector<NodeId>::const_iterator const root_it) {
+        return forest.root_run_length(asserting_cast<size_t>(root_it - forest.roots().begin()));
     }
 
-private:
-    tskit::TSKitTreeSequence& _tree_sequence;
-    tsk_size_t                _num_samples;
-    tskit::TSKitTree          _ts_tree;
-    std::vector<SubtreeHash>  _ts_node_to_subtree;
-    SubtreeHashToNodeMapper   _subtree_to_sf_node;
-    SubtreeHasher             _subtree_hash_factory;
-
-    // The sample ids are consecutive: 0 ... num_samples - 1
     inline bool is_sample(tsk_id_t ts_node_id) const {
-        return ts_node_id < asserting_cast<tsk_id_t>(_num_samples);
+        return _sample_ids.is_sample(ts_node_id);
     }
 
-    // Add them to the compressed forest first, so they have the same IDs there.
+    // Add them to the compressed forest first, so they have the same IDs there: 0 ... num_samples - 1
     void _register_samples(DAGCompressedForest& forest) {
-        KASSERT(_tree_sequence.sample_ids_are_consecutive(), "Sample IDs are not consecutive.");
+        // The samples are numbered in the order of the tree sequence; store the mapping to the tskit node ids.
+        forest.sample_ids(_sample_ids);
         for (SampleId sample_id = 0; sample_id < _num_samples; sample_id++) {
-            KASSERT(_tree_sequence.is_sample(asserting_cast<tsk_id_t>(sample_id)));
+            tsk_id_t const ts_node_id = _sample_ids.ts_node_id(sample_id);
+            KASSERT(_tree_sequence.is_sample(ts_node_id));
 
             // Compute the subtree ID of this sample (leaf) node by hashing its label.
             auto subtree_hash = _subtree_hash_factory.hash_sample(sample_id);
 
             // Cache the subtree ID for this TS node
-            KASSERT(asserting_cast<size_t>(sample_id) < _ts_node_to_subtree.size());
-            _ts_node_to_subtree[asserting_cast<size_t>(sample_id)] = subtree_hash;
+            KASSERT(asserting_cast<size_t>(ts_node_id) < _ts_node_to_subtree.size());
+            _ts_node_to_subtree[asserting_cast<size_t>(ts_node_id)] = subtree_hash;
 
             // Map the DAG subtree ID to the corresponding node ID in the DAG. The first tree should insert all
             // the samples as the samples in all trees are identical.
@@ -169,6 +739,7 @@ private:
             );
             NodeId dag_node_id = _subtree_to_sf_node.insert_node(subtree_hash);
             forest.insert_leaf(dag_node_id);
+            _verifier_add_node(dag_node_id, {});
         }
     }
 };
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/cereal.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::dag {
+
+using sfkit::graph::EdgeId;
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::NodeId;
+using sfkit::utils::asserting_cast;
+
+// Partitions the edges of a DAG by the height of their parent. The leaves have height 0; each inner node is one higher
+// than its highest child. Level i contains the edges of the nodes of height i + 1. When processing the levels in
+// increasing order, all children of the nodes of a level have thus been finalized; the edges of a level can be
+// processed in parallel. In post-order, the edges of each parent are consecutive; instead of a copy of the edges, we
+// store the index of the first edge of each parent. Splitting a level between two of these gives each thread its own
+// set of parents to write to.
+class DAGLevels {
+public:
+    DAGLevels() = default;
+
+    // The edges of the DAG have to be in post-order.
+    explicit DAGLevels(EdgeListGraph const& dag) : _num_edges(dag.num_edges()) {
+        KASSERT(dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+        NodeId const num_nodes = dag.num_nodes();
+
+        // In post-order, all edges of a child precede the edges pointing to it.
+        std::vector<EdgeId> height(num_nodes, 0);
+        EdgeId              max_height = 0;
+        for (auto const& edge: dag) {
+            height[edge.from()] = std::max(height[edge.from()], height[edge.to()] + 1);
+            max_height          = std::max(max_height, height[edge.from()]);
+        }
+
+        // The first edge of each parent ...
+        std::vector<EdgeId> first_edges;
+        std::vector<NodeId> parents;
+        EdgeId              edge_idx = 0;
+        for (auto const& edge: dag) {
+            if (parents.empty() || parents.back() != edge.from()) {
+                first_edges.push_back(edge_idx);
+                parents.push_back(edge.from());
+            }
+            edge_idx++;
+        }
+        KASSERT(
+            [&]() {
+                std::vector<bool> seen(num_nodes, false);
+                for (NodeId const parent: parents) {
+                    if (seen[parent]) {
+                        return false;
+                    }
+                    seen[parent] = true;
+                }
+                return true;
+            }(),
+            "The edges of a parent are not consecutive.",
+            sfkit::assert::normal
+        );
+
+        // ... sorted (stable) by the height of the parent.
+        _level_starts.assign(max_height + 1ul, 0);
+        for (NodeId const parent: parents) {
+            _level_starts[height[parent]]++;
+        }
+        std::exclusive_scan(_level_starts.begin(), _level_starts.end(), _level_starts.begin(), EdgeId{0});
+        _first_edges.resize(first_edges.size());
+        std::vector<EdgeId> insert_pos(_level_starts.begin() + 1, _level_starts.end());
+        for (size_t group = 0; group < parents.size(); group++) {
+            _first_edges[insert_pos[height[parents[group]] - 1]++] = first_edges[group];
+        }
+        // Remove the (empty) level of the leaves, _level_starts[i] now is the start of level i.
+        _level_starts.erase(_level_starts.begin());
+        _level_starts.push_back(asserting_cast<EdgeId>(_first_edges.size()));
+
+        KASSERT(_level_starts.size() == num_levels() + 1ul);
+        KASSERT(_level_starts.back() == num_parents());
+    }
+
+    [[nodiscard]] size_t num_levels() const {
+        return _level_starts.empty() ? 0 : _level_starts.size() - 1;
+    }
+
+    // The index of the first edge of each parent in the level, in the order of the post-ordered edges.
+    [[nodiscard]] std::span<EdgeId const> level(size_t const level) const {
+        KASSERT(level < num_levels(), "Level out of bounds.", sfkit::assert::light);
+        return std::span<EdgeId const>(_first_edges)
+            .subspan(_level_starts[level], _level_starts[level + 1] - _level_starts[level]);
+    }
+
+    // The number of edges of the DAG the levels have been computed for.
+    [[nodiscard]] EdgeId num_edges() const {
+        return _num_edges;
+    }
+
+    // The number of nodes with at least one child.
+    [[nodiscard]] EdgeId num_parents() const {
+        return asserting_cast<EdgeId>(_first_edges.size());
+    }
+
+    // True for default-constructed levels only; the levels of a DAG without edges are not empty.
+    [[nodiscard]] bool empty() const {
+        return _level_starts.empty();
+    }
+
+    [[nodiscard]] size_t memory_usage() const {
+        return (_first_edges.size() + _level_starts.size()) * sizeof(EdgeId);
+    }
+
+    [[nodiscard]] bool operator==(DAGLevels const& other) const = default;
+
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(_num_edges, _first_edges, _level_starts);
+    }
+
+private:
+    EdgeId              _num_edges = 0;
+    std::vector<EdgeId> _first_edges;  // The first edge of each parent; sorted by the height of the parent.
+    std::vector<EdgeId> _level_starts; // The first parent of each level, followed by the number of parents.
+};
+
+} // namespace sfkit::dag
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/sequence/GenomicSequence.hpp"
+
+namespace sfkit::dag {
+
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::INVALID_NODE_ID;
+using sfkit::graph::NodeId;
+using sfkit::sequence::GenomicSequence;
+
+// New ids for the nodes of the DAG such that a sweep over its post-ordered edges accesses the per-node data (almost)
+// sequentially: The samples keep their ids 0 ... num_samples - 1. The inner nodes are numbered num_samples,
+// num_samples + 1, ... in the order in which they first appear as the parent of an edge. As all edges of a node are
+// consecutive in post-order, the parents are then visited in increasing order and each child has a smaller id than
+// its parent. Nodes without any edges (which are not samples) get the highest ids. Returns new_ids with new_ids[v]
+// being the new id of node v.
+inline std::vector<NodeId> postorder_node_ids(EdgeListGraph const& dag) {
+    KASSERT(dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+    NodeId const num_nodes   = dag.num_nodes();
+    NodeId const num_samples = dag.num_leaves();
+
+    std::vector<NodeId> new_ids(num_nodes, INVALID_NODE_ID);
+    for (NodeId sample = 0; sample < num_samples; sample++) {
+        new_ids[sample] = sample;
+    }
+
+    NodeId next_id = num_samples;
+    for (auto const& edge: dag) {
+        if (new_ids[edge.from()] == INVALID_NODE_ID) {
+            new_ids[edge.from()] = next_id++;
+        }
+    }
+    for (auto& new_id: new_ids) {
+        if (new_id == INVALID_NODE_ID) {
+            new_id = next_id++;
+        }
+    }
+    KASSERT(next_id == num_nodes, "The new ids are not a permutation of the node ids.", sfkit::assert::light);
+
+    return new_ids;
+}
+
+// Renumber the nodes of the DAG in post-order (see postorder_node_ids()) and remap the nodes of the mutations
+// accordingly. The relabeled forest can no longer be extended by the compressor it was built with.
+inline void relabel_nodes_in_postorder(DAGCompressedForest& forest, GenomicSequence& sequence) {
+    std::vector<NodeId> const new_ids = postorder_node_ids(forest.postorder_edges());
+    forest.relabel_nodes(new_ids, DAGNodeOrder::Postorder);
+    sequence.relabel_nodes(new_ids);
+}
+
+} // namespace sfkit::dag
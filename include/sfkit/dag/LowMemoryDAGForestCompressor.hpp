@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/graph/BoundedSubtreeHashToNodeMapper.hpp"
+#include "sfkit/graph/Edge.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/samples/SampleIdMap.hpp"
+#include "sfkit/tskit/tskit.hpp"
+#include "sfkit/utils/ChunkedVector.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::dag {
+
+using sfkit::graph::Edge;
+using sfkit::graph::INVALID_NODE_ID;
+using sfkit::graph::NodeId;
+using sfkit::graph::TraversalOrder;
+using sfkit::graph::TreeId;
+using sfkit::samples::SampleId;
+using sfkit::utils::asserting_cast;
+
+// Compresses a tree sequence to a DAGCompressedForest like the DAGForestCompressor, but with bounded peak memory. Use
+// it for tree sequences whose subtree hash map does not fit into memory.
+//
+// - The subtree hash map uses about memory_budget bytes at most (see BoundedSubtreeHashToNodeMapper). Subtrees which
+//   have not been seen for a while are dropped from it; if they recur later, they are stored again.
+// - For each tskit node, we store the node id of its subtree instead of its subtree hash. The hash of an inner node is
+//   thus computed from the node ids of its children instead of from their subtree hashes.
+// - The edges are collected in a ChunkedVector, which never reallocates, and moved to the forest at the end.
+//
+// As long as no subtree is dropped, the forest is the same as the one built by the DAGForestCompressor; otherwise, it
+// contains some subtrees more than once. The budget covers the subtree hash map only, not the tree sequence, the
+// per-node arrays, or the resulting forest and genomic sequence. The hashes are trusted (HashCollisionHandling::Trust).
+template <typename HashPolicy = graph::XXH3_128HashPolicy>
+class BasicLowMemoryDAGForestCompressor {
+public:
+    using SubtreeHash             = typename HashPolicy::SubtreeHash;
+    using SubtreeHasher           = graph::BasicSubtreeHasher<HashPolicy>;
+    using SubtreeHashToNodeMapper = graph::BasicBoundedSubtreeHashToNodeMapper<SubtreeHash>;
+
+    BasicLowMemoryDAGForestCompressor(tskit::TSKitTreeSequence& tree_sequence, size_t const memory_budget)
+        : _tree_sequence(tree_sequence),
+          _num_samples(tree_sequence.num_samples()),
+          _sample_ids(tree_sequence),
+          _ts_tree(tree_sequence),
+          _subtree_to_sf_node(memory_budget) {
+        // The last entry is used by the virtual root of trees with multiple roots (see TSKitTree::root()).
+        _ts_node_to_sf_node.resize(_ts_tree.max_node_id() + 1, INVALID_NODE_ID);
+    }
+
+    template <typename GenomicSequenceFactoryT>
+    DAGCompressedForest compress(GenomicSequenceFactoryT& genomic_sequence_factory) {
+        DAGCompressedForest forest;
+        _register_samples(forest);
+
+        auto const ts_to_sf_node = [this](size_t const ts_node_id) {
+            return _ts_node_to_sf_node[ts_node_id];
+        };
+
+        for (_ts_tree.first(); _ts_tree.is_tree(); _ts_tree.next()) {
+            bool const is_first_tree = _ts_tree.tree_id() == 0;
+            if (!is_first_tree && _ts_tree.edge_diff_is_empty()) [[unlikely]] {
+                // This tree is identical to the previous one. It shares its root; there is nothing to hash.
+                forest.insert_root(forest.roots().back());
+            } else {
+                auto const ts_nodes = is_first_tree ? _ts_tree.postorder() : _ts_tree.invalidated_postorder();
+                for (auto const ts_node_id: ts_nodes) {
+                    // Samples are already mapped and added to the DAG before processing the first tree.
+                    if (_sample_ids.is_sample(ts_node_id)) [[unlikely]] {
+                        continue;
+                    }
+                    _compress_node(forest, ts_node_id, _ts_tree.is_root(ts_node_id), _ts_tree.children(ts_node_id));
+                }
+            }
+
+            genomic_sequence_factory.process_mutations(asserting_cast<TreeId>(_ts_tree.tree_id()), ts_to_sf_node);
+        }
+        genomic_sequence_factory.finalize();
+
+        KASSERT(forest.num_trees() == _tree_sequence.num_trees());
+        KASSERT(forest.num_leaves() == _tree_sequence.num_samples());
+        forest.postorder_edges().insert_edges(_edges);
+        forest.num_nodes(_subtree_to_sf_node.num_nodes());
+        forest.postorder_edges().traversal_order(TraversalOrder::Postorder);
+
+        return forest;
+    }
+
+    // The number of subtrees dropped from the subtree hash map in order to stay within the memory budget.
+    [[nodiscard]] size_t num_dropped_subtrees() const {
+        return _subtree_to_sf_node.num_dropped();
+    }
+
+    // The memory used by the hash map from subtree hashes to node ids (see BoundedSubtreeHashToNodeMapper).
+    [[nodiscard]] size_t subtree_map_memory_usage() const {
+        return _subtree_to_sf_node.memory_usage();
+    }
+
+    // The number of subtrees the hash map keeps at least, before dropping the least recently seen ones.
+    [[nodiscard]] size_t subtree_map_generation_capacity() const {
+        return _subtree_to_sf_node.generation_capacity();
+    }
+
+private:
+    tskit::TSKitTreeSequence&  _tree_sequence;
+    tsk_size_t                 _num_samples;
+    samples::SampleIdMap       _sample_ids;
+    tskit::TSKitTree           _ts_tree;
+    std::vector<NodeId>        _ts_node_to_sf_node;
+    SubtreeHashToNodeMapper    _subtree_to_sf_node;
+    SubtreeHasher              _subtree_hash_factory;
+    std::vector<NodeId>        _children_sf_node_ids;
+    utils::ChunkedVector<Edge> _edges;
+
+    // Hash the subtree of an inner node from the node ids of its children and add it to the DAG if it is new.
+    template <typename ChildrenT>
+    void _compress_node(
+        DAGCompressedForest& forest, tsk_id_t const ts_node_id, bool const subtree_is_root, ChildrenT&& children
+    ) {
+        _subtree_hash_factory.reset();
+        _children_sf_node_ids.clear();
+        for (auto child_ts_id: children) {
+            NodeId const child_sf_node_id = _ts_node_to_sf_node[asserting_cast<size_t>(child_ts_id)];
+            KASSERT(child_sf_node_id != INVALID_NODE_ID, "Child has not been mapped yet.", sfkit::assert::light);
+            _subtree_hash_factory.append_child(_subtree_hash_factory.hash_sample(child_sf_node_id));
+            _children_sf_node_ids.push_back(child_sf_node_id);
+        }
+        SubtreeHash const subtree_id = _subtree_hash_factory.hash();
+
+        std::optional<NodeId> const sf_node_id = _subtree_to_sf_node.find(subtree_id);
+        if (sf_node_id && (!subtree_is_root || _is_last_root(forest, *sf_node_id))) {
+            // Either a known subtree or the tree is identical to the previous one and thus shares its root.
+            _ts_node_to_sf_node[asserting_cast<size_t>(ts_node_id)] = *sf_node_id;
+            if (subtree_is_root) {
+                forest.insert_root(*sf_node_id);
+            }
+            return;
+        }
+
+        // Identical trees which are not consecutive have a root each; we map the subtree to the most recent one.
+        NodeId const new_sf_node_id = subtree_is_root ? _subtree_to_sf_node.insert_or_update_node(subtree_id)
+                                                      : _subtree_to_sf_node.insert_node(subtree_id);
+        _ts_node_to_sf_node[asserting_cast<size_t>(ts_node_id)] = new_sf_node_id;
+        if (subtree_is_root) {
+            forest.insert_root(new_sf_node_id);
+        }
+        for (NodeId const child: _children_sf_node_ids) {
+            _edges.emplace_back(new_sf_node_id, child);
+        }
+    }
+
+    // Is the node the root of the last tree added to the forest?
+    static bool _is_last_root(DAGCompressedForest const& forest, NodeId const sf_node_id) {
+        return forest.num_roots() != 0 && forest.roots().back() == sf_node_id;
+    }
+
+    // The samples get the node ids 0 ... num_samples - 1. They are never looked up in the subtree hash map, as the
+    // subtrees of the inner nodes are identified by the node ids of their children.
+    void _register_samples(DAGCompressedForest& forest) {
+        forest.sample_ids(_sample_ids);
+        for (SampleId sample_id = 0; sample_id < _num_samples; sample_id++) {
+            tsk_id_t const ts_node_id = _sample_ids.ts_node_id(sample_id);
+            NodeId const   sf_node_id = _subtree_to_sf_node.insert_unmapped_node();
+            KASSERT(sf_node_id == sample_id, "The samples are not the first nodes.", sfkit::assert::light);
+
+            _ts_node_to_sf_node[asserting_cast<size_t>(ts_node_id)] = sf_node_id;
+            forest.insert_leaf(sf_node_id);
+        }
+    }
+};
+
+using LowMemoryDAGForestCompressor = BasicLowMemoryDAGForestCompressor<>;
+
+} // namespace sfkit::dag
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/hopscotch_map.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+#include "sfkit/graph/primitives.hpp"
+
+namespace sfkit::graph {
+
+// Maps subtree hashes to node ids like the SubtreeHashToNodeMapper, but uses about max_memory bytes at most (as
+// measured by memory_usage()). The entries are kept in two generations. Subtrees inserted or found are stored in the
+// current generation. Once it is full, the previous generation is dropped and the current one becomes the previous
+// one. Subtrees which have not been seen during an entire generation are thus forgotten; if one of them recurs, it is
+// inserted again under a new node id.
+//
+// Each generation gets half of the budget. We size its buckets to fit into it, but the hopscotch map may still store
+// entries in its overflow list or grow, if a neighborhood is full. The generation is therefore also considered full
+// once its measured memory usage exceeds its budget; the insertion which triggered the growth may exceed the budget.
+// A generation holds at least one entry, even if max_memory is too small for that.
+template <typename SubtreeHash>
+class BasicBoundedSubtreeHashToNodeMapper {
+public:
+    BasicBoundedSubtreeHashToNodeMapper(size_t const max_memory)
+        : _max_generation_memory(max_memory / 2),
+          _generation_capacity(_max_entries_per_generation(_max_generation_memory)) {
+        _current.reserve(_generation_capacity);
+    }
+
+    // Finding a subtree of the previous generation moves it to the current one.
+    std::optional<NodeId> find(SubtreeHash const& subtree_id) {
+        auto const it = _current.find(subtree_id);
+        if (it != _current.end()) {
+            return it->second;
+        }
+
+        auto const previous_it = _previous.find(subtree_id);
+        if (previous_it != _previous.end()) {
+            NodeId const node_id = previous_it->second;
+            _insert(subtree_id, node_id);
+            return node_id;
+        }
+        return std::nullopt;
+    }
+
+    NodeId insert_node(SubtreeHash const& subtree_id) {
+        KASSERT(
+            _current.find(subtree_id) == _current.end(),
+            "Subtree ID already exists in the map",
+            sfkit::assert::light
+        );
+        _insert(subtree_id, _next_node_id);
+        return _next_node_id++;
+    }
+
+    NodeId insert_or_update_node(SubtreeHash const& subtree_id) {
+        _insert(subtree_id, _next_node_id);
+        return _next_node_id++;
+    }
+
+    // Assign a node id without storing a subtree for it, e.g. for nodes which are never looked up.
+    NodeId insert_unmapped_node() {
+        return _next_node_id++;
+    }
+
+    NodeId num_nodes() const {
+        return _next_node_id;
+    }
+
+    // The number of subtrees stored in both generations.
+    size_t size() const {
+        return _current.size() + _previous.size();
+    }
+
+    // The maximum number of subtrees in a single generation.
+    size_t generation_capacity() const {
+        return _generation_capacity;
+    }
+
+    // The number of subtrees dropped so far. If a subtree is found again after being moved to the current generation,
+    // it is counted again.
+    size_t num_dropped() const {
+        return _num_dropped;
+    }
+
+    // The memory used by both generations, including the neighborhood bitmaps of the buckets and the overflow lists.
+    // Ignores the allocator's overhead.
+    size_t memory_usage() const {
+        return _memory_usage(_current) + _memory_usage(_previous);
+    }
+
+private:
+    // The default neighborhood size of tsl::hopscotch_map, which we spell out to compute the memory usage.
+    static constexpr unsigned int _neighborhood_size = 62;
+
+    using MapType = tsl::hopscotch_map<
+        SubtreeHash,
+        NodeId,
+        std::hash<SubtreeHash>,
+        std::equal_to<SubtreeHash>,
+        std::allocator<std::pair<SubtreeHash, NodeId>>,
+        _neighborhood_size>;
+    using Entry = typename MapType::value_type;
+
+    // Each bucket stores its entry next to a 64 bit neighborhood bitmap. Entries which do not fit into their
+    // neighborhood are stored in a std::list.
+    static constexpr size_t _bytes_per_bucket         = sizeof(std::pair<std::uint64_t, Entry>);
+    static constexpr size_t _bytes_per_overflow_entry = sizeof(Entry) + 2 * sizeof(void*);
+
+    size_t  _max_generation_memory;
+    size_t  _generation_capacity;
+    MapType _current;
+    MapType _previous;
+    NodeId  _next_node_id = 0;
+    size_t  _num_dropped  = 0;
+
+    // The hopscotch map allocates _neighborhood_size - 1 buckets beyond bucket_count(), so that the neighborhood of the
+    // last bucket does not wrap around.
+    static size_t _memory_usage(MapType const& map) {
+        size_t const num_buckets = map.bucket_count() == 0 ? 0 : map.bucket_count() + _neighborhood_size - 1;
+        return num_buckets * _bytes_per_bucket + map.overflow_size() * _bytes_per_overflow_entry;
+    }
+
+    // The number of buckets is a power of two. We stay below the maximum load factor of the map (0.9 by default), so
+    // that reserve() does not round up to the next power of two.
+    static size_t _max_entries_per_generation(size_t const max_generation_memory) {
+        size_t const max_buckets = max_generation_memory / _bytes_per_bucket;
+        if (max_buckets <= _neighborhood_size) {
+            return 1;
+        }
+        size_t const num_buckets = std::bit_floor(max_buckets - (_neighborhood_size - 1));
+        return std::max<size_t>(1, num_buckets / 4 * 3);
+    }
+
+    bool _current_is_full() const {
+        return _current.size() >= _generation_capacity || _memory_usage(_current) > _max_generation_memory;
+    }
+
+    void _insert(SubtreeHash const& subtree_id, NodeId const node_id) {
+        if (!_current.empty() && _current_is_full() && _current.find(subtree_id) == _current.end()) [[unlikely]] {
+            _num_dropped += _previous.size();
+            _previous = std::move(_current);
+            _current  = MapType{};
+            _current.reserve(_generation_capacity);
+        }
+        _current.insert_or_assign(subtree_id, node_id);
+    }
+};
+
+} // namespace sfkit::graph
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "sfkit/graph/primitives.hpp"
+
+namespace sfkit::graph {
+
+// Counters collected by the forest compressors for a single tree (or summed up over all trees).
+struct TreeCompressionStats {
+    using Duration = std::chrono::nanoseconds;
+
+    TreeId tree_id = 0;
+    double left    = 0; // Genomic interval [left, right) covered by the tree.
+    double right   = 0;
+
+    size_t num_visited_nodes     = 0; // Nodes the compressor looked at.
+    size_t num_invalidated_nodes = 0; // Nodes whose subtree changed compared to the previous tree.
+    size_t num_new_subtrees      = 0; // Hash misses; the subtree was added to the compressed forest.
+    size_t num_reused_subtrees   = 0; // Hash hits; the subtree was already present in the compressed forest.
+
+    size_t map_size        = 0; // Entries in the subtree hash map after processing this tree.
+    double map_load_factor = 0;
+
+    Duration advance_time{0};   // Advancing the tskit tree and computing the (invalidated) nodes to visit.
+    Duration hashing_time{0};   // Hashing the subtrees (including looking up the children's node ids).
+    Duration map_time{0};       // Looking up and inserting the subtrees, emitting the compressed forest.
+    Duration mutations_time{0}; // Processing the mutations of the tree.
+
+    TreeCompressionStats& operator+=(TreeCompressionStats const& other) {
+        num_visited_nodes += other.num_visited_nodes;
+        num_invalidated_nodes += other.num_invalidated_nodes;
+        num_new_subtrees += other.num_new_subtrees;
+        num_reused_subtrees += other.num_reused_subtrees;
+        advance_time += other.advance_time;
+        hashing_time += other.hashing_time;
+        map_time += other.map_time;
+        mutations_time += other.mutations_time;
+        return *this;
+    }
+};
+
+// Instrumentation of the forest compressors. Collecting these statistics requires reading the clock multiple times per
+// node; only enable them when needed.
+class CompressionStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CompressionStats(bool const keep_per_tree_stats = true) : _keep_per_tree_stats(keep_per_tree_stats) {}
+
+    void start_tree(TreeId const tree_id, double const left, double const right) {
+        _current         = TreeCompressionStats{};
+        _current.tree_id = tree_id;
+        _current.left    = left;
+        _current.right   = right;
+    }
+
+    // The statistics of the tree currently being compressed.
+    TreeCompressionStats& current() {
+        return _current;
+    }
+
+    void finish_tree(size_t const map_size, double const map_load_factor) {
+        _current.map_size        = map_size;
+        _current.map_load_factor = map_load_factor;
+
+        _total += _current;
+        _total.tree_id         = _current.tree_id;
+        _total.right           = _current.right;
+        _total.map_size        = map_size;
+        _total.map_load_factor = map_load_factor;
+        ++_num_trees;
+
+        if (_keep_per_tree_stats) {
+            _trees.push_back(_current);
+        }
+    }
+
+    // The counters summed up over all trees; the map size and load factor are the ones after the last tree.
+    [[nodiscard]] TreeCompressionStats const& total() const {
+        return _total;
+    }
+
+    [[nodiscard]] TreeId num_trees() const {
+        return _num_trees;
+    }
+
+    [[nodiscard]] std::vector<TreeCompressionStats> const& trees() const {
+        return _trees;
+    }
+
+    static void write_csv_header(std::ostream& out) {
+        out << "compressor,tree_id,left,right,visited_nodes,invalidated_nodes,new_subtrees,reused_subtrees,map_size,"
+               "map_load_factor,advance_ns,hashing_ns,map_ns,mutations_ns\n";
+    }
+
+    // Write one row per tree; the first column is set to the given label.
+    void write_csv(std::ostream& out, std::string const& compressor) const {
+        for (auto const& tree: _trees) {
+            out << compressor << ',' << tree.tree_id << ',' << tree.left << ',' << tree.right << ','
+                << tree.num_visited_nodes << ',' << tree.num_invalidated_nodes << ',' << tree.num_new_subtrees << ','
+                << tree.num_reused_subtrees << ',' << tree.map_size << ',' << tree.map_load_factor << ','
+                << tree.advance_time.count() << ',' << tree.hashing_time.count() << ',' << tree.map_time.count() << ','
+                << tree.mutations_time.count() << '\n';
+        }
+    }
+
+private:
+    bool                              _keep_per_tree_stats;
+    TreeCompressionStats              _current;
+    TreeCompressionStats              _total;
+    TreeId                            _num_trees = 0;
+    std::vector<TreeCompressionStats> _trees;
+};
+
+} // namespace sfkit::graph
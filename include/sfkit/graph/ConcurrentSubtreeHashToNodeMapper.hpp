@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/hopscotch_map.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+#include "sfkit/graph/primitives.hpp"
+
+namespace sfkit::graph {
+
+// A SubtreeHashToNodeMapper which can be used by multiple threads at once. The hash map is split into shards, each
+// protected by its own lock. The shard is selected using the most significant bits of std::hash<SubtreeHash>, while the
+// hash map of the shard itself uses the least significant ones to select the bucket. As the subtree hashes are random,
+// the load is spread evenly across the shards and two threads rarely contend for the same lock. The SubtreeHash type
+// depends on the hashing policy of the SubtreeHasher (see SubtreeHasher.hpp).
+//
+// Node ids are handed out by a single atomic counter. They are thus unique and consecutive, but if multiple threads
+// insert concurrently, the order in which they are assigned depends on the scheduling.
+template <typename SubtreeHash>
+class BasicConcurrentSubtreeHashToNodeMapper {
+public:
+    BasicConcurrentSubtreeHashToNodeMapper(size_t const num_shards = 64)
+        : _shards(std::bit_ceil(num_shards)),
+          _num_shard_bits(std::countr_zero(std::bit_ceil(num_shards))) {
+        KASSERT(num_shards > 0u, "There has to be at least one shard.", sfkit::assert::light);
+    }
+
+    NodeId insert_node(SubtreeHash const& subtree_id) {
+        auto& shard = _shard(subtree_id);
+
+        std::lock_guard const lock(shard.mutex);
+        KASSERT(
+            shard.map.find(subtree_id) == shard.map.end(),
+            "Subtree ID already exists in the map",
+            sfkit::assert::light
+        );
+        NodeId const node_id  = _next_node_id.fetch_add(1, std::memory_order_relaxed);
+        shard.map[subtree_id] = node_id;
+        return node_id;
+    }
+
+    NodeId insert_or_update_node(SubtreeHash const& subtree_id) {
+        auto& shard = _shard(subtree_id);
+
+        std::lock_guard const lock(shard.mutex);
+        NodeId const          node_id = _next_node_id.fetch_add(1, std::memory_order_relaxed);
+        shard.map[subtree_id]         = node_id;
+        return node_id;
+    }
+
+    // Look up the node id of the given subtree and insert the subtree if it's not present yet. In contrast to a call to
+    // contains() followed by insert_node(), this is atomic. Returns the node id and whether the subtree was inserted.
+    std::pair<NodeId, bool> insert_or_get_node(SubtreeHash const& subtree_id) {
+        auto& shard = _shard(subtree_id);
+
+        std::lock_guard const lock(shard.mutex);
+        auto const            node_it = shard.map.find(subtree_id);
+        if (node_it != shard.map.end()) {
+            return {node_it->second, false};
+        }
+
+        NodeId const node_id = _next_node_id.fetch_add(1, std::memory_order_relaxed);
+        shard.map.emplace(subtree_id, node_id);
+        return {node_id, true};
+    }
+
+    // Root nodes might have identical subtrees, thus the mapping is lo longer surjective. As roots are never
+    // referred to, we do not need to store them but only assign them a node id.
+    NodeId insert_root() {
+        return _next_node_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool contains(SubtreeHash const& subtree_id) const {
+        return try_map(subtree_id).has_value();
+    }
+
+    // We cannot hand out iterators into the shards, as they would be invalidated by concurrent insertions.
+    std::optional<NodeId> try_map(SubtreeHash const& subtree_id) const {
+        auto const& shard = _shard(subtree_id);
+
+        std::lock_guard const lock(shard.mutex);
+        auto const            node_it = shard.map.find(subtree_id);
+        if (node_it != shard.map.end()) {
+            return node_it->second;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    NodeId map(SubtreeHash const& subtree_id) const {
+        auto const node_id = try_map(subtree_id);
+        KASSERT(node_id.has_value(), "Subtree ID does not exists in the map", sfkit::assert::light);
+        return *node_id;
+    }
+
+    NodeId operator[](SubtreeHash const& subtree_id) const {
+        return map(subtree_id);
+    }
+
+    NodeId num_nodes() const {
+        return _next_node_id.load(std::memory_order_relaxed);
+    }
+
+    size_t num_shards() const {
+        return _shards.size();
+    }
+
+private:
+    using MapType = tsl::hopscotch_map<SubtreeHash, NodeId>;
+
+    // Align the shards to cache lines in order to avoid false sharing of the locks.
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        MapType            map;
+    };
+
+    size_t _shard_idx(SubtreeHash const& subtree_id) const {
+        static_assert(sizeof(size_t) == 8, "The shard selection assumes 64 bit hash values.");
+        size_t const hash = std::hash<SubtreeHash>{}(subtree_id);
+        return _num_shard_bits == 0 ? 0 : hash >> (64 - _num_shard_bits);
+    }
+
+    Shard& _shard(SubtreeHash const& subtree_id) {
+        return _shards[_shard_idx(subtree_id)];
+    }
+
+    Shard const& _shard(SubtreeHash const& subtree_id) const {
+        return _shards[_shard_idx(subtree_id)];
+    }
+
+    std::vector<Shard>  _shards;
+    int const           _num_shard_bits;
+    std::atomic<NodeId> _next_node_id = 0;
+};
+
+using ConcurrentSubtreeHashToNodeMapper = BasicConcurrentSubtreeHashToNodeMapper<SubtreeHash>;
+} // namespace sfkit::graph
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <optional>
+#include <span>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -14,6 +15,7 @@
 #include "sfkit/graph/Edge.hpp"
 #include "sfkit/graph/primitives.hpp"
 #include "sfkit/samples/SampleSet.hpp"
+#include "sfkit/utils/ChunkedVector.hpp"
 
 namespace sfkit::graph {
 
@@ -37,8 +39,26 @@ public:
         // TODO Think about incremental updates of the nodes array or a separate build phase for the graph.
     }
 
-    void insert_root(NodeId root) {
-        _roots.push_back(root);
+    // Append edges collected in a ChunkedVector, which is empty afterwards. We allocate the memory for all edges at
+    // once; as the chunks are freed while they are copied, the pages touched stay at about the size of all edges plus
+    // one chunk.
+    template <size_t ChunkSize>
+    void insert_edges(sfkit::utils::ChunkedVector<Edge, ChunkSize>& edges) {
+        _edges.reserve(_edges.size() + edges.size());
+        edges.drain([this](std::span<Edge const> const chunk) {
+            _edges.insert(_edges.end(), chunk.begin(), chunk.end());
+        });
+    }
+
+    // Add the root of the next tree. Consecutive trees with the same root are stored as a single run; thus, each
+    // root is stored (and processed by the algorithms working on the roots) only once per run of identical trees.
+    void insert_root(NodeId root, TreeId num_trees = 1) {
+        KASSERT(num_trees > 0u, "A root has to span at least one tree.", sfkit::assert::light);
+        if (_roots.empty() || _roots.back() != root) {
+            _roots.push_back(root);
+            _root_run_starts.push_back(_num_trees);
+        }
+        _num_trees += num_trees;
     }
 
     void insert_leaf(NodeId leaf) {
@@ -73,6 +93,8 @@ public:
         return _edges.cend();
     }
 
+    // The distinct roots of consecutive trees; roots()[idx] is the root of the trees
+    // [root_run_start(idx), root_run_start(idx) + root_run_length(idx)).
     std::vector<NodeId> const& roots() const {
         KASSERT(_unique_nodes(_roots), "Roots are not unique", sfkit::assert::heavy);
         return _roots;
@@ -83,8 +105,26 @@ public:
         return asserting_cast<NodeId>(_roots.size());
     }
 
+    TreeId root_run_start(size_t const root_idx) const {
+        KASSERT(root_idx < _root_run_starts.size(), "Root index out of bounds.", sfkit::assert::light);
+        return _root_run_starts[root_idx];
+    }
+
+    TreeId root_run_length(size_t const root_idx) const {
+        KASSERT(root_idx < _root_run_starts.size(), "Root index out of bounds.", sfkit::assert::light);
+        TreeId const run_end = root_idx + 1 < _root_run_starts.size() ? _root_run_starts[root_idx + 1] : _num_trees;
+        return run_end - _root_run_starts[root_idx];
+    }
+
+    // O(log num_roots)
+    NodeId root_of_tree(TreeId const tree_id) const {
+        KASSERT(tree_id < _num_trees, "Tree id out of bounds.", sfkit::assert::light);
+        auto const run_it = std::upper_bound(_root_run_starts.begin(), _root_run_starts.end(), tree_id);
+        return _roots[asserting_cast<size_t>(run_it - _root_run_starts.begin()) - 1];
+    }
+
     TreeId num_trees() const {
-        return num_roots();
+        return _num_trees;
     }
 
     std::vector<NodeId> const& leaves() const {
@@ -174,6 +214,26 @@ public:
         return _num_nodes != INVALID_NODE_ID;
     }
 
+    // Forget the number of nodes, e.g. because nodes are added to a graph which has been loaded from disk.
+    void unset_num_nodes() {
+        _num_nodes = INVALID_NODE_ID;
+    }
+
+    // Rename each node v to new_ids[v]; new_ids has to be a permutation of the node ids. The order of the edges, roots,
+    // and leaves is kept.
+    void relabel_nodes(std::span<NodeId const> const new_ids) {
+        KASSERT(new_ids.size() == num_nodes(), "There has to be a new id for each node.", sfkit::assert::light);
+        for (auto& edge: _edges) {
+            edge = Edge(new_ids[edge.from()], new_ids[edge.to()]);
+        }
+        for (auto& root: _roots) {
+            root = new_ids[root];
+        }
+        for (auto& leaf: _leaves) {
+            leaf = new_ids[leaf];
+        }
+    }
+
     bool check_postorder() const {
         // Initialize all leaves as visited and all other nodes as unvisited.
         std::vector<bool> visited(num_nodes(), false);
@@ -266,7 +326,20 @@ public:
 
     template <class Archive>
     void serialize(Archive& archive) {
-        archive(_num_nodes, _edges, _roots, _leaves, _traversal_order);
+        archive(_num_nodes, _edges, _roots, _root_run_starts, _num_trees, _leaves, _traversal_order);
+    }
+
+    // Store everything but the edges, e.g. if they are stored in a more compact encoding (see DAGCSREdges).
+    template <class Archive>
+    void save_without_edges(Archive& archive) const {
+        archive(_num_nodes, _roots, _root_run_starts, _num_trees, _leaves, _traversal_order);
+    }
+
+    // The edges have to be inserted afterwards.
+    template <class Archive>
+    void load_without_edges(Archive& archive) {
+        _edges.clear();
+        archive(_num_nodes, _roots, _root_run_starts, _num_trees, _leaves, _traversal_order);
     }
 
 private:
@@ -287,6 +360,8 @@ private:
     NodeId              _num_nodes = INVALID_NODE_ID;
     EdgeList            _edges;
     std::vector<NodeId> _roots;
+    std::vector<TreeId> _root_run_starts; // The first tree of each run of trees sharing a root.
+    TreeId              _num_trees = 0;
     std::vector<NodeId> _leaves;
     TraversalOrder      _traversal_order = TraversalOrder::Unordered;
 };
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "sfkit/graph/SubtreeHasher.hpp"
+
 namespace sfkit::graph {
 
-template <typename SuccinctForest>
+// The HashPolicy selects how subtrees are hashed and thus the width of the subtree hashes (see SubtreeHasher.hpp).
+template <typename SuccinctForest, typename HashPolicy = XXH3_128HashPolicy>
 class ForestCompressor {};
 
 } // namespace sfkit::graph
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::graph {
+
+using sfkit::utils::asserting_cast;
+
+// What the compressors do if the subtree hash of a node is already present in the hash map.
+enum class HashCollisionHandling {
+    Trust,   // Assume that the subtrees are identical (default).
+    Report,  // Check that the subtrees are identical and throw if they are not.
+    Resolve, // Check that the subtrees are identical; if they are not, use the next secondary hash of the subtree.
+};
+
+// Stores the children of each node of the compressed forest in order to verify that two subtrees with the same hash are
+// identical. Two subtrees are identical if the multisets of their children's node ids are the same -- the children
+// in turn have already been verified. The children are stored in a canonical (sorted) order in a single array.
+class SubtreeCollisionVerifier {
+public:
+    SubtreeCollisionVerifier() : _children_begin{0} {}
+
+    // Store the children of a newly created node. The node ids have to be added in consecutive order.
+    void add_node(NodeId const node_id, std::span<NodeId const> const children) {
+        KASSERT(node_id == num_nodes(), "Node ids have to be added consecutively.", sfkit::assert::light);
+        auto const begin = _children.size();
+        _children.insert(_children.end(), children.begin(), children.end());
+        std::sort(_children.begin() + asserting_cast<std::ptrdiff_t>(begin), _children.end());
+        _children_begin.push_back(_children.size());
+    }
+
+    // Does the node with the given id have exactly these children (in any order)?
+    [[nodiscard]] bool matches(NodeId const node_id, std::span<NodeId const> const children) {
+        KASSERT(node_id < num_nodes(), "Node id out of range.", sfkit::assert::light);
+        auto const begin = _children.begin() + asserting_cast<std::ptrdiff_t>(_children_begin[node_id]);
+        auto const end   = _children.begin() + asserting_cast<std::ptrdiff_t>(_children_begin[node_id + 1]);
+        if (asserting_cast<size_t>(end - begin) != children.size()) {
+            return false;
+        }
+
+        _canonical_children.assign(children.begin(), children.end());
+        std::sort(_canonical_children.begin(), _canonical_children.end());
+        return std::equal(begin, end, _canonical_children.begin());
+    }
+
+    [[nodiscard]] NodeId num_nodes() const {
+        return asserting_cast<NodeId>(_children_begin.size() - 1);
+    }
+
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(_children, _children_begin);
+    }
+
+private:
+    std::vector<NodeId> _children;
+    std::vector<size_t> _children_begin;
+    std::vector<NodeId> _canonical_children; // Buffer, reused across calls to matches()
+};
+
+} // namespace sfkit::graph
@@ -1,14 +1,25 @@
 #pragma once
 
+#include <vector>
+
+#include <sfkit/include-redirects/cereal.hpp>
 #include <sfkit/include-redirects/hopscotch_map.hpp>
 
 #include "sfkit/graph/SubtreeHasher.hpp"
 #include "sfkit/graph/primitives.hpp"
 
+// Serialization of the 128 bit subtree hashes; cereal finds this via argument-dependent lookup.
+template <class Archive>
+void serialize(Archive& archive, XXH128_hash_t& hash) {
+    archive(hash.low64, hash.high64);
+}
+
 namespace sfkit::graph {
-class SubtreeHashToNodeMapper {
+// The SubtreeHash type depends on the hashing policy of the SubtreeHasher (see SubtreeHasher.hpp).
+template <typename SubtreeHash>
+class BasicSubtreeHashToNodeMapper {
 public:
-    SubtreeHashToNodeMapper() {
+    BasicSubtreeHashToNodeMapper() {
         // TODO Retest this with the new hash map
         // Even if I know the exact size of the map, reserving the memory /degrades/ performance.
         // Hypothesis: Even more cache-misses in the beginning, when the map isn't fully filled yet.
@@ -57,9 +68,53 @@ public:
         return _next_node_id;
     }
 
+    // The number of subtrees stored; roots sharing the subtree of another node are not stored.
+    size_t size() const {
+        return _subtree_to_node_map.size();
+    }
+
+    float load_factor() const {
+        return _subtree_to_node_map.load_factor();
+    }
+
+    // The memory used by the buckets of the hash map, ignoring the per-bucket neighborhood information.
+    size_t memory_usage() const {
+        return _subtree_to_node_map.bucket_count() * sizeof(typename MapType::value_type);
+    }
+
+    // Store the mapping in order to continue compressing later (see DAGForestCompressor::append()).
+    template <class Archive>
+    void save(Archive& archive) const {
+        std::vector<SubtreeHash> subtree_ids;
+        std::vector<NodeId>      node_ids;
+        subtree_ids.reserve(_subtree_to_node_map.size());
+        node_ids.reserve(_subtree_to_node_map.size());
+        for (auto const& [subtree_id, node_id]: _subtree_to_node_map) {
+            subtree_ids.push_back(subtree_id);
+            node_ids.push_back(node_id);
+        }
+        archive(_next_node_id, subtree_ids, node_ids);
+    }
+
+    template <class Archive>
+    void load(Archive& archive) {
+        std::vector<SubtreeHash> subtree_ids;
+        std::vector<NodeId>      node_ids;
+        archive(_next_node_id, subtree_ids, node_ids);
+        KASSERT(subtree_ids.size() == node_ids.size(), "Corrupted subtree map.", sfkit::assert::light);
+
+        _subtree_to_node_map.clear();
+        _subtree_to_node_map.reserve(subtree_ids.size());
+        for (size_t idx = 0; idx < subtree_ids.size(); ++idx) {
+            _subtree_to_node_map.emplace(subtree_ids[idx], node_ids[idx]);
+        }
+    }
+
 private:
     using MapType = tsl::hopscotch_map<SubtreeHash, NodeId>;
     mutable MapType _subtree_to_node_map;
     NodeId          _next_node_id = 0;
 };
+
+using SubtreeHashToNodeMapper = BasicSubtreeHashToNodeMapper<SubtreeHash>;
 } // namespace sfkit::graph
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <typeinfo>
 
@@ -13,6 +14,7 @@
 namespace sfkit::graph {
 
 using sfkit::utils::xxhash128;
+using sfkit::utils::xxhash64;
 
 using SubtreeHash                           = XXH128_hash_t;
 constexpr SubtreeHash SuccinctSubtreeIdZero = {0, 0};
@@ -23,39 +25,112 @@ inline SubtreeHash& operator^=(SubtreeHash& lhs, SubtreeHash const& rhs) {
     return lhs;
 }
 
-class SubtreeHasher {
+// Hashing policies for the SubtreeHasher. The hash of an inner node is computed by XOR-ing the hashes of its children
+// and applying the policy's finish() to the result. As the children's hashes are random already, finish() does not need
+// to be a full hash function; it only has to mix the bits, such that e.g. a node with a single child does not get its
+// child's hash. The choice of the policy determines the width of the SubtreeHash and thus of the keys of the hash maps.
+
+// Hash the XOR-ed children using a full run of XXH3_128bits.
+struct XXH3_128HashPolicy {
+    using SubtreeHash = XXH128_hash_t;
+
+    template <typename T>
+    static SubtreeHash hash_sample(T const& data, XXH64_hash_t const seed) {
+        return xxhash128(data, seed);
+    }
+
+    static SubtreeHash finish(SubtreeHash const& data, XXH64_hash_t const seed) {
+        return xxhash128(data, seed);
+    }
+};
+
+// Use only the avalanche step of XXH3 on both halves of the XOR-ed children, mixing the lower into the upper half.
+// This is a bijection on the 128 bit values.
+struct Mix128HashPolicy {
+    using SubtreeHash = XXH128_hash_t;
+
+    template <typename T>
+    static SubtreeHash hash_sample(T const& data, XXH64_hash_t const seed) {
+        return xxhash128(data, seed);
+    }
+
+    static SubtreeHash finish(SubtreeHash const& data, XXH64_hash_t const seed) {
+        uint64_t const low  = avalanche(data.low64 ^ seed);
+        uint64_t const high = avalanche(data.high64 ^ low);
+        return {low ^ (high >> 29), high};
+    }
+
+private:
+    static uint64_t avalanche(uint64_t hash) {
+        hash ^= hash >> 37;
+        hash *= 0x165667919E3779F9ULL;
+        hash ^= hash >> 32;
+        return hash;
+    }
+};
+
+// 64 bit hashes using the multiply-xorshift finisher of MurmurHash3. Halves the size of the hash map keys, but
+// collisions become likely for large inputs; consider using HashCollisionHandling::Resolve in the compressors.
+struct MultiplyXorShift64HashPolicy {
+    using SubtreeHash = XXH64_hash_t;
+
+    template <typename T>
+    static SubtreeHash hash_sample(T const& data, XXH64_hash_t const seed) {
+        return xxhash64(data, seed);
+    }
+
+    static SubtreeHash finish(SubtreeHash hash, XXH64_hash_t const seed) {
+        hash ^= seed;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+};
+
+template <typename HashPolicy>
+class BasicSubtreeHasher {
 public:
-    SubtreeHasher(XXH64_hash_t const& seed = 42) : _seed(seed) {
+    using SubtreeHash = typename HashPolicy::SubtreeHash;
+
+    BasicSubtreeHasher(XXH64_hash_t const& seed = 42) : _seed(seed) {
         reset();
     }
 
     template <typename T>
     requires requires(T const& t, XXH64_hash_t const& seed) {
-        xxhash128(t, seed);
+        HashPolicy::hash_sample(t, seed);
     }
     SubtreeHash hash_sample(T const& data) {
-        return xxhash128(data, _seed);
+        return HashPolicy::hash_sample(data, _seed);
     }
 
-    void append_child(XXH128_hash_t const& data) {
+    void append_child(SubtreeHash const& data) {
         _data ^= data;
     }
 
     SubtreeHash hash() {
-        // TODO Instead of a full hash, maybe use only the hash's finisher. The values are random anyhow, as
-        // they were generated by xor-ing the hashes of the children.
-        return xxhash128(_data, _seed);
-        // return _data;
+        return HashPolicy::finish(_data, _seed);
     }
 
     void reset() {
-        _data = SuccinctSubtreeIdZero;
+        _data = SubtreeHash{};
+    }
+
+    // Secondary hashes of a subtree, used to resolve hash collisions. Each probe yields a different but deterministic
+    // hash for the same subtree hash.
+    SubtreeHash probe(SubtreeHash const& subtree_hash, XXH64_hash_t const probe) const {
+        return HashPolicy::hash_sample(subtree_hash, _seed + probe);
     }
 
 private:
     XXH64_hash_t const _seed;
-    XXH128_hash_t      _data;
+    SubtreeHash        _data;
 };
+
+using SubtreeHasher = BasicSubtreeHasher<XXH3_128HashPolicy>;
 } // namespace sfkit::graph
 
 // SubtreeHash already is a hash; this function thus is the identity.
@@ -4,6 +4,7 @@
 
 #include "sfkit/SuccinctForest.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/dag/DAGCompressorState.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
 
 namespace sfkit::io::internal {
@@ -14,12 +15,15 @@ using sfkit::dag::DAGCompressedForest;
 using Version = uint64_t;
 using Magic   = uint64_t;
 
-static constexpr Version DAG_ARCHIVE_VERSION = 3;
+static constexpr Version DAG_ARCHIVE_VERSION = 10;
 static constexpr Magic   DAG_ARCHIVE_MAGIC   = 1307950585415129820;
 
-static constexpr Version BP_ARCHIVE_VERSION = 1;
+static constexpr Version BP_ARCHIVE_VERSION = 2;
 static constexpr Magic   BP_ARCHIVE_MAGIC   = 7612607674453629763;
 
+static constexpr Version DAG_COMPRESSOR_STATE_VERSION = 1;
+static constexpr Magic   DAG_COMPRESSOR_STATE_MAGIC   = 5377406718243302951;
+
 class DAGCompressedForestIO {
 public:
     static void load(std::string const& filename, DAGCompressedForest& forest, GenomicSequence& sequence) {
@@ -55,7 +59,8 @@ public:
         );
     }
 
-    static void save(std::string const& filename, DAGCompressedForest& forest, GenomicSequence& sequence) {
+    // The levels are stored only if they have been computed (see DAGCompressedForest::compute_levels()).
+    static void save(std::string const& filename, DAGCompressedForest const& forest, GenomicSequence const& sequence) {
         std::ofstream os(filename, std::ios::binary | std::ios::out);
 
         cereal::BinaryOutputArchive archive(os);
@@ -65,6 +70,46 @@ public:
     }
 };
 
+// The state of the DAGForestCompressor, required to append trees to a .forest archive later on. It is stored in a
+// separate file next to the archive, as it is considerably larger than the compressed forest itself.
+class DAGCompressorStateIO {
+public:
+    template <typename SubtreeHash>
+    static void load(std::string const& filename, graph::BasicDAGCompressorState<SubtreeHash>& state) {
+        std::ifstream              is(filename, std::ios::binary | std::ios::in);
+        cereal::BinaryInputArchive archive(is);
+
+        Magic   magic;
+        Version version;
+        archive(magic, version);
+
+        if (magic != DAG_COMPRESSOR_STATE_MAGIC) {
+            throw std::runtime_error("Compressor state is invalid (mismatch of magic number)");
+        }
+
+        if (version != DAG_COMPRESSOR_STATE_VERSION) {
+            throw std::runtime_error(fmt::format(
+                "Compressor state {} has version {} but current version is {}",
+                filename,
+                version,
+                DAG_COMPRESSOR_STATE_VERSION
+            ));
+        }
+
+        archive(state);
+    }
+
+    template <typename SubtreeHash>
+    static void save(std::string const& filename, graph::BasicDAGCompressorState<SubtreeHash> const& state) {
+        std::ofstream os(filename, std::ios::binary | std::ios::out);
+
+        cereal::BinaryOutputArchive archive(os);
+        archive(DAG_COMPRESSOR_STATE_MAGIC, DAG_COMPRESSOR_STATE_VERSION, state);
+
+        os.close();
+    }
+};
+
 class BPCompressedForestIO {
 public:
     static void save(std::string const& filename, BPCompressedForest& forest, GenomicSequence& sequence) {
@@ -126,8 +171,19 @@ public:
         internal::DAGCompressedForestIO::load(filename, forest, sequence);
     }
 
-    static void save(std::string const& filename, dag::DAGCompressedForest& forest, GenomicSequence& sequence) {
+    static void
+    save(std::string const& filename, dag::DAGCompressedForest const& forest, GenomicSequence const& sequence) {
         internal::DAGCompressedForestIO::save(filename, forest, sequence);
     }
+
+    template <typename SubtreeHash>
+    static void load(std::string const& filename, graph::BasicDAGCompressorState<SubtreeHash>& state) {
+        internal::DAGCompressorStateIO::load(filename, state);
+    }
+
+    template <typename SubtreeHash>
+    static void save(std::string const& filename, graph::BasicDAGCompressorState<SubtreeHash> const& state) {
+        internal::DAGCompressorStateIO::save(filename, state);
+    }
 };
 } // namespace sfkit::io
@@ -1,10 +1,16 @@
 #pragma once
 
-#include "plf_stack.h"
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <cstdint>
 #include <experimental/simd>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/sdsl.hpp>
 
 #include "sfkit/bp/BPCompressedForest.hpp"
 #include "sfkit/samples/BPNumSamplesBelow.hpp"
@@ -12,7 +18,31 @@
 #include "sfkit/samples/NumSamplesBelow.hpp"
 #include "sfkit/samples/SampleSet.hpp"
 #include "sfkit/samples/primitives.hpp"
-#include "sfkit/utils/BufferedSDSLBitVectorView.hpp"
+
+namespace sfkit::samples::internal {
+
+// The excess (number of opening minus number of closing parentheses) of each byte of a balanced parenthesis sequence,
+// and the maximum excess of its non-empty prefixes. The first parenthesis is the least significant bit.
+struct BPByteExcess {
+    int8_t excess;
+    int8_t max_prefix_excess;
+};
+
+inline constexpr std::array<BPByteExcess, 256> BP_BYTE_EXCESS = []() {
+    std::array<BPByteExcess, 256> table{};
+    for (size_t byte = 0; byte < table.size(); byte++) {
+        int8_t excess            = 0;
+        int8_t max_prefix_excess = -8;
+        for (size_t bit = 0; bit < 8; bit++) {
+            excess            = static_cast<int8_t>(excess + (((byte >> bit) & 1u) == bp::PARENS_OPEN ? 1 : -1));
+            max_prefix_excess = std::max(max_prefix_excess, excess);
+        }
+        table[byte] = {excess, max_prefix_excess};
+    }
+    return table;
+}();
+
+} // namespace sfkit::samples::internal
 
 namespace sfkit::samples {
 
@@ -20,13 +50,77 @@ using sfkit::bp::BPCompressedForest;
 using sfkit::graph::NodeId;
 using sfkit::samples::SampleId;
 using sfkit::utils::asserting_cast;
-using sfkit::utils::BufferedSDSLBitVectorView;
 namespace stdx = std::experimental;
 
 template <size_t N, typename BaseType>
 class NumSamplesBelow<BPCompressedForest, N, BaseType> {
 public:
     NumSamplesBelow(BPCompressedForest const& forest, SetOfSampleSets<N> const& samples) : _forest(forest) {
+        _check_and_count(samples);
+        _compute(samples);
+    }
+
+    // Process blocks of trees in parallel using num_threads threads. The blocks start at the trees sampled by the
+    // forest's tree start index (see BPCompressedForest::build_tree_start_index()); there are at most as many blocks
+    // as sampled trees.
+    NumSamplesBelow(BPCompressedForest const& forest, SetOfSampleSets<N> const& samples, size_t const num_threads)
+        : _forest(forest) {
+        _check_and_count(samples);
+        _compute_parallel(samples, num_threads);
+    }
+
+    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
+        KASSERT(node_id < _subtree_sizes.size(), "Subtree ID out of bounds.", sfkit::assert::light);
+        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
+
+        return _subtree_sizes[node_id][sample_set_id];
+    }
+
+    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
+        return this->num_samples_below(node_id, sample_set_id);
+    }
+
+    [[nodiscard]] SampleId num_nodes_in_dag() const {
+        return asserting_cast<SampleId>(_forest.num_nodes());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_dag() const {
+        return asserting_cast<SampleId>(_forest.num_leaves());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
+        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
+        return _num_samples_in_sample_set[sample_set_id];
+    }
+
+private:
+    using simd_t    = stdx::fixed_size_simd<BaseType, N>;
+    using TreeStart = BPCompressedForest::TreeStart;
+
+    // The inner nodes parsed in parallel which have references to non-final nodes below them; these references are
+    // pending_refs[begin, end) of the block.
+    struct PendingRange {
+        NodeId node_id;
+        size_t begin;
+        size_t end;
+    };
+
+    // The state of parsing the trees starting at start up to (excluding) the parenthesis at end_bit.
+    struct Block {
+        TreeStart                 start;
+        size_t                    end_bit;
+        std::vector<simd_t>       sample_counts;
+        std::vector<SampleId>     num_children;      // Of each node on the path from the root, by level
+        std::vector<size_t>       first_pending_ref; // Of each node on the path from the root, by level
+        std::vector<NodeId>       pending_refs;      // References to non-final nodes, in the order of the references
+        std::vector<PendingRange> pending_ranges;    // In the order of the nodes
+    };
+
+    BPCompressedForest const& _forest;
+    std::array<SampleId, N>   _num_samples_in_sample_set;
+    std::vector<simd_t>       _subtree_sizes;
+
+    void _check_and_count(SetOfSampleSets<N> const& samples) {
         // Check inputs
         KASSERT(_forest.num_nodes() >= _forest.num_leaves(), "DAG has less nodes than leaves.", sfkit::assert::light);
         for (auto const& sample_set: samples) {
@@ -61,52 +155,120 @@ public:
             num_samples_in_sample_set_it++;
             samples_it++;
         }
-
-        // Compute the subtree sizes
-        _compute(samples);
     }
 
-    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
-        KASSERT(node_id < _subtree_sizes.size(), "Subtree ID out of bounds.", sfkit::assert::light);
-        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
+    void _init_leaves(SetOfSampleSets<N> const& samples) {
+        KASSERT(_subtree_sizes.size() == 0ul, "Subtree sizes already computed.", sfkit::assert::light);
+        _subtree_sizes.resize(_forest.num_nodes(), 0);
 
-        return _subtree_sizes[node_id][sample_set_id];
+        KASSERT(samples.size() == N);
+        for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
+            for (SampleId sample: samples[sample_set_idx].get()) {
+                _subtree_sizes[sample][sample_set_idx] = 1;
+            }
+        }
     }
 
-    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
-        return this->num_samples_below(node_id, sample_set_id);
+    // The maximum nesting depth of the parentheses, i.e. the maximum excess of any prefix, computed a byte at a time.
+    static size_t _max_depth(sdsl::bit_vector const& bp) {
+        constexpr size_t bits_per_word = 64;
+        uint64_t const*  words         = bp.data();
+        size_t const     num_bytes     = bp.size() / 8;
+        int64_t          depth         = 0;
+        int64_t          max_depth     = 0;
+        for (size_t byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+            uint64_t const word  = words[byte_idx * 8 / bits_per_word];
+            auto const     byte  = static_cast<uint8_t>(word >> (byte_idx * 8 % bits_per_word));
+            auto const&    entry = internal::BP_BYTE_EXCESS[byte];
+            max_depth            = std::max<int64_t>(max_depth, depth + entry.max_prefix_excess);
+            depth += entry.excess;
+        }
+        for (size_t bit = num_bytes * 8; bit < bp.size(); bit++) {
+            depth += bp[bit] == bp::PARENS_OPEN ? 1 : -1;
+            max_depth = std::max(max_depth, depth);
+        }
+        KASSERT(depth == 0, "The parentheses are not balanced.", sfkit::assert::light);
+        return asserting_cast<size_t>(max_depth);
     }
 
-    [[nodiscard]] SampleId num_nodes_in_dag() const {
-        return asserting_cast<SampleId>(_forest.num_nodes());
+    Block _make_block(TreeStart const& start, size_t const end_bit, size_t const max_depth) const {
+        Block block{start, end_bit, {}, {}, {}, {}, {}};
+        // We're wasting the first entry of sample_counts as a sentinel to simplify the parser.
+        block.sample_counts.resize(_forest.num_samples() + 1); // TODO Think about the maximum size
+        block.num_children.resize(max_depth + 1, 0);
+        block.first_pending_ref.resize(max_depth + 1, 0);
+        return block;
     }
 
-    [[nodiscard]] SampleId num_samples_in_dag() const {
-        return asserting_cast<SampleId>(_forest.num_leaves());
-    }
+    void _compute(SetOfSampleSets<N> const& samples) {
+        _init_leaves(samples);
+        auto const& bp = _forest.balanced_parenthesis();
 
-    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
-        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
-        return _num_samples_in_sample_set[sample_set_id];
+        TreeStart const first_tree{0, 0, 0, 0, _forest.num_samples()};
+        Block           block = _make_block(first_tree, bp.size(), _max_depth(bp));
+        _parse<false>(block, {});
     }
 
-private:
-    using simd_t = stdx::fixed_size_simd<BaseType, N>;
-    BPCompressedForest const& _forest;
-    std::array<SampleId, N>   _num_samples_in_sample_set;
-    std::vector<simd_t>       _subtree_sizes;
+    // Phase 1: Each thread parses its own blocks of trees. References point to earlier nodes; if such a node lies in
+    // an earlier block, its subtree size might not be computed yet. We leave these references (and the ones to nodes
+    // below which such a reference lies) pending and remember for each inner node the range of pending references below
+    // it. Phase 2: We process the blocks in order. All nodes of the earlier blocks are final; we add the sizes of the
+    // pending references below each node using prefix sums over the pending references of the block.
+    void _compute_parallel(SetOfSampleSets<N> const& samples, size_t const num_threads) {
+        KASSERT(num_threads > 0ul, "At least one thread is required.", sfkit::assert::light);
+        auto const& tree_starts = _forest.tree_starts();
+        size_t const num_blocks = std::min(num_threads, tree_starts.size());
+        if (num_blocks <= 1) {
+            _compute(samples);
+            return;
+        }
 
-    void _compute(SetOfSampleSets<N> const& samples) {
-        KASSERT(_subtree_sizes.size() == 0ul, "Subtree sizes already computed.", sfkit::assert::light);
-        _subtree_sizes.resize(_forest.num_nodes(), 0);
+        _init_leaves(samples);
+        auto const&        bp        = _forest.balanced_parenthesis();
+        size_t const       max_depth = _max_depth(bp);
+        std::vector<Block> blocks;
+        blocks.reserve(num_blocks);
+        for (size_t block_idx = 0; block_idx < num_blocks; block_idx++) {
+            size_t const first_start = block_idx * tree_starts.size() / num_blocks;
+            size_t const next_start  = (block_idx + 1) * tree_starts.size() / num_blocks;
+            size_t const end_bit     = block_idx + 1 < num_blocks ? tree_starts[next_start].bp_idx : bp.size();
+            blocks.push_back(_make_block(tree_starts[first_start], end_bit, max_depth));
+        }
 
-        KASSERT(samples.size() == N);
-        for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
-            for (SampleId sample: samples[sample_set_idx].get()) {
-                _subtree_sizes[sample][sample_set_idx] = 1;
+        // Each thread only writes the entries of the nodes of its own block.
+        std::vector<uint8_t>     is_incomplete(_forest.num_nodes(), false);
+        std::vector<std::thread> workers;
+        workers.reserve(num_blocks - 1);
+        for (size_t block_idx = 1; block_idx < num_blocks; block_idx++) {
+            workers.emplace_back([this, &blocks, &is_incomplete, block_idx]() {
+                _parse<true>(blocks[block_idx], is_incomplete);
+            });
+        }
+        _parse<true>(blocks[0], is_incomplete);
+        for (auto& worker: workers) {
+            worker.join();
+        }
+
+        for (Block const& block: blocks) {
+            // A pending reference points to a node of an earlier block or to a node of this block which was closed
+            // before the reference and thus before all nodes having the reference below them.
+            std::vector<simd_t> pending_prefix_sums;
+            pending_prefix_sums.reserve(block.pending_refs.size() + 1);
+            pending_prefix_sums.push_back(0);
+            for (PendingRange const& range: block.pending_ranges) {
+                while (pending_prefix_sums.size() <= range.end) {
+                    NodeId const node_id = block.pending_refs[pending_prefix_sums.size() - 1];
+                    pending_prefix_sums.push_back(pending_prefix_sums.back() + _subtree_sizes[node_id]);
+                }
+                _subtree_sizes[range.node_id] += pending_prefix_sums[range.end] - pending_prefix_sums[range.begin];
             }
         }
+    }
 
+    // Parse the trees of the block. With track_pending, references to nodes of earlier blocks and to incomplete nodes
+    // of this block are left pending (see _compute_parallel()).
+    template <bool track_pending>
+    void _parse(Block& block, std::span<uint8_t> const is_incomplete) {
         auto const& bp     = _forest.balanced_parenthesis();
         auto const& is_ref = _forest.is_reference();
         KASSERT(
@@ -114,93 +276,112 @@ private:
             "balanced_parenthesis and is_reference are of different size",
             sfkit::assert::light
         );
+        KASSERT(block.end_bit <= bp.size(), "The block ends after the balanced parenthesis.", sfkit::assert::light);
+        KASSERT(!track_pending || is_incomplete.size() == _forest.num_nodes());
 
-        KASSERT(samples.size() == N);
-        for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
-            for (SampleId sample: samples[sample_set_idx].get()) {
-                _subtree_sizes[sample][sample_set_idx] = 1;
+        auto         sample_counts_top   = block.sample_counts.begin();
+        auto&        num_children        = block.num_children;
+        size_t       level               = 0; // Distance from root
+        NodeId const first_inner_node_id = block.start.inner_node_id;
+        NodeId       inner_node_id       = block.start.inner_node_id;
+        SampleId     leaf_rank           = block.start.leaf_rank;
+        size_t       ref_rank            = block.start.ref_rank;
+        num_children[0]                  = 0;
+
+        // Process 64 parentheses at once: We classify them using bitwise operations on whole words and then visit only
+        // the ones we have to act on, i.e. all but the closing parentheses of references.
+        static_assert(bp::PARENS_OPEN == true, "The word-parallel parser assumes that set bits are opening parens.");
+        constexpr size_t bits_per_word     = 64;
+        uint64_t const*  bp_words          = bp.data();
+        uint64_t const*  is_ref_words      = is_ref.data();
+        uint64_t         last_bit_was_open = 0; // Trees start after a closing parenthesis (or at the very beginning)
+        size_t const     begin_bit         = block.start.bp_idx;
+        for (size_t first_bit = begin_bit / bits_per_word * bits_per_word; first_bit < block.end_bit;
+             first_bit += bits_per_word) {
+            size_t const word_idx = first_bit / bits_per_word;
+            uint64_t     valid    = ~0ull;
+            if (first_bit < begin_bit) {
+                valid &= ~0ull << (begin_bit - first_bit);
             }
-        }
+            if (block.end_bit - first_bit < bits_per_word) {
+                valid &= (1ull << (block.end_bit - first_bit)) - 1;
+            }
+            uint64_t const open      = bp_words[word_idx];
+            uint64_t const ref       = is_ref_words[word_idx];
+            uint64_t const prev_open = (open << 1) | last_bit_was_open; // Bit i is set if paren i - 1 is open
+            uint64_t       to_visit  = (open | ~ref) & valid;
 
-        std::vector<simd_t>  sample_counts;
-        plf::stack<SampleId> num_children;
-        sample_counts.resize(_forest.num_samples() + 1); // TODO Think about the maximum size
-        // We're wasting the first entry here as a sentinel to simplify the logic below.
-        auto sample_counts_top = sample_counts.begin();
-
-        NodeId   inner_node_id = _forest.num_samples();
-        SampleId leaf_rank     = 0;
-        size_t   ref_rank      = 0;
-
-        // TODO If the buffered iterator is not faster, remove it again
-        KASSERT(bp.size() == is_ref.size(), "balanced_parenthesis and is_reference are of different size");
-        BufferedSDSLBitVectorView bp_view{bp};
-        BufferedSDSLBitVectorView is_ref_view{is_ref};
-
-        auto bp_it      = bp_view.begin();
-        auto bp_end     = bp_view.end();
-        auto is_ref_it  = is_ref_view.begin();
-        auto is_ref_end = is_ref_view.end();
-
-        bool   last_bp = bp::PARENS_CLOSE;
-        size_t level   = 0; // Distance from root
-        // bool last_is_leaf = false;
-        num_children.emplace(0);
-        while (bp_it != bp_end) {
-            KASSERT(num_children.size() == level + 1);
-            KASSERT(bp_it != bp_end && is_ref_it != is_ref_end);
-            if (*is_ref_it) { // reference
-                // Reference always occur as tuples of (open, close) in BP and (true, true) in is_ref
-                KASSERT(*bp_it == bp::PARENS_OPEN);
-                ++bp_it;
-                ++is_ref_it;
-                KASSERT(bp_it != bp_end && is_ref_it != is_ref_end);
-                KASSERT(*is_ref_it);
-                KASSERT(*bp_it == bp::PARENS_CLOSE);
-
-                NodeId const node_id = _forest.node_id_ref_by_rank(ref_rank);
-                if (level > 0) [[likely]] { // We're not referring to a whole tree
-                    ++sample_counts_top;
-                    *sample_counts_top = _subtree_sizes[node_id];
-                    num_children.top()++;
-                }
-                ++ref_rank;
-            } else { // description of subtree
-                if (*bp_it == bp::PARENS_OPEN) {
-                    ++level;
-                    num_children.top()++;
-                    num_children.emplace(0);
-                } else { // &bp_it == bp::PARENS_CLOSE
-                    --level;
-                    if (last_bp == bp::PARENS_OPEN) { // sample
-                        KASSERT(leaf_rank < _forest.num_samples());
-                        SampleId const leaf_id = _forest.leaf_idx_to_id(leaf_rank);
-                        ++sample_counts_top;
-                        *sample_counts_top = _subtree_sizes[leaf_id];
-                        ++leaf_rank;
-                    } else { // inner node
-                        KASSERT(sample_counts.size() >= 2ul);
-                        for ([[maybe_unused]] SampleId child = 0; child < num_children.top() - 1; ++child) {
-                            auto const other = *sample_counts_top;
-                            --sample_counts_top;
-                            *sample_counts_top += other;
+            while (to_visit != 0) {
+                uint64_t const paren = to_visit & (~to_visit + 1); // The lowest set bit
+                to_visit ^= paren;
+
+                if (open & paren) {
+                    if (ref & paren) {
+                        // References always occur as tuples of (open, close) in BP and (true, true) in is_ref
+                        NodeId const node_id = _forest.node_id_ref_by_rank(ref_rank);
+                        if (level > 0) [[likely]] { // We're not referring to a whole tree
+                            ++sample_counts_top;
+                            if constexpr (track_pending) {
+                                bool const is_final =
+                                    node_id < _forest.num_samples()
+                                    || (node_id >= first_inner_node_id && !is_incomplete[node_id]);
+                                if (is_final) {
+                                    *sample_counts_top = _subtree_sizes[node_id];
+                                } else {
+                                    *sample_counts_top = 0;
+                                    block.pending_refs.push_back(node_id);
+                                }
+                            } else {
+                                *sample_counts_top = _subtree_sizes[node_id];
+                            }
+                            num_children[level]++;
                         }
-                        KASSERT(inner_node_id < _forest.num_nodes());
-                        _subtree_sizes[inner_node_id] = *sample_counts_top;
-                        if (level == 0) [[unlikely]] {
-                            --sample_counts_top;
+                        ++ref_rank;
+                    } else {
+                        num_children[level]++;
+                        ++level;
+                        KASSERT(level < num_children.size());
+                        num_children[level] = 0;
+                        if constexpr (track_pending) {
+                            block.first_pending_ref[level] = block.pending_refs.size();
                         }
-                        ++inner_node_id;
                     }
-                    num_children.pop();
+                } else if (prev_open & paren) { // sample
+                    KASSERT(level > 0u);
+                    --level;
+                    KASSERT(leaf_rank < _forest.num_samples());
+                    SampleId const leaf_id = _forest.leaf_idx_to_id(leaf_rank);
+                    ++sample_counts_top;
+                    *sample_counts_top = _subtree_sizes[leaf_id];
+                    ++leaf_rank;
+                } else { // inner node
+                    KASSERT(level > 0u);
+                    for ([[maybe_unused]] SampleId child = 0; child < num_children[level] - 1; ++child) {
+                        auto const other = *sample_counts_top;
+                        --sample_counts_top;
+                        *sample_counts_top += other;
+                    }
+                    KASSERT(inner_node_id < _forest.num_nodes());
+                    _subtree_sizes[inner_node_id] = *sample_counts_top;
+                    if constexpr (track_pending) {
+                        size_t const first_pending_ref = block.first_pending_ref[level];
+                        size_t const end_pending_ref   = block.pending_refs.size();
+                        if (end_pending_ref > first_pending_ref) {
+                            block.pending_ranges.push_back({inner_node_id, first_pending_ref, end_pending_ref});
+                            is_incomplete[inner_node_id] = true;
+                        }
+                    }
+                    --level;
+                    if (level == 0) [[unlikely]] {
+                        --sample_counts_top;
+                    }
+                    ++inner_node_id;
                 }
             }
-            last_bp = *bp_it;
-            ++bp_it;
-            ++is_ref_it;
+            last_bit_was_open = open >> (bits_per_word - 1);
         }
-        KASSERT(sample_counts_top - sample_counts.begin() == 0);
-        KASSERT(num_children.size() == 1ul);
+        KASSERT(sample_counts_top - block.sample_counts.begin() == 0);
+        KASSERT(level == 0ul);
     }
 };
 } // namespace sfkit::samples
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <barrier>
 #include <experimental/simd>
+#include <span>
+#include <thread>
 #include <vector>
 
 #include <kassert/kassert.hpp>
@@ -9,7 +13,9 @@
 
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/bp/BPCompressedForest.hpp"
+#include "sfkit/dag/DAGCSREdges.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/dag/DAGLevels.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/samples/NumSamplesBelow.hpp"
 #include "sfkit/samples/SampleSet.hpp"
@@ -19,6 +25,9 @@
 namespace sfkit::samples::internal {
 
 using sfkit::dag::DAGCompressedForest;
+using sfkit::dag::DAGCSREdges;
+using sfkit::dag::DAGLevels;
+using sfkit::graph::EdgeId;
 using sfkit::graph::EdgeListGraph;
 using sfkit::graph::NodeId;
 namespace stdx = std::experimental;
@@ -29,7 +38,72 @@ public:
     using SetOfSampleSets = std::array<std::reference_wrapper<SampleSet const>, N>;
 
     DAGNumSamplesBelowImpl(EdgeListGraph const& dag, SetOfSampleSets const& samples) : _dag(dag) {
-        // Check inputs
+        _check_and_count(samples);
+        _compute(samples);
+    }
+
+    // Compute the subtree sizes using the CSR encoding of the DAG's edges (see DAGCSREdges); csr_edges has to be
+    // computed from dag.
+    DAGNumSamplesBelowImpl(EdgeListGraph const& dag, DAGCSREdges const& csr_edges, SetOfSampleSets const& samples)
+        : _dag(dag) {
+        KASSERT(
+            csr_edges.num_edges() == _dag.num_edges(),
+            "The CSR edges do not belong to the DAG.",
+            sfkit::assert::light
+        );
+        _check_and_count(samples);
+        _compute(csr_edges, samples);
+    }
+
+    // Compute the subtree sizes level by level (see DAGLevels) using num_threads threads. The levels have to be
+    // computed from dag. Levels with less than 2 * min_parents_per_thread parents are not split between threads.
+    DAGNumSamplesBelowImpl(
+        EdgeListGraph const&   dag,
+        DAGLevels const&       levels,
+        SetOfSampleSets const& samples,
+        size_t const           num_threads,
+        size_t const           min_parents_per_thread = 2048
+    )
+        : _dag(dag) {
+        KASSERT(levels.num_edges() == _dag.num_edges(), "The levels do not belong to the DAG.", sfkit::assert::light);
+        _check_and_count(samples);
+        _compute_parallel(levels, samples, num_threads, min_parents_per_thread);
+    }
+
+    DAGNumSamplesBelowImpl(EdgeListGraph const& dag, SetOfSampleSets const& samples, size_t const num_threads)
+        : DAGNumSamplesBelowImpl(dag, DAGLevels(dag), samples, num_threads) {}
+
+    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
+        KASSERT(node_id < _subtree_sizes.size(), "Subtree ID out of bounds.", sfkit::assert::light);
+        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
+
+        return _subtree_sizes[node_id][sample_set_id];
+    }
+
+    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
+        return this->num_samples_below(node_id, sample_set_id);
+    }
+
+    [[nodiscard]] SampleId num_nodes_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_nodes());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_leaves());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
+        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
+        return _num_samples_in_sample_set[sample_set_id];
+    }
+
+private:
+    using simd_t = stdx::fixed_size_simd<BaseType, N>;
+    EdgeListGraph const&    _dag; // As a post-order sorted edge list
+    std::array<SampleId, N> _num_samples_in_sample_set;
+    std::vector<simd_t>     _subtree_sizes;
+
+    void _check_and_count(SetOfSampleSets const& samples) {
         KASSERT(_dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
         KASSERT(_dag.num_nodes() >= _dag.num_leaves(), "DAG has less nodes than leaves.", sfkit::assert::light);
         for (auto sample_set: samples) {
@@ -65,51 +139,118 @@ public:
             num_samples_in_sample_set_it++;
             samples_it++;
         }
-
-        // Compute the subtree sizes
-        _compute(samples);
     }
 
-    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
-        KASSERT(node_id < _subtree_sizes.size(), "Subtree ID out of bounds.", sfkit::assert::light);
-        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
-
-        return _subtree_sizes[node_id][sample_set_id];
-    }
+    void _init_leaves(SetOfSampleSets const& samples) {
+        KASSERT(_subtree_sizes.size() == 0ul, "Subtree sizes already computed.", sfkit::assert::light);
+        _subtree_sizes.resize(_dag.num_nodes(), 0);
 
-    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
-        return this->num_samples_below(node_id, sample_set_id);
+        KASSERT(samples.size() == N);
+        for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
+            for (SampleId sample: samples[sample_set_idx].get()) {
+                _subtree_sizes[sample][sample_set_idx] = 1;
+            }
+        }
     }
 
-    [[nodiscard]] SampleId num_nodes_in_dag() const {
-        return asserting_cast<SampleId>(_dag.num_nodes());
-    }
+    void _compute_parallel(
+        DAGLevels const&       levels,
+        SetOfSampleSets const& samples,
+        size_t const           num_threads,
+        size_t const           min_parents_per_thread
+    ) {
+        KASSERT(num_threads > 0ul, "At least one thread is required.", sfkit::assert::light);
+        KASSERT(min_parents_per_thread > 0ul, "Each thread has to process at least one parent.", sfkit::assert::light);
+        _init_leaves(samples);
+
+        // All children of the nodes of a level are final once the previous level is done; each thread adds up the
+        // children of its own range of parents. Levels which are too small to be worth splitting are processed by the
+        // first thread alone.
+        auto const   edges     = _dag.cbegin();
+        EdgeId const num_edges = _dag.num_edges();
+        std::barrier level_done(asserting_cast<std::ptrdiff_t>(num_threads));
+        auto const   process_levels = [&](size_t const thread_id) {
+            for (size_t level = 0; level < levels.num_levels(); level++) {
+                std::span<EdgeId const> const first_edges = levels.level(level);
+                size_t const                  num_active_threads =
+                    std::clamp<size_t>(first_edges.size() / min_parents_per_thread, 1ul, num_threads);
+                if (thread_id < num_active_threads) {
+                    size_t const begin = thread_id * first_edges.size() / num_active_threads;
+                    size_t const end   = (thread_id + 1) * first_edges.size() / num_active_threads;
+                    for (size_t group = begin; group < end; group++) {
+                        EdgeId       edge_idx = first_edges[group];
+                        NodeId const parent   = edges[edge_idx].from();
+                        do {
+                            _subtree_sizes[parent] += _subtree_sizes[edges[edge_idx].to()];
+                        } while (++edge_idx < num_edges && edges[edge_idx].from() == parent);
+                    }
+                }
+                level_done.arrive_and_wait();
+            }
+        };
 
-    [[nodiscard]] SampleId num_samples_in_dag() const {
-        return asserting_cast<SampleId>(_dag.num_leaves());
-    }
+        std::vector<std::thread> workers;
+        workers.reserve(num_threads - 1);
+        for (size_t thread_id = 1; thread_id < num_threads; thread_id++) {
+            workers.emplace_back(process_levels, thread_id);
+        }
+        process_levels(0);
+        for (auto& worker: workers) {
+            worker.join();
+        }
 
-    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
-        KASSERT(sample_set_id >= 0 && sample_set_id <= N, "Sample set ID invalid.", sfkit::assert::light);
-        return _num_samples_in_sample_set[sample_set_id];
+        KASSERT(
+            [this]() {
+                for (NodeId node_id = 0; node_id < _dag.num_nodes(); node_id++) {
+                    for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
+                        if (_subtree_sizes[node_id][sample_set_idx] > _num_samples_in_sample_set[sample_set_idx]) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }(),
+            "Number of samples below a node exceeds the number of samples in the tree sequence.",
+            sfkit::assert::heavy
+        );
     }
 
-private:
-    using simd_t = stdx::fixed_size_simd<BaseType, N>;
-    EdgeListGraph const&    _dag; // As a post-order sorted edge list
-    std::array<SampleId, N> _num_samples_in_sample_set;
-    std::vector<simd_t>     _subtree_sizes;
+    // Sweep the parents of the CSR edges in postorder and sum up the subtree sizes of their children.
+    void _compute(DAGCSREdges const& csr_edges, SetOfSampleSets const& samples) {
+        _init_leaves(samples);
+
+        // The children of all parents are stored consecutively; prefetch the subtree sizes of the children a fixed
+        // number of edges ahead. Each parent accumulates its children in a register and is written only once.
+        constexpr size_t              prefetch_distance = 128;
+        std::span<NodeId const> const all_children      = csr_edges.children();
+        size_t                        prefetch_idx      = 0;
+        for (; prefetch_idx < prefetch_distance && prefetch_idx < all_children.size(); prefetch_idx++) {
+            __builtin_prefetch(&_subtree_sizes[all_children[prefetch_idx]], 0, 3);
+        }
 
-    void _compute(SetOfSampleSets const& samples) {
-        KASSERT(_subtree_sizes.size() == 0ul, "Subtree sizes already computed.", sfkit::assert::light);
-        _subtree_sizes.resize(_dag.num_nodes(), 0);
+        csr_edges.for_each_parent([&](NodeId const parent, std::span<NodeId const> const children) {
+            simd_t subtree_size = _subtree_sizes[parent];
+            for (NodeId const child: children) {
+                subtree_size += _subtree_sizes[child];
+                if (prefetch_idx < all_children.size()) {
+                    __builtin_prefetch(&_subtree_sizes[all_children[prefetch_idx]], 0, 3);
+                    prefetch_idx++;
+                }
+            }
+            _subtree_sizes[parent] = subtree_size;
 
-        KASSERT(samples.size() == N);
-        for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
-            for (SampleId sample: samples[sample_set_idx].get()) {
-                _subtree_sizes[sample][sample_set_idx] = 1;
+            for (size_t sample_set_idx = 0; sample_set_idx < N; sample_set_idx++) {
+                KASSERT(
+                    (_subtree_sizes[parent][sample_set_idx]) <= _num_samples_in_sample_set[sample_set_idx],
+                    "Number of samples below a node exceeds the number of samples in the tree sequence.",
+                    sfkit::assert::light
+                );
             }
-        }
+        });
+    }
+
+    void _compute(SetOfSampleSets const& samples) {
+        _init_leaves(samples);
 
         // Prefetch the first few edges
         constexpr auto num_edges_to_prefetch = 128;
@@ -167,8 +308,21 @@ class NumSamplesBelow<DAGCompressedForest, N, BaseType> {
 public:
     using SetOfSampleSets = std::array<std::reference_wrapper<SampleSet const>, N>;
 
+    // Uses the CSR encoding of the edges cached in the forest if it has been computed (see
+    // DAGCompressedForest::compute_csr_edges()).
     NumSamplesBelow(DAGCompressedForest const& forest, SetOfSampleSets const& samples)
-        : _impl(forest.postorder_edges(), samples) {}
+        : _impl(
+            forest.csr_edges_are_computed() ? Impl(forest.postorder_edges(), forest.csr_edges(), samples)
+                                            : Impl(forest.postorder_edges(), samples)
+        ) {}
+
+    // Process the DAG level by level using num_threads threads. Uses the levels stored in the forest if they have been
+    // computed (e.g. for forests loaded from an archive) and computes them otherwise.
+    NumSamplesBelow(DAGCompressedForest const& forest, SetOfSampleSets const& samples, size_t const num_threads)
+        : _impl(
+            forest.levels_are_computed() ? Impl(forest.postorder_edges(), forest.levels(), samples, num_threads)
+                                         : Impl(forest.postorder_edges(), samples, num_threads)
+        ) {}
 
     [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
         return _impl.num_samples_below(node_id, sample_set_id);
@@ -191,7 +345,8 @@ public:
     }
 
 private:
-    internal::DAGNumSamplesBelowImpl<N, BaseType> _impl;
+    using Impl = internal::DAGNumSamplesBelowImpl<N, BaseType>;
+    Impl _impl;
 };
 
 template <size_t N, typename BaseType>
@@ -201,6 +356,10 @@ public:
 
     NumSamplesBelow(EdgeListGraph const& dag, SetOfSampleSets const& samples) : _impl(dag, samples) {}
 
+    // Process the DAG level by level using num_threads threads (see DAGLevels).
+    NumSamplesBelow(EdgeListGraph const& dag, SetOfSampleSets const& samples, size_t const num_threads)
+        : _impl(dag, samples, num_threads) {}
+
     [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
         return _impl.num_samples_below(node_id, sample_set_id);
     }
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/samples/SampleSet.hpp"
+#include "sfkit/samples/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+#include "sfkit/utils/concepts.hpp"
+
+namespace sfkit::samples {
+
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::NodeId;
+using sfkit::utils::asserting_cast;
+using sfkit::utils::IterableInput;
+
+// For a fixed set of nodes (e.g. the nodes with mutations), stores the set of samples below each of them as a bitmap.
+// The number of samples of any sample set below one of these nodes is then the popcount of the bitwise AND of two
+// bitmaps; answering a query needs no traversal of the DAG. Needs num_nodes * num_samples / 8 bytes and is thus meant
+// for tree sequences with up to a few thousand samples.
+class DescendantBitmaps {
+public:
+    using Word                            = uint64_t;
+    static constexpr size_t bits_per_word = std::numeric_limits<Word>::digits;
+    static constexpr size_t NO_BITMAP     = std::numeric_limits<size_t>::max();
+
+    // The edges of the DAG have to be in post-order and the samples have to be the nodes 0 ... num_leaves - 1.
+    template <IterableInput Nodes>
+    DescendantBitmaps(EdgeListGraph const& dag, Nodes const& nodes)
+        : _num_nodes_in_dag(dag.num_nodes()),
+          _num_samples(dag.num_leaves()),
+          _words_per_bitmap((dag.num_leaves() + bits_per_word - 1) / bits_per_word),
+          _bitmap_of_node(dag.num_nodes(), NO_BITMAP) {
+        KASSERT(dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+
+        size_t num_bitmaps = 0;
+        for (NodeId const node: nodes) {
+            KASSERT(node < _num_nodes_in_dag, "Node ID out of bounds.", sfkit::assert::light);
+            if (_bitmap_of_node[node] == NO_BITMAP) {
+                _bitmap_of_node[node] = num_bitmaps++;
+            }
+        }
+        _bitmaps.resize(num_bitmaps * _words_per_bitmap, 0);
+
+        _compute(dag);
+    }
+
+    // The number of samples in the sample set, given as a bitmap (see to_bitmap()), below the node.
+    [[nodiscard]] SampleId num_samples_below(NodeId const node_id, std::span<Word const> const sample_set) const {
+        KASSERT(sample_set.size() == _words_per_bitmap, "Sample set has the wrong size.", sfkit::assert::light);
+        std::span<Word const> const descendants = bitmap(node_id);
+
+        SampleId num_samples = 0;
+        for (size_t word = 0; word < _words_per_bitmap; word++) {
+            num_samples += asserting_cast<SampleId>(std::popcount(descendants[word] & sample_set[word]));
+        }
+        return num_samples;
+    }
+
+    [[nodiscard]] std::span<Word const> bitmap(NodeId const node_id) const {
+        KASSERT(has_bitmap(node_id), "There is no bitmap for this node.", sfkit::assert::light);
+        size_t const first_word = _bitmap_of_node[node_id] * _words_per_bitmap;
+        return std::span<Word const>(_bitmaps).subspan(first_word, _words_per_bitmap);
+    }
+
+    [[nodiscard]] bool has_bitmap(NodeId const node_id) const {
+        KASSERT(node_id < _num_nodes_in_dag, "Node ID out of bounds.", sfkit::assert::light);
+        return _bitmap_of_node[node_id] != NO_BITMAP;
+    }
+
+    [[nodiscard]] std::vector<Word> to_bitmap(SampleSet const& sample_set) const {
+        KASSERT(
+            sample_set.overall_num_samples() == _num_samples,
+            "Sample set has the wrong number of overall samples.",
+            sfkit::assert::light
+        );
+        std::vector<Word> bitmap(_words_per_bitmap, 0);
+        for (SampleId const sample: sample_set) {
+            bitmap[sample / bits_per_word] |= Word{1} << (sample % bits_per_word);
+        }
+        return bitmap;
+    }
+
+    [[nodiscard]] NodeId num_nodes_in_dag() const {
+        return _num_nodes_in_dag;
+    }
+
+    [[nodiscard]] SampleId num_samples() const {
+        return _num_samples;
+    }
+
+    [[nodiscard]] size_t num_bitmaps() const {
+        return _bitmaps.size() / std::max<size_t>(_words_per_bitmap, 1);
+    }
+
+    [[nodiscard]] size_t memory_usage() const {
+        return _bitmaps.size() * sizeof(Word) + _bitmap_of_node.size() * sizeof(size_t);
+    }
+
+private:
+    NodeId              _num_nodes_in_dag;
+    SampleId            _num_samples;
+    size_t              _words_per_bitmap;
+    std::vector<size_t> _bitmap_of_node; // Index of the node's bitmap or NO_BITMAP
+    std::vector<Word>   _bitmaps;
+
+    // Compute the bitmaps of all nodes bottom-up. The bitmap of a node which does not need one is released as soon as
+    // the last of its parents has been processed; thus, we only keep the bitmaps of the current "frontier" of the DAG.
+    void _compute(EdgeListGraph const& dag) {
+        std::vector<NodeId> num_unprocessed_parents(_num_nodes_in_dag, 0);
+        for (auto const& edge: dag) {
+            num_unprocessed_parents[edge.to()]++;
+        }
+
+        std::vector<std::vector<Word>> frontier(_num_nodes_in_dag);
+        for (SampleId sample = 0; sample < _num_samples; sample++) {
+            frontier[sample].resize(_words_per_bitmap, 0);
+            frontier[sample][sample / bits_per_word] |= Word{1} << (sample % bits_per_word);
+        }
+
+        for (auto const& edge: dag) {
+            std::vector<Word>& parent = frontier[edge.from()];
+            std::vector<Word>& child  = frontier[edge.to()];
+            KASSERT(child.size() == _words_per_bitmap, "The child has not been processed.", sfkit::assert::light);
+            if (parent.empty()) {
+                parent.resize(_words_per_bitmap, 0);
+            }
+            for (size_t word = 0; word < _words_per_bitmap; word++) {
+                parent[word] |= child[word];
+            }
+
+            if (--num_unprocessed_parents[edge.to()] == 0) {
+                _store_and_release(edge.to(), child);
+            }
+        }
+
+        // The roots have no parents.
+        for (NodeId node = 0; node < _num_nodes_in_dag; node++) {
+            if (!frontier[node].empty()) {
+                _store_and_release(node, frontier[node]);
+            }
+        }
+    }
+
+    void _store_and_release(NodeId const node_id, std::vector<Word>& bitmap) {
+        if (_bitmap_of_node[node_id] != NO_BITMAP) {
+            std::copy(
+                bitmap.begin(),
+                bitmap.end(),
+                _bitmaps.begin() + asserting_cast<std::ptrdiff_t>(_bitmap_of_node[node_id] * _words_per_bitmap)
+            );
+        }
+        bitmap.clear();
+        bitmap.shrink_to_fit();
+    }
+};
+
+// Answers the number of samples of one sample set below the nodes of a DescendantBitmaps index. Can be used in place of
+// a NumSamplesBelowAccessor, e.g. to compute AlleleFrequencies, as long as only nodes with a bitmap are queried.
+class DescendantBitmapNumSamplesBelow {
+public:
+    DescendantBitmapNumSamplesBelow(std::shared_ptr<DescendantBitmaps const> bitmaps, SampleSet const& sample_set)
+        : _bitmaps(std::move(bitmaps)),
+          _sample_set(_bitmaps->to_bitmap(sample_set)),
+          _num_samples_in_sample_set(sample_set.popcount()) {}
+
+    [[nodiscard]] SampleId num_samples_below(NodeId node_id) const {
+        return _bitmaps->num_samples_below(node_id, _sample_set);
+    }
+
+    [[nodiscard]] SampleId operator()(NodeId node_id) const {
+        return this->num_samples_below(node_id);
+    }
+
+    [[nodiscard]] SampleId operator[](NodeId node_id) const {
+        return this->num_samples_below(node_id);
+    }
+
+    [[nodiscard]] SampleId num_nodes_in_dag() const {
+        return asserting_cast<SampleId>(_bitmaps->num_nodes_in_dag());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_dag() const {
+        return _bitmaps->num_samples();
+    }
+
+    [[nodiscard]] SampleId num_samples_in_sample_set() const {
+        return _num_samples_in_sample_set;
+    }
+
+private:
+    std::shared_ptr<DescendantBitmaps const> _bitmaps;
+    std::vector<DescendantBitmaps::Word>     _sample_set;
+    SampleId                                 _num_samples_in_sample_set;
+};
+
+} // namespace sfkit::samples
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <experimental/simd>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/samples/SampleSet.hpp"
+#include "sfkit/samples/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::samples {
+
+using sfkit::dag::DAGCompressedForest;
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::NodeId;
+using sfkit::utils::asserting_cast;
+namespace stdx = std::experimental;
+
+// A set of sample sets whose size is only known at runtime.
+using DynamicSetOfSampleSets = std::vector<std::reference_wrapper<SampleSet const>>;
+
+// Like NumSamplesBelow<DAGCompressedForest, N, BaseType>, but the number of sample sets is chosen at runtime, e.g. one
+// per population. The sample sets are split into blocks of `lanes` sample sets each, which fill one SIMD register
+// (16 x uint16_t or 8 x uint32_t). The subtree sizes are stored as a node-major matrix of these blocks; all blocks of a
+// node are thus adjacent in memory. A single pass over the post-ordered edges computes the subtree sizes of all sample
+// sets. BaseType has to be able to represent the number of samples in each sample set.
+template <typename BaseType = SampleId>
+class DynamicNumSamplesBelow {
+public:
+    static constexpr size_t lanes = 32 / sizeof(BaseType);
+    using Block                   = stdx::fixed_size_simd<BaseType, lanes>;
+
+    DynamicNumSamplesBelow(EdgeListGraph const& dag, DynamicSetOfSampleSets const& samples)
+        : _dag(dag),
+          _num_sample_sets(samples.size()),
+          _num_blocks((samples.size() + lanes - 1) / lanes) {
+        KASSERT(_dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+        KASSERT(_dag.num_nodes() >= _dag.num_leaves(), "DAG has less nodes than leaves.", sfkit::assert::light);
+        KASSERT(
+            samples.size() <= std::numeric_limits<SampleSetId>::max() + 1ul,
+            "Too many sample sets to be addressed by a SampleSetId.",
+            sfkit::assert::light
+        );
+
+        _num_samples_in_sample_set.reserve(samples.size());
+        for (auto sample_set: samples) {
+            KASSERT(
+                _dag.num_leaves() <= sample_set.get().overall_num_samples(),
+                "Number of leaves in the DAG is greater than the number of overall samples representable in the "
+                "sample set.",
+                sfkit::assert::light
+            );
+            KASSERT(
+                sample_set.get().popcount() <= std::numeric_limits<BaseType>::max(),
+                "The number of samples in the sample set does not fit into BaseType.",
+                sfkit::assert::light
+            );
+            _num_samples_in_sample_set.push_back(sample_set.get().popcount());
+        }
+
+        _compute(samples);
+    }
+
+    DynamicNumSamplesBelow(DAGCompressedForest const& forest, DynamicSetOfSampleSets const& samples)
+        : DynamicNumSamplesBelow(forest.postorder_edges(), samples) {}
+
+    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
+        KASSERT(node_id < _dag.num_nodes(), "Node ID out of bounds.", sfkit::assert::light);
+        KASSERT(sample_set_id < _num_sample_sets, "Sample set ID invalid.", sfkit::assert::light);
+
+        return _subtree_sizes[node_id * _num_blocks + sample_set_id / lanes][sample_set_id % lanes];
+    }
+
+    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
+        return this->num_samples_below(node_id, sample_set_id);
+    }
+
+    [[nodiscard]] SampleId num_nodes_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_nodes());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_leaves());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
+        KASSERT(sample_set_id < _num_sample_sets, "Sample set ID invalid.", sfkit::assert::light);
+        return _num_samples_in_sample_set[sample_set_id];
+    }
+
+    [[nodiscard]] size_t num_sample_sets() const {
+        return _num_sample_sets;
+    }
+
+private:
+    EdgeListGraph const&  _dag; // As a post-order sorted edge list
+    size_t                _num_sample_sets;
+    size_t                _num_blocks; // per node
+    std::vector<SampleId> _num_samples_in_sample_set;
+    std::vector<Block>    _subtree_sizes;
+
+    Block* _blocks_of(NodeId node_id) {
+        return _subtree_sizes.data() + node_id * _num_blocks;
+    }
+
+    void _compute(DynamicSetOfSampleSets const& samples) {
+        KASSERT(_subtree_sizes.size() == 0ul, "Subtree sizes already computed.", sfkit::assert::light);
+        _subtree_sizes.resize(_dag.num_nodes() * _num_blocks, 0);
+
+        for (size_t sample_set_idx = 0; sample_set_idx < _num_sample_sets; sample_set_idx++) {
+            size_t const block = sample_set_idx / lanes;
+            size_t const lane  = sample_set_idx % lanes;
+            for (SampleId sample: samples[sample_set_idx].get()) {
+                _blocks_of(sample)[block][lane] = 1;
+            }
+        }
+
+        // Compute the subtree sizes using a post-order traversal. We prefetch the rows of the edges a few iterations
+        // ahead; a row may span several cache lines if there are many sample sets.
+        constexpr size_t prefetch_distance = 32;
+        size_t const     row_bytes         = _num_blocks * sizeof(Block);
+        auto const       prefetch_row      = [this, row_bytes](NodeId const node_id) {
+            char const* row = reinterpret_cast<char const*>(_blocks_of(node_id));
+            for (size_t offset = 0; offset < row_bytes; offset += 64) {
+                __builtin_prefetch(row + offset, 0, 3);
+            }
+        };
+
+        auto prefetch_it = _dag.begin();
+        for (size_t i = 0; i < prefetch_distance && prefetch_it != _dag.end(); i++) {
+            prefetch_row(prefetch_it->from());
+            prefetch_row(prefetch_it->to());
+            prefetch_it++;
+        }
+
+        for (auto work_it = _dag.begin(); work_it != _dag.end(); work_it++) {
+            if (prefetch_it != _dag.end()) [[likely]] {
+                prefetch_row(prefetch_it->from());
+                prefetch_row(prefetch_it->to());
+                prefetch_it++;
+            }
+
+            // Add the blocks of the child to the blocks of the parent, one SIMD register at a time.
+            Block*       from = _blocks_of(work_it->from());
+            Block const* to   = _blocks_of(work_it->to());
+            for (size_t block = 0; block < _num_blocks; block++) {
+                from[block] += to[block];
+            }
+        }
+
+        KASSERT(
+            [this]() {
+                for (NodeId node_id = 0; node_id < _dag.num_nodes(); node_id++) {
+                    for (size_t set = 0; set < _num_sample_sets; set++) {
+                        if (num_samples_below(node_id, asserting_cast<SampleSetId>(set))
+                            > _num_samples_in_sample_set[set]) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }(),
+            "Number of samples below a node exceeds the number of samples in the sample set.",
+            sfkit::assert::heavy
+        );
+    }
+};
+
+} // namespace sfkit::samples
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/graph/EdgeListGraph.hpp"
+#include "sfkit/graph/primitives.hpp"
+#include "sfkit/samples/DynamicNumSamplesBelow.hpp"
+#include "sfkit/samples/SampleSet.hpp"
+#include "sfkit/samples/primitives.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::samples {
+
+using sfkit::dag::DAGCompressedForest;
+using sfkit::graph::EdgeListGraph;
+using sfkit::graph::NodeId;
+using sfkit::utils::asserting_cast;
+
+// The number of samples below each node for a number of sample sets which change over time, e.g. during permutation
+// tests. The subtree sizes are computed once with a pass over all edges. Afterwards, adding a sample to a sample set
+// (or removing it) only updates the ancestors of that sample, which we find using an index of the parents of each node.
+// As each subtree of the DAG is a tree, a sample lies below each of its ancestors exactly once; we thus visit each
+// ancestor once, even if it can be reached via multiple paths.
+//
+// The object is shared by the NumSamplesBelowAccessors of its sample sets (see NumSamplesBelowAccessor), which thus
+// always reflect the current sample sets; e.g. an AlleleFrequencies object built from such an accessor yields the
+// allele frequencies of the updated sample set without any further work.
+class IncrementalNumSamplesBelow {
+public:
+    IncrementalNumSamplesBelow(EdgeListGraph const& dag, DynamicSetOfSampleSets const& samples)
+        : _dag(dag),
+          _num_sample_sets(samples.size()),
+          _visited(dag.num_nodes(), 0) {
+        KASSERT(_dag.check_postorder(), "DAG edges are not post-ordered.", sfkit::assert::normal);
+        KASSERT(_dag.num_nodes() >= _dag.num_leaves(), "DAG has less nodes than leaves.", sfkit::assert::light);
+        KASSERT(
+            samples.size() <= std::numeric_limits<SampleSetId>::max() + 1ul,
+            "Too many sample sets to be addressed by a SampleSetId.",
+            sfkit::assert::light
+        );
+
+        _sample_sets.reserve(samples.size());
+        _num_samples_in_sample_set.reserve(samples.size());
+        for (auto sample_set: samples) {
+            KASSERT(
+                _dag.num_leaves() <= sample_set.get().overall_num_samples(),
+                "Number of leaves in the DAG is greater than the number of overall samples representable in the "
+                "sample set.",
+                sfkit::assert::light
+            );
+            _sample_sets.push_back(sample_set.get());
+            _num_samples_in_sample_set.push_back(sample_set.get().popcount());
+        }
+
+        _build_parent_index();
+        _compute();
+    }
+
+    IncrementalNumSamplesBelow(DAGCompressedForest const& forest, DynamicSetOfSampleSets const& samples)
+        : IncrementalNumSamplesBelow(forest.postorder_edges(), samples) {}
+
+    // Adds the sample to the sample set; O(number of ancestors of the sample).
+    void add(SampleId const sample, SampleSetId const sample_set_id) {
+        KASSERT(!_sample_sets[sample_set_id][sample], "The sample is already in the sample set.", sfkit::assert::light);
+        _sample_sets[sample_set_id].add(sample);
+        _num_samples_in_sample_set[sample_set_id]++;
+        _for_each_ancestor(sample, [this, sample_set_id](NodeId const node_id) {
+            _subtree_size(node_id, sample_set_id)++;
+        });
+    }
+
+    // Removes the sample from the sample set; O(number of ancestors of the sample).
+    void remove(SampleId const sample, SampleSetId const sample_set_id) {
+        KASSERT(_sample_sets[sample_set_id][sample], "The sample is not in the sample set.", sfkit::assert::light);
+        _sample_sets[sample_set_id].remove(sample);
+        _num_samples_in_sample_set[sample_set_id]--;
+        _for_each_ancestor(sample, [this, sample_set_id](NodeId const node_id) {
+            _subtree_size(node_id, sample_set_id)--;
+        });
+    }
+
+    // Moves the sample from one sample set to another, visiting its ancestors only once.
+    void move(SampleId const sample, SampleSetId const from_set_id, SampleSetId const to_set_id) {
+        KASSERT(_sample_sets[from_set_id][sample], "The sample is not in the sample set.", sfkit::assert::light);
+        KASSERT(!_sample_sets[to_set_id][sample], "The sample is already in the sample set.", sfkit::assert::light);
+        _sample_sets[from_set_id].remove(sample);
+        _sample_sets[to_set_id].add(sample);
+        _num_samples_in_sample_set[from_set_id]--;
+        _num_samples_in_sample_set[to_set_id]++;
+        _for_each_ancestor(sample, [this, from_set_id, to_set_id](NodeId const node_id) {
+            _subtree_size(node_id, from_set_id)--;
+            _subtree_size(node_id, to_set_id)++;
+        });
+    }
+
+    [[nodiscard]] SampleId num_samples_below(NodeId node_id, SampleSetId sample_set_id) const {
+        KASSERT(node_id < _dag.num_nodes(), "Node ID out of bounds.", sfkit::assert::light);
+        KASSERT(sample_set_id < _num_sample_sets, "Sample set ID invalid.", sfkit::assert::light);
+        return _subtree_sizes[node_id * _num_sample_sets + sample_set_id];
+    }
+
+    [[nodiscard]] SampleId operator()(NodeId node_id, SampleSetId sample_set_id) const {
+        return this->num_samples_below(node_id, sample_set_id);
+    }
+
+    [[nodiscard]] SampleId num_nodes_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_nodes());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_dag() const {
+        return asserting_cast<SampleId>(_dag.num_leaves());
+    }
+
+    [[nodiscard]] SampleId num_samples_in_sample_set(SampleSetId sample_set_id) const {
+        KASSERT(sample_set_id < _num_sample_sets, "Sample set ID invalid.", sfkit::assert::light);
+        return _num_samples_in_sample_set[sample_set_id];
+    }
+
+    [[nodiscard]] SampleSet const& sample_set(SampleSetId sample_set_id) const {
+        KASSERT(sample_set_id < _num_sample_sets, "Sample set ID invalid.", sfkit::assert::light);
+        return _sample_sets[sample_set_id];
+    }
+
+    [[nodiscard]] size_t num_sample_sets() const {
+        return _num_sample_sets;
+    }
+
+private:
+    EdgeListGraph const&   _dag; // As a post-order sorted edge list
+    size_t                 _num_sample_sets;
+    std::vector<SampleSet> _sample_sets;
+    std::vector<SampleId>  _num_samples_in_sample_set;
+    std::vector<SampleId>  _subtree_sizes; // Node-major, _num_sample_sets entries per node
+    std::vector<NodeId>    _parents;       // The parents of node i are _parents[_parents_begin[i], _parents_begin[i+1])
+    std::vector<size_t>    _parents_begin;
+    std::vector<uint32_t>  _visited;       // Nodes visited during the current traversal are marked with _epoch
+    uint32_t               _epoch = 0;
+    std::vector<NodeId>    _stack;
+
+    SampleId& _subtree_size(NodeId const node_id, SampleSetId const sample_set_id) {
+        return _subtree_sizes[node_id * _num_sample_sets + sample_set_id];
+    }
+
+    void _build_parent_index() {
+        _parents_begin.assign(_dag.num_nodes() + 1ul, 0);
+        for (auto const& edge: _dag) {
+            _parents_begin[edge.to() + 1ul]++;
+        }
+        std::inclusive_scan(_parents_begin.begin(), _parents_begin.end(), _parents_begin.begin());
+
+        _parents.resize(_dag.num_edges());
+        std::vector<size_t> insert_pos(_parents_begin.begin(), _parents_begin.end() - 1);
+        for (auto const& edge: _dag) {
+            _parents[insert_pos[edge.to()]++] = edge.from();
+        }
+    }
+
+    void _compute() {
+        _subtree_sizes.assign(_dag.num_nodes() * _num_sample_sets, 0);
+        for (size_t sample_set_idx = 0; sample_set_idx < _num_sample_sets; sample_set_idx++) {
+            for (SampleId sample: _sample_sets[sample_set_idx]) {
+                _subtree_sizes[sample * _num_sample_sets + sample_set_idx] = 1;
+            }
+        }
+
+        for (auto const& edge: _dag) {
+            SampleId*       from = _subtree_sizes.data() + edge.from() * _num_sample_sets;
+            SampleId const* to   = _subtree_sizes.data() + edge.to() * _num_sample_sets;
+            for (size_t sample_set_idx = 0; sample_set_idx < _num_sample_sets; sample_set_idx++) {
+                from[sample_set_idx] += to[sample_set_idx];
+            }
+        }
+    }
+
+    // Calls visit(node) for the sample and each of its ancestors, exactly once each.
+    template <typename Visitor>
+    void _for_each_ancestor(SampleId const sample, Visitor&& visit) {
+        KASSERT(sample < _dag.num_leaves(), "Sample ID out of bounds.", sfkit::assert::light);
+        if (++_epoch == 0) [[unlikely]] { // Overflow; reset the marks of all nodes.
+            std::fill(_visited.begin(), _visited.end(), 0);
+            _epoch = 1;
+        }
+
+        _stack.clear();
+        _stack.push_back(sample);
+        _visited[sample] = _epoch;
+        while (!_stack.empty()) {
+            NodeId const node_id = _stack.back();
+            _stack.pop_back();
+            visit(node_id);
+
+            for (size_t idx = _parents_begin[node_id]; idx < _parents_begin[node_id + 1]; idx++) {
+                NodeId const parent = _parents[idx];
+                if (_visited[parent] != _epoch) {
+                    _visited[parent] = _epoch;
+                    _stack.push_back(parent);
+                }
+            }
+        }
+    }
+};
+
+} // namespace sfkit::samples
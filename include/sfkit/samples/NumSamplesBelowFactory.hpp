@@ -1,5 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "sfkit/samples/DynamicNumSamplesBelow.hpp"
+#include "sfkit/samples/IncrementalNumSamplesBelow.hpp"
 #include "sfkit/samples/NumSamplesBelow.hpp"
 #include "sfkit/samples/NumSamplesBelowAccessor.hpp"
 #include "sfkit/samples/SampleSet.hpp"
@@ -60,6 +66,40 @@ public:
         );
     }
 
+    // Any number of sample sets at once, computed in a single pass over the DAG. Choose BaseType = uint16_t to process
+    // 16 instead of 8 sample sets per SIMD register if each sample set contains less than 2^16 samples.
+    template <typename CompressedForest, typename BaseType = SampleId>
+    static std::vector<NumSamplesBelowAccessor<DynamicNumSamplesBelow<BaseType>>>
+    build(CompressedForest const& forest, DynamicSetOfSampleSets const& sample_sets) {
+        using NumSamplesBelow = DynamicNumSamplesBelow<BaseType>;
+
+        auto const num_samples_below = std::make_shared<NumSamplesBelow>(forest, sample_sets);
+
+        std::vector<NumSamplesBelowAccessor<NumSamplesBelow>> accessors;
+        accessors.reserve(sample_sets.size());
+        for (size_t sample_set_id = 0; sample_set_id < sample_sets.size(); sample_set_id++) {
+            accessors.emplace_back(num_samples_below, asserting_cast<SampleSetId>(sample_set_id));
+        }
+        return accessors;
+    }
+
+    // Sample sets which change over time (see IncrementalNumSamplesBelow). Returns the object to add and remove samples
+    // with and an accessor per sample set; the accessors reflect these changes.
+    template <typename CompressedForest>
+    static std::tuple<
+        std::shared_ptr<IncrementalNumSamplesBelow>,
+        std::vector<NumSamplesBelowAccessor<IncrementalNumSamplesBelow>>>
+    build_incremental(CompressedForest const& forest, DynamicSetOfSampleSets const& sample_sets) {
+        auto num_samples_below = std::make_shared<IncrementalNumSamplesBelow>(forest, sample_sets);
+
+        std::vector<NumSamplesBelowAccessor<IncrementalNumSamplesBelow>> accessors;
+        accessors.reserve(sample_sets.size());
+        for (size_t sample_set_id = 0; sample_set_id < sample_sets.size(); sample_set_id++) {
+            accessors.emplace_back(num_samples_below, asserting_cast<SampleSetId>(sample_set_id));
+        }
+        return std::tuple(std::move(num_samples_below), std::move(accessors));
+    }
+
 private:
 };
 
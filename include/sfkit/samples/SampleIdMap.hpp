@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/cereal.hpp>
+#include <tskit/core.h>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/io/vector_serialization.hpp"
+#include "sfkit/samples/primitives.hpp"
+#include "sfkit/tskit/TSKitTreeSequence.hpp"
+#include "sfkit/utils/checking_casts.hpp"
+
+namespace sfkit::samples {
+
+using sfkit::utils::asserting_cast;
+
+// The compressed forests number the samples consecutively: 0 ... num_samples - 1. In a tree sequence, the samples can
+// be arbitrary nodes. This maps the sample ids to the tskit node ids and back, the i-th sample of the tree sequence
+// getting sample id i. The mapping is stored alongside the compressed forest in order to translate results back to the
+// nodes of the tree sequence. If the samples of the tree sequence are the nodes 0 ... num_samples - 1 (the common
+// case), the mapping is the identity and no lookups are required.
+class SampleIdMap {
+public:
+    SampleIdMap() = default;
+
+    SampleIdMap(tskit::TSKitTreeSequence const& tree_sequence) {
+        tsk_id_t const* samples = tsk_treeseq_get_samples(&tree_sequence.underlying());
+        _ts_node_ids.assign(samples, samples + tree_sequence.num_samples());
+        _init();
+    }
+
+    [[nodiscard]] SampleId num_samples() const {
+        return asserting_cast<SampleId>(_ts_node_ids.size());
+    }
+
+    // Are the samples the nodes 0 ... num_samples - 1 of the tree sequence?
+    [[nodiscard]] bool is_identity() const {
+        return _is_identity;
+    }
+
+    [[nodiscard]] tsk_id_t ts_node_id(SampleId const sample_id) const {
+        KASSERT(sample_id < num_samples(), "Sample id out of range.", sfkit::assert::light);
+        return _ts_node_ids[sample_id];
+    }
+
+    [[nodiscard]] bool is_sample(tsk_id_t const ts_node_id) const {
+        if (_is_identity) [[likely]] {
+            return ts_node_id < asserting_cast<tsk_id_t>(_ts_node_ids.size());
+        } else {
+            return asserting_cast<size_t>(ts_node_id) < _is_sample.size()
+                   && _is_sample[asserting_cast<size_t>(ts_node_id)];
+        }
+    }
+
+    // O(log num_samples) if the mapping is not the identity.
+    [[nodiscard]] SampleId sample_id(tsk_id_t const ts_node_id) const {
+        KASSERT(is_sample(ts_node_id), "Node is not a sample.", sfkit::assert::light);
+        if (_is_identity) [[likely]] {
+            return asserting_cast<SampleId>(ts_node_id);
+        }
+        auto const it = std::lower_bound(_ts_node_ids.begin(), _ts_node_ids.end(), ts_node_id);
+        return asserting_cast<SampleId>(it - _ts_node_ids.begin());
+    }
+
+    [[nodiscard]] std::vector<tsk_id_t> const& ts_node_ids() const {
+        return _ts_node_ids;
+    }
+
+    [[nodiscard]] bool operator==(SampleIdMap const& other) const {
+        return _ts_node_ids == other._ts_node_ids;
+    }
+
+    // Only the sample ids are stored, the lookup table is rebuilt after loading.
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(_ts_node_ids);
+        _init();
+    }
+
+    void save(std::ostream& os) const {
+        sfkit::io::utils::serialize(os, _ts_node_ids);
+    }
+
+    void load(std::istream& is) {
+        sfkit::io::utils::deserialize(is, _ts_node_ids);
+        _init();
+    }
+
+private:
+    std::vector<tsk_id_t> _ts_node_ids; // Indexed by sample id
+    std::vector<bool>     _is_sample;   // Indexed by tskit node id; empty if the mapping is the identity.
+    bool                  _is_identity = true;
+
+    void _init() {
+        // tskit lists the samples in the order of the node table.
+        KASSERT(
+            std::is_sorted(_ts_node_ids.begin(), _ts_node_ids.end()),
+            "The samples are not sorted by their node id.",
+            sfkit::assert::light
+        );
+
+        _is_identity = true;
+        for (SampleId sample_id = 0; sample_id < num_samples() && _is_identity; ++sample_id) {
+            _is_identity = _ts_node_ids[sample_id] == asserting_cast<tsk_id_t>(sample_id);
+        }
+
+        _is_sample.clear();
+        if (!_is_identity) {
+            _is_sample.resize(asserting_cast<size_t>(_ts_node_ids.back()) + 1, false);
+            for (tsk_id_t const ts_node_id: _ts_node_ids) {
+                _is_sample[asserting_cast<size_t>(ts_node_id)] = true;
+            }
+        }
+    }
+};
+
+} // namespace sfkit::samples
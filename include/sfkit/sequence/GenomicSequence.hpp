@@ -121,6 +121,40 @@ public:
         _mutation_indices_valid = true;
     }
 
+    // Append the sites and mutations of a sequence covering the genomic region directly following this one. The site
+    // ids of the other sequence are shifted by the number of sites in this sequence and its tree ids by tree_offset.
+    // The mutation indices are extended instead of rebuilt, thus this takes time proportional to the size of other.
+    void append(GenomicSequence const& other, TreeId const tree_offset) {
+        KASSERT(other._mutation_indices_valid, "Mutation indices of the other sequence are not built.");
+        if (!_mutation_indices_valid) {
+            build_mutation_indices();
+        }
+
+        SiteId const     site_offset     = num_sites();
+        MutationId const mutation_offset = num_mutations();
+
+        _sites.insert(_sites.end(), other._sites.begin(), other._sites.end());
+
+        _mutations.reserve(_mutations.size() + other._mutations.size());
+        for (Mutation const& mutation: other._mutations) {
+            _mutations.emplace_back(
+                mutation.site_id() + site_offset,
+                mutation.tree_id() + tree_offset,
+                mutation.node_id(),
+                mutation.allelic_state(),
+                mutation.parent_state()
+            );
+        }
+
+        // Replace our sentinel by the mutation indices of the other sequence's sites (and its sentinel).
+        _mutation_indices.pop_back();
+        for (size_t idx = 1; idx < other._mutation_indices.size(); ++idx) {
+            _mutation_indices.push_back(mutation_offset + other._mutation_indices[idx]);
+        }
+        KASSERT(_mutation_indices.size() == _sites.size() + 2, "Mutation indices are inconsistent.");
+        KASSERT(_mutation_indices.back() == _mutations.size(), "Mutation index sentinel is broken.");
+    }
+
     [[nodiscard]] bool mutation_indices_are_built() const {
         return _mutation_indices_valid;
     }
@@ -159,6 +193,14 @@ public:
             );
     }
 
+    // Rename the node of each mutation from v to new_ids[v], e.g. after the nodes of the forest have been relabeled.
+    void relabel_nodes(std::span<NodeId const> const new_ids) {
+        for (Mutation& mutation: _mutations) {
+            KASSERT(mutation.node_id() < new_ids.size(), "Node ID out of bounds.", sfkit::assert::light);
+            mutation.node_id(new_ids[mutation.node_id()]);
+        }
+    }
+
     [[nodiscard]] std::unordered_set<NodeId> subtrees_with_mutations() const {
         std::unordered_set<NodeId> subtrees_with_mutations;
 
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
 #include <kassert/kassert.hpp>
 #include <tskit/core.h>
 
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/graph/TsToSfNodeMapper.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
+#include "sfkit/sequence/TSKitSiteToTreeMapper.hpp"
 #include "sfkit/tskit/tskit.hpp"
 
 namespace sfkit::sequence {
@@ -18,11 +25,79 @@ class GenomicSequenceFactory {
 public:
     // Rename storage to store?
     GenomicSequenceFactory(tskit::TSKitTreeSequence const& tree_sequence)
+        : GenomicSequenceFactory(tree_sequence, std::make_shared<TSKitSiteToTreeMapper const>(tree_sequence)) {}
+
+    // Reuse the site to tree mapping built for the same tree sequence, e.g. by another factory (see site_to_tree()).
+    GenomicSequenceFactory(
+        tskit::TSKitTreeSequence const& tree_sequence, std::shared_ptr<TSKitSiteToTreeMapper const> site_to_tree
+    )
         : _sequence(tree_sequence.num_sites(), tree_sequence.num_mutations()),
-          _site2tree(tree_sequence),
+          _site2tree(std::move(site_to_tree)),
           _mutation_it(tree_sequence.mutations().begin()),
           _mutations_end(tree_sequence.mutations().end()) {
-        _set_ancestral_states(tree_sequence);
+        KASSERT(_site2tree != nullptr, "No site to tree mapping given.", sfkit::assert::light);
+        KASSERT(
+            _site2tree->num_sites() == tree_sequence.num_sites(),
+            "The site to tree mapping belongs to another tree sequence.",
+            sfkit::assert::light
+        );
+        _set_ancestral_states(tree_sequence.sites());
+        KASSERT(
+            _sequence.num_sites() == tree_sequence.num_sites(),
+            "Number of sites reported by num_sites() and in the sites() iterator does not match",
+            sfkit::assert::light
+        );
+    }
+
+    // Process only the mutations of the trees [first_tree, end_tree) instead of all of the tree sequence. This is used
+    // to build the genomic sequence for a contiguous range of trees independently of the others; see append(). We
+    // store (and reserve memory for) only the sites and mutations of these trees. Such a factory cannot be finalized;
+    // append it to the factory for the preceding trees instead.
+    GenomicSequenceFactory(
+        tskit::TSKitTreeSequence const&              tree_sequence,
+        TreeId const                                 first_tree,
+        TreeId const                                 end_tree,
+        std::shared_ptr<TSKitSiteToTreeMapper const> site_to_tree = nullptr
+    )
+        : _site2tree(
+            site_to_tree ? std::move(site_to_tree) : std::make_shared<TSKitSiteToTreeMapper const>(tree_sequence)
+        ),
+          _mutation_it(tree_sequence.mutations().begin()),
+          _mutations_end(tree_sequence.mutations().end()) {
+        KASSERT(first_tree <= end_tree, "The range of trees is invalid.", sfkit::assert::light);
+        KASSERT(
+            _site2tree->num_sites() == tree_sequence.num_sites(),
+            "The site to tree mapping belongs to another tree sequence.",
+            sfkit::assert::light
+        );
+
+        // The sites are sorted by their position and thus by tree.
+        auto const& site_to_tree_ids = _site2tree->site_to_tree();
+        auto const  first_site_it    = std::lower_bound(site_to_tree_ids.begin(), site_to_tree_ids.end(), first_tree);
+        auto const  end_site_it      = std::lower_bound(first_site_it, site_to_tree_ids.end(), end_tree);
+        _first_site_id               = asserting_cast<SiteId>(first_site_it - site_to_tree_ids.begin());
+        SiteId const end_site_id     = asserting_cast<SiteId>(end_site_it - site_to_tree_ids.begin());
+
+        // The mutations are sorted by site and thus by tree, too.
+        _mutation_it = std::partition_point(_mutation_it, _mutations_end, [this, first_tree](auto const& mutation) {
+            return _site2tree->tree_id(mutation.site) < first_tree;
+        });
+        _mutations_end = std::partition_point(_mutation_it, _mutations_end, [this, end_tree](auto const& mutation) {
+            return _site2tree->tree_id(mutation.site) < end_tree;
+        });
+        _first_mutation_id = _mutation_id_or_end(_mutation_it, tree_sequence);
+        MutationId const end_mutation_id = _mutation_id_or_end(_mutations_end, tree_sequence);
+
+        _sequence = GenomicSequence(end_site_id - _first_site_id, end_mutation_id - _first_mutation_id);
+        _set_ancestral_states(tree_sequence.sites().subspan(
+            asserting_cast<size_t>(_first_site_id),
+            asserting_cast<size_t>(end_site_id - _first_site_id)
+        ));
+    }
+
+    // The mapping of the sites to the trees; it can be shared with other factories for the same tree sequence.
+    [[nodiscard]] std::shared_ptr<TSKitSiteToTreeMapper const> const& site_to_tree() const {
+        return _site2tree;
     }
 
     // Call this for all trees in order, make sure the the mutations are sorted by site.
@@ -37,7 +112,7 @@ public:
         while (_mutation_it != _mutations_end) {
             // TODO Use less bits for site and tree ids
             tsk_id_t const site_id       = _mutation_it->site;
-            TreeId const   sites_tree_id = _site2tree(site_id);
+            TreeId const   sites_tree_id = _site2tree->tree_id(site_id);
             KASSERT(
                 sites_tree_id >= tree_id,
                 "We seemed to have missed processing a mutation. Are the mutations sorted by tree id?",
@@ -53,18 +128,25 @@ public:
             KASSERT(_mutation_it->derived_state_length == 1u, "Derived state length is not 1", sfkit::assert::light);
 
             AllelicState const derived_state = *_mutation_it->derived_state;
-            tsk_id_t const     mutation_id   = asserting_cast<tsk_id_t>(_sequence.num_mutations());
+            tsk_id_t const mutation_id = asserting_cast<tsk_id_t>(_first_mutation_id + _sequence.num_mutations());
             KASSERT(
                 mutation_id == _mutation_it->id,
                 "Mutation ID is not equal to the index in the mutations vector",
                 sfkit::assert::light
             );
 
-            tsk_id_t const     parent_mutation_id = _mutation_it->parent;
+            // The parent mutation is at the same site and thus in the same tree, so it has already been processed.
+            tsk_id_t const parent_mutation_id = _mutation_it->parent;
+            KASSERT(
+                parent_mutation_id == TSK_NULL || asserting_cast<MutationId>(parent_mutation_id) >= _first_mutation_id,
+                "The parent mutation has not been processed by this factory.",
+                sfkit::assert::light
+            );
             AllelicState const ancestral_state =
                 parent_mutation_id == TSK_NULL
-                    ? _sequence.ancestral_state(asserting_cast<SiteId>(site_id))
-                    : _sequence.mutation_by_id(asserting_cast<MutationId>(parent_mutation_id)).allelic_state();
+                    ? _sequence.ancestral_state(asserting_cast<SiteId>(site_id) - _first_site_id)
+                    : _sequence.mutation_by_id(asserting_cast<MutationId>(parent_mutation_id) - _first_mutation_id)
+                          .allelic_state();
 
             _sequence.emplace_back(site_id, tree_id, sf_node_id, derived_state, ancestral_state);
             ++_mutation_it;
@@ -72,6 +154,32 @@ public:
         return true;
     }
 
+    // Append the mutations processed by a factory which started at a later tree (see the constructor above). The
+    // node ids of its mutations are translated using node_id_map. The other factory must continue exactly where this
+    // factory stopped.
+    void append(GenomicSequenceFactory const& other, std::vector<NodeId> const& node_id_map) {
+        KASSERT(!_finalized, "Storage has already been finalized", sfkit::assert::light);
+        KASSERT(
+            other._first_mutation_id == _first_mutation_id + _sequence.num_mutations(),
+            "The mutations to append do not continue the mutations processed so far.",
+            sfkit::assert::light
+        );
+
+        for (MutationId mutation_id = 0; mutation_id < other._sequence.num_mutations(); ++mutation_id) {
+            Mutation const& mutation = other._sequence.mutation_by_id(mutation_id);
+            KASSERT(mutation.node_id() < node_id_map.size(), "Node ID is not mapped.", sfkit::assert::light);
+            _sequence.emplace_back(
+                mutation.site_id(),
+                mutation.tree_id(),
+                node_id_map[mutation.node_id()],
+                mutation.allelic_state(),
+                mutation.parent_state()
+            );
+            KASSERT(_mutation_it != _mutations_end, "Appended more mutations than present.", sfkit::assert::light);
+            ++_mutation_it;
+        }
+    }
+
     GenomicSequence&& move_storage() {
         KASSERT(
             _finalized,
@@ -85,30 +193,38 @@ public:
 
     void finalize() {
         KASSERT(!_finalized, "Storage has already been finalized", sfkit::assert::light);
+        KASSERT(
+            _sequence.num_sites() == _site2tree->num_sites(),
+            "Only a factory for all trees can be finalized.",
+            sfkit::assert::light
+        );
         _finalized = true;
         _sequence.build_mutation_indices();
     }
 
 private:
-    GenomicSequence                  _sequence;
-    tskit::TskMutationView           _tsk_mutations;
-    TSKitSiteToTreeMapper            _site2tree;
-    tskit::TskMutationView::iterator _mutation_it;
-    tskit::TskMutationView::iterator _mutations_end;
-    bool                             _finalized = false;
-    bool                             _moved     = false;
-
-    void _set_ancestral_states(tskit::TSKitTreeSequence const& tree_sequence) {
+    GenomicSequence                              _sequence;
+    tskit::TskMutationView                       _tsk_mutations;
+    std::shared_ptr<TSKitSiteToTreeMapper const> _site2tree;
+    tskit::TskMutationView::iterator             _mutation_it;
+    tskit::TskMutationView::iterator             _mutations_end;
+    SiteId                                       _first_site_id     = 0;
+    MutationId                                   _first_mutation_id = 0;
+    bool                                         _finalized         = false;
+    bool                                         _moved             = false;
+
+    void _set_ancestral_states(std::span<tsk_site_t const> const sites) {
         // Store ancestral states
-        for (auto&& site: tree_sequence.sites()) {
+        for (auto&& site: sites) {
             KASSERT(site.ancestral_state_length == 1u, "Ancestral state length is not 1", sfkit::assert::light);
             _sequence.emplace_back(*site.ancestral_state);
         }
-        KASSERT(
-            _sequence.num_sites() == tree_sequence.num_sites(),
-            "Number of sites reported by num_sites() and in the sites() iterator does not match",
-            sfkit::assert::light
-        );
+    }
+
+    static MutationId
+    _mutation_id_or_end(tskit::TskMutationView::iterator const& it, tskit::TSKitTreeSequence const& tree_sequence) {
+        return it != tree_sequence.mutations().end() ? asserting_cast<MutationId>(it->id)
+                                                      : tree_sequence.num_mutations();
     }
 };
 } // namespace sfkit::sequence
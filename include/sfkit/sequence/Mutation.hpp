@@ -37,6 +37,14 @@ public:
         return _node_id;
     }
 
+    void node_id(NodeId const node_id) {
+        _node_id = node_id;
+    }
+
+    [[nodiscard]] TreeId tree_id() const {
+        return _tree_id;
+    }
+
     template <class Archive>
     void serialize(Archive& archive) {
         archive(_site_id, _derived_state, _tree_id, _node_id, _parent_state);
@@ -60,8 +68,7 @@ private:
     AllelicState _parent_state;
     AllelicState _derived_state;
     TreeId       _tree_id;
-    // TODO Directly encode the formula to compute the subtree size here. E.g. a bitmask of which samples ares below
-    // this node. (xor with sample set and then do a popcount)
+    // The samples below this node can be precomputed as a bitmap, see samples::DescendantBitmaps.
     NodeId _node_id;
 };
 
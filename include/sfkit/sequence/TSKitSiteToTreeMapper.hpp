@@ -1,12 +1,17 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <span>
 #include <vector>
 
 #include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/cereal.hpp>
 
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/graph/primitives.hpp"
+#include "sfkit/io/vector_serialization.hpp"
 #include "sfkit/sequence/Sequence.hpp"
 #include "sfkit/tskit/tskit.hpp"
 
@@ -14,79 +19,86 @@ namespace sfkit::sequence {
 
 using sfkit::graph::TreeId;
 
-// As the mutations are sorted by site, we can use a mapper wich does not rely on a search tree but only
-// checks of the next site passes the next breakpoint in the sorted list of breakpoints.
+// Maps each site to the tree it lies in. Both, the sites and the breakpoints between the trees, are sorted by their
+// position. We thus build the mapping in a single linear pass, merging the site position column of the site table with
+// the breakpoints and filling the range of sites of each tree at once. Looking up a tree is a single array access and
+// the sites can be requested in any order. The mapping can be shared by multiple GenomicSequenceFactories and stored
+// alongside a compressed forest.
 class TSKitSiteToTreeMapper {
 public:
-    struct Breakpoint {
-        Breakpoint(SiteId _site_id, TreeId _tree_id) noexcept : site_id(_site_id), tree_id(_tree_id) {}
-
-        SiteId site_id;
-        TreeId tree_id;
-    };
-    using breakpoint_iterator = std::vector<Breakpoint>::const_iterator;
-
-    struct State {
-        State(breakpoint_iterator _current_breakpoint, breakpoint_iterator _next_breakpoint)
-            : current_breakpoint(_current_breakpoint),
-              next_breakpoint(_next_breakpoint) {}
-
-        breakpoint_iterator current_breakpoint;
-        breakpoint_iterator next_breakpoint;
-    };
+    TSKitSiteToTreeMapper() = default;
 
     TSKitSiteToTreeMapper(tskit::TSKitTreeSequence const& tree_sequence) {
-        tsk_id_t const num_sites       = asserting_cast<tsk_id_t>(tree_sequence.num_sites());
-        size_t const   num_breakpoints = tree_sequence.breakpoints().size();
-
-        _breakpoints.reserve(num_breakpoints + 1);
-        SiteId site = 0;
-        TreeId tree = 0;
-        _breakpoints.emplace_back(site, tree);
+        std::span<double const> const positions   = tree_sequence.site_positions();
+        std::span<double const> const breakpoints = tree_sequence.breakpoints(); // The left end of each tree.
+        KASSERT(
+            std::is_sorted(positions.begin(), positions.end()),
+            "The sites are not sorted by their position.",
+            sfkit::assert::normal
+        );
 
-        for (auto breakpoint: tree_sequence.breakpoints()) {
-            while (site < num_sites && tree_sequence.position_of(site) < breakpoint) {
-                ++site;
+        _site_to_tree.resize(positions.size());
+        size_t site_begin = 0;
+        for (TreeId tree_id = 0; tree_id < breakpoints.size() && site_begin < positions.size(); ++tree_id) {
+            size_t site_end = positions.size();
+            if (tree_id + 1u < breakpoints.size()) {
+                double const right = breakpoints[tree_id + 1u];
+                site_end           = site_begin;
+                while (site_end < positions.size() && positions[site_end] < right) {
+                    ++site_end;
+                }
             }
-            _breakpoints.emplace_back(site, tree);
-            ++tree;
+            std::fill(
+                _site_to_tree.begin() + asserting_cast<std::ptrdiff_t>(site_begin),
+                _site_to_tree.begin() + asserting_cast<std::ptrdiff_t>(site_end),
+                tree_id
+            );
+            site_begin = site_end;
         }
-
-        _current_breakpoint = _breakpoints.begin();
-        _next_breakpoint    = _current_breakpoint + 1;
+        KASSERT(site_begin == positions.size(), "Not all sites have been mapped to a tree.", sfkit::assert::light);
     }
 
     TreeId tree_id(tsk_id_t site_id) const {
+        KASSERT(site_id >= 0, "Site ID is invalid.", sfkit::assert::light);
         KASSERT(
-            _current_breakpoint->site_id <= site_id,
-            "Are the site ids not requested in ascending order?",
+            asserting_cast<size_t>(site_id) < _site_to_tree.size(),
+            "Site ID is out of bounds.",
             sfkit::assert::light
         );
+        return _site_to_tree[asserting_cast<size_t>(site_id)];
+    }
 
-        while (_next_breakpoint != _breakpoints.end() && _next_breakpoint->site_id <= site_id) {
-            ++_next_breakpoint;
-            ++_current_breakpoint;
-        }
+    TreeId operator()(tsk_id_t site_id) const {
+        return tree_id(site_id);
+    }
+
+    [[nodiscard]] SiteId num_sites() const {
+        return asserting_cast<SiteId>(_site_to_tree.size());
+    }
+
+    // Indexed by site id.
+    [[nodiscard]] std::vector<TreeId> const& site_to_tree() const {
+        return _site_to_tree;
+    }
 
-        return _current_breakpoint->tree_id;
+    [[nodiscard]] bool operator==(TSKitSiteToTreeMapper const& other) const {
+        return _site_to_tree == other._site_to_tree;
     }
 
-    TreeId operator()(tsk_id_t position) const {
-        return tree_id(position);
+    template <class Archive>
+    void serialize(Archive& archive) {
+        archive(_site_to_tree);
     }
 
-    State state() const {
-        return State(_current_breakpoint, _next_breakpoint);
+    void save(std::ostream& os) const {
+        sfkit::io::utils::serialize(os, _site_to_tree);
     }
 
-    void reset_to(State state) {
-        _current_breakpoint = state.current_breakpoint;
-        _next_breakpoint    = state.next_breakpoint;
+    void load(std::istream& is) {
+        sfkit::io::utils::deserialize(is, _site_to_tree);
     }
 
 private:
-    std::vector<Breakpoint>     _breakpoints;
-    mutable breakpoint_iterator _current_breakpoint;
-    mutable breakpoint_iterator _next_breakpoint;
+    std::vector<TreeId> _site_to_tree;
 };
 } // namespace sfkit::sequence
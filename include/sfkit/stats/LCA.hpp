@@ -1,11 +1,13 @@
 #pragma once
 
 #include <array>
+#include <span>
 #include <vector>
 
 #include <kassert/kassert.hpp>
 
 #include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCSREdges.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/samples/NumSamplesBelow.hpp"
@@ -15,6 +17,7 @@
 
 namespace sfkit::stats {
 
+using sfkit::dag::DAGCSREdges;
 using sfkit::graph::EdgeListGraph;
 using sfkit::graph::NodeId;
 using sfkit::utils::asserting_cast;
@@ -27,6 +30,16 @@ public:
         KASSERT(_dag.num_nodes() >= _dag.num_leaves(), "DAG has less nodes than leaves.", sfkit::assert::light);
     }
 
+    // Sweep over the CSR encoding of the DAG's edges (see DAGCSREdges) instead; csr_edges has to be computed from dag.
+    DAGLowestCommonAncestor(EdgeListGraph const& dag, DAGCSREdges const& csr_edges) : DAGLowestCommonAncestor(dag) {
+        KASSERT(
+            csr_edges.num_edges() == _dag.num_edges(),
+            "The CSR edges do not belong to the DAG.",
+            sfkit::assert::light
+        );
+        _csr_edges = &csr_edges;
+    }
+
     [[nodiscard]] std::vector<NodeId> operator()(samples::SampleSet const& samples) const {
         return this->lca(samples);
     }
@@ -63,11 +76,7 @@ public:
         }
 
         // Compute the subtree sizes using a post-order traversal
-        auto edge_it = _dag.begin();
-        while (edge_it != _dag.end()) {
-            auto const& from = edge_it->from();
-            auto const& to   = edge_it->to();
-
+        auto const process_edge = [&](NodeId const from, NodeId const to) {
             if (subtree_sizes[from].lca != graph::INVALID_NODE_ID) {
                 // LCA already propagated to this `from` node via another edge.
                 KASSERT(subtree_sizes[from].samples_below == num_requested_samples);
@@ -87,29 +96,42 @@ public:
             }
 
             KASSERT(
-                (subtree_sizes[edge_it->from()].samples_below) <= samples.overall_num_samples(),
+                (subtree_sizes[from].samples_below) <= samples.overall_num_samples(),
                 "Number of samples below a node exceeds the number of samples in the tree sequence.",
                 sfkit::assert::light
             );
+        };
 
-            edge_it++;
+        if (_csr_edges != nullptr) {
+            _csr_edges->for_each_parent([&](NodeId const parent, std::span<NodeId const> const children) {
+                for (NodeId const child: children) {
+                    process_edge(parent, child);
+                }
+            });
+        } else {
+            for (auto const& edge: _dag) {
+                process_edge(edge.from(), edge.to());
+            }
         }
 
-        // Collect the per-tree LCAs
+        // Collect the per-tree LCAs. Consecutive identical trees share their root; we look at each root only once.
         lcas.reserve(_dag.num_trees());
-        for (auto const root: _dag.roots()) {
+        for (size_t root_idx = 0; root_idx < _dag.roots().size(); ++root_idx) {
+            auto const root = _dag.roots()[root_idx];
             KASSERT(
                 subtree_sizes[root].samples_below == samples.popcount(),
                 "Number of samples below the root node does not match the number of samples in the sample set.",
                 sfkit::assert::light
             );
-            lcas.push_back(subtree_sizes[root].lca);
+            lcas.insert(lcas.end(), _dag.root_run_length(root_idx), subtree_sizes[root].lca);
         }
+        KASSERT(lcas.size() == _dag.num_trees(), "Not exactly one LCA per tree.", sfkit::assert::light);
         return lcas;
     }
 
 private:
-    EdgeListGraph const& _dag; // As a post-order sorted edge list
+    EdgeListGraph const& _dag;                 // As a post-order sorted edge list
+    DAGCSREdges const*   _csr_edges = nullptr; // The same edges in CSR encoding, if given
 
     struct lca_interm {
         NodeId samples_below;
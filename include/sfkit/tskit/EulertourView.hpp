@@ -6,9 +6,11 @@ namespace sfkit::tskit {
 
 class TSKitTreeSequence;
 
+// Visits each inner node twice (on the way down and on the way up) and each sample once. The tour starts and ends at
+// the given root, which might be tskit's virtual root if the tree has multiple roots (see TSKitTree::root()).
 class EulertourView {
 public:
-    EulertourView(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence);
+    EulertourView(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence, tsk_id_t const root);
 
     class iterator {
     public:
@@ -19,7 +21,7 @@ public:
         using reference         = value_type&;
         struct sentinel {};
 
-        iterator(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence);
+        iterator(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence, tsk_id_t const root);
         iterator&               operator++();
         iterator                operator++(int);
         [[nodiscard]] bool      operator==(iterator const& other) const;
@@ -30,10 +32,12 @@ public:
         [[nodiscard]] bool      first_visit();
         [[nodiscard]] bool      second_visit();
         [[nodiscard]] bool      is_sample();
+        void                    skip_subtree();
         [[nodiscard]] pointer   operator->();
 
     private:
         tsk_tree_t const&        _tree;
+        tsk_id_t                 _root;
         tsk_id_t                 _current_node;
         bool                     _just_moved_up;
         TSKitTreeSequence const& _tree_sequence;
@@ -45,6 +49,7 @@ public:
 private:
     tsk_tree_t const&        _tree;
     TSKitTreeSequence const& _tree_sequence;
+    tsk_id_t                 _root;
 };
 
 } // namespace sfkit::tskit
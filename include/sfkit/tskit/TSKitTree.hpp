@@ -4,12 +4,12 @@
 #include <cstdint>
 #include <ranges>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <tskit/trees.h>
 
 #include "sfkit/graph/primitives.hpp"
-#include "sfkit/include-redirects/hopscotch_set.hpp"
 #include "sfkit/samples/SampleSet.hpp"
 #include "sfkit/samples/primitives.hpp"
 #include "sfkit/sequence/Mutation.hpp"
@@ -38,17 +38,21 @@ public:
     ~TSKitTree();
     bool first();
     bool next();
+    bool seek_index(tsk_id_t const tree_id);
 
     [[nodiscard]] bool is_valid() const;
     [[nodiscard]] bool is_tree() const;
     [[nodiscard]] bool is_null() const;
 
     [[nodiscard]] tsk_id_t    tree_id() const;
+    [[nodiscard]] double      left() const;
+    [[nodiscard]] double      right() const;
     [[nodiscard]] std::size_t num_roots() const;
     [[nodiscard]] std::size_t num_samples() const;
     [[nodiscard]] tsk_id_t    num_children(tsk_id_t node) const;
     [[nodiscard]] std::size_t max_node_id() const;
     [[nodiscard]] tsk_id_t    root() const;
+    [[nodiscard]] tsk_id_t    virtual_root() const;
     [[nodiscard]] bool        is_root(tsk_id_t const node) const;
     [[nodiscard]] bool        is_sample(tsk_id_t node) const;
     [[nodiscard]] NodeId      lca(tsk_id_t const u, tsk_id_t const v);
@@ -59,11 +63,16 @@ public:
     [[nodiscard]] Children children(tsk_id_t const parent);
     [[nodiscard]] tsk_id_t parent(tsk_id_t const node) const;
 
-    tsl::hopscotch_set<tsk_id_t> invalidated_nodes() const;
+    [[nodiscard]] std::span<tsk_id_t const> invalidated_nodes();
+    [[nodiscard]] bool                      is_invalidated(tsk_id_t const node) const;
+    [[nodiscard]] size_t                    num_invalidated_nodes() const;
+    [[nodiscard]] std::span<tsk_id_t>       invalidated_postorder();
+    [[nodiscard]] bool                      edge_diff_is_empty();
 
 private:
     [[nodiscard]] size_t _current_tree_size_bound() const;
     void                 _postorder_nodes_resize();
+    void                 _next_epoch();
     // TODO Create a variadic templated _create_tsk_sample_sets and use it in the functions above.
 
     TSKitTreeSequence&    _tree_sequence;
@@ -72,6 +81,18 @@ private:
     tsk_id_t              _tree_id;
     int                   _state = -1;
     std::vector<tsk_id_t> _postorder_nodes;
+    std::vector<tsk_id_t> _invalidated_postorder_nodes;
+    std::vector<tsk_id_t> _node_stack;
+
+    // A node is invalidated iff its entry equals the current epoch. This way, we don't have to clear the marks when
+    // advancing to the next tree.
+    std::vector<uint32_t> _invalidated_epochs;
+    uint32_t              _epoch = 1;
+    std::vector<tsk_id_t> _invalidated_nodes;
+
+    // The (parent, child) pairs of the edges removed and inserted when moving to the current tree.
+    std::vector<std::pair<tsk_id_t, tsk_id_t>> _edges_out;
+    std::vector<std::pair<tsk_id_t, tsk_id_t>> _edges_in;
 };
 
 } // namespace sfkit::tskit
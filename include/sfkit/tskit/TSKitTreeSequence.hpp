@@ -78,6 +78,9 @@ public:
     [[nodiscard]] std::span<tsk_site_t const>   sites() const;
     [[nodiscard]] std::span<double const> const breakpoints() const;
 
+    // The position column of the site table, i.e. the positions of all sites in ascending order.
+    [[nodiscard]] std::span<double const> site_positions() const;
+
     [[nodiscard]] double position_of(tsk_id_t site_id) const;
 
 private:
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+
+namespace sfkit::utils {
+
+// An append-only sequence storing its elements in chunks of fixed size. Growing it never relocates elements; in
+// contrast to std::vector, we thus never need the memory for both, the old and the new buffer, at the same time. The
+// elements are handed out chunk by chunk by drain(), which releases each chunk once it has been consumed.
+template <typename T, size_t ChunkSize = (size_t{1} << 20) / sizeof(T)>
+class ChunkedVector {
+public:
+    static_assert(ChunkSize > 0, "The chunks have to hold at least one element.");
+
+    void push_back(T const& value) {
+        if (_size == _chunks.size() * ChunkSize) [[unlikely]] {
+            _chunks.emplace_back(std::make_unique_for_overwrite<T[]>(ChunkSize));
+        }
+        _chunks.back()[_size % ChunkSize] = value;
+        ++_size;
+    }
+
+    template <class... Args>
+    void emplace_back(Args&&... args) {
+        push_back(T(std::forward<Args>(args)...));
+    }
+
+    [[nodiscard]] T const& operator[](size_t const idx) const {
+        KASSERT(idx < _size, "Index out of bounds.", sfkit::assert::light);
+        return _chunks[idx / ChunkSize][idx % ChunkSize];
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _size;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _size == 0;
+    }
+
+    [[nodiscard]] static constexpr size_t chunk_size() {
+        return ChunkSize;
+    }
+
+    // The memory allocated for the elements.
+    [[nodiscard]] size_t memory_usage() const {
+        return _chunks.size() * ChunkSize * sizeof(T);
+    }
+
+    // Pass the elements to consume(std::span<T const>), one chunk at a time and in the order of insertion. Each chunk
+    // is freed right after it has been consumed; the vector is empty afterwards.
+    template <typename Consumer>
+    void drain(Consumer&& consume) {
+        for (size_t chunk = 0; chunk < _chunks.size(); ++chunk) {
+            size_t const begin = chunk * ChunkSize;
+            size_t const end   = std::min(begin + ChunkSize, _size);
+            consume(std::span<T const>(_chunks[chunk].get(), end - begin));
+            _chunks[chunk].reset();
+        }
+        clear();
+    }
+
+    void clear() {
+        _chunks.clear();
+        _chunks.shrink_to_fit();
+        _size = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<T[]>> _chunks;
+    size_t                            _size = 0;
+};
+
+} // namespace sfkit::utils
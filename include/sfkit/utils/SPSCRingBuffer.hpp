@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+
+namespace sfkit::utils {
+
+// A bounded, lock-free ring buffer for exactly one producer and one consumer thread. The elements are constructed once
+// and then reused, i.e. the producer fills the next free slot in place and the consumer reads it in place. Containers
+// inside the elements thus keep their capacity and we do not allocate memory in steady state.
+//
+// Producer: slot = try_writable_slot(); fill *slot; commit_write();
+// Consumer: slot = try_readable_slot(); read *slot; release_read();
+template <typename T>
+class SPSCRingBuffer {
+public:
+    // The capacity is rounded up to the next power of two.
+    SPSCRingBuffer(size_t const capacity) : _slots(std::bit_ceil(capacity)), _mask(_slots.size() - 1) {
+        KASSERT(capacity > 0u, "The capacity of the ring buffer has to be positive.", sfkit::assert::light);
+    }
+
+    // Returns the next free slot or nullptr if the buffer is full. Must only be called by the producer.
+    [[nodiscard]] T* try_writable_slot() {
+        size_t const tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cached_head == _slots.size()) {
+            _cached_head = _head.load(std::memory_order_acquire);
+            if (tail - _cached_head == _slots.size()) {
+                return nullptr;
+            }
+        }
+        return &_slots[tail & _mask];
+    }
+
+    // Hands the slot returned by the last call to try_writable_slot() to the consumer.
+    void commit_write() {
+        size_t const tail = _tail.load(std::memory_order_relaxed);
+        KASSERT(tail - _head.load(std::memory_order_relaxed) < _slots.size(), "The ring buffer is full.");
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+
+    // Returns the oldest filled slot or nullptr if the buffer is empty. Must only be called by the consumer.
+    [[nodiscard]] T* try_readable_slot() {
+        size_t const head = _head.load(std::memory_order_relaxed);
+        if (head == _cached_tail) {
+            _cached_tail = _tail.load(std::memory_order_acquire);
+            if (head == _cached_tail) {
+                return nullptr;
+            }
+        }
+        return &_slots[head & _mask];
+    }
+
+    // Hands the slot returned by the last call to try_readable_slot() back to the producer.
+    void release_read() {
+        size_t const head = _head.load(std::memory_order_relaxed);
+        KASSERT(head != _tail.load(std::memory_order_relaxed), "The ring buffer is empty.");
+        _head.store(head + 1, std::memory_order_release);
+    }
+
+    [[nodiscard]] size_t capacity() const {
+        return _slots.size();
+    }
+
+private:
+    static constexpr size_t cache_line_size = 64;
+
+    std::vector<T> _slots;
+    size_t const   _mask;
+
+    // The indices grow monotonically and are mapped to the slots using the mask. The producer and the consumer each
+    // keep a cached copy of the other's index, in order to not touch the other's cache line on every operation.
+    alignas(cache_line_size) std::atomic<size_t> _head = 0;
+    size_t _cached_tail                                = 0; // Consumer only
+    alignas(cache_line_size) std::atomic<size_t> _tail = 0;
+    size_t _cached_head                                = 0; // Producer only
+};
+
+} // namespace sfkit::utils
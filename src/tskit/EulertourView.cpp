@@ -7,40 +7,44 @@
 
 namespace sfkit::tskit {
 
-EulertourView::EulertourView(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence)
+EulertourView::EulertourView(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence, tsk_id_t const root)
     : _tree(tree),
-      _tree_sequence(tree_sequence) {}
+      _tree_sequence(tree_sequence),
+      _root(root) {}
 
-EulertourView::iterator::iterator(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence)
+EulertourView::iterator::iterator(tsk_tree_t const& tree, TSKitTreeSequence const& tree_sequence, tsk_id_t const root)
     : _tree(tree),
+      _root(root),
+      _current_node(root),
       _just_moved_up(false),
       _tree_sequence(tree_sequence) {
     KASSERT(_tree.virtual_root != TSK_NULL, "The virtual root of the tree does not exist.", sfkit::assert::light);
+    KASSERT(_root != TSK_NULL, "The root of the tree does not exist.", sfkit::assert::light);
     KASSERT(
-        _tree.right_child[_tree.virtual_root] != TSK_NULL,
-        "The virtual root of the tree has no children.",
+        _root == _tree.virtual_root || _tree.parent[_root] == TSK_NULL,
+        "The Euler tour has to start at a root of the tree.",
         sfkit::assert::light
     );
-    KASSERT(
-        _tree.left_child[_tree.virtual_root] == _tree.right_child[_tree.virtual_root],
-        "The virtual root of the tree has more than one child.",
-        sfkit::assert::light
-    );
-    _current_node = _tree.left_child[_tree.virtual_root];
 }
 
 EulertourView::iterator& EulertourView::iterator::operator++() {
     if (_just_moved_up || is_sample()) {
         // The children of this node were already processed OR there are no children because the current
         // node is a sample node.
-        if (_tree.right_sib[_current_node] != TSK_NULL) {
+        if (_current_node == _root) {
+            // We are back at the root -> the tour is complete.
+            _current_node  = TSK_NULL;
+            _just_moved_up = true;
+        } else if (_tree.right_sib[_current_node] != TSK_NULL) {
             // Move to the next unprocessed sibling of this node.
             _current_node  = _tree.right_sib[_current_node];
             _just_moved_up = false;
         } else {
-            // There are no more siblings of this node -> move up.
-            _current_node  = _tree.parent[_current_node];
-            _just_moved_up = true;
+            // There are no more siblings of this node -> move up. The roots of the tree have no parent in tskit; if
+            // we started at the virtual root, we return to it.
+            tsk_id_t const parent = _tree.parent[_current_node];
+            _current_node         = parent != TSK_NULL ? parent : _tree.virtual_root;
+            _just_moved_up        = true;
         }
     } else {
         // We just moved down or right (to a sibling), the children of this node are not processed yet
@@ -91,13 +95,20 @@ bool EulertourView::iterator::is_sample() {
     return _tree_sequence.is_sample(_current_node);
 }
 
+// Continue as if we already visited all nodes below the current node, i.e. the next increment moves to the next
+// sibling or the parent of the current node.
+void EulertourView::iterator::skip_subtree() {
+    KASSERT(first_visit(), "We can skip a subtree only on our first visit of it.", sfkit::assert::light);
+    _just_moved_up = true;
+}
+
 EulertourView::iterator::pointer EulertourView::iterator::operator->() {
     KASSERT(_current_node != TSK_NULL);
     return &_current_node;
 }
 
 EulertourView::iterator EulertourView::begin() const {
-    return iterator{_tree, _tree_sequence};
+    return iterator{_tree, _tree_sequence, _root};
 }
 
 EulertourView::iterator::sentinel EulertourView::end() const {
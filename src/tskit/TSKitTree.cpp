@@ -4,14 +4,15 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <ranges>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
 #include <kassert/kassert.hpp>
 
 #include "sfkit/assertion_levels.hpp"
-#include "sfkit/include-redirects/hopscotch_set.hpp"
 #include "sfkit/tskit/ChangedNodesView.hpp"
 #include "sfkit/tskit/ChildrenView.hpp"
 #include "sfkit/tskit/EulertourView.hpp"
@@ -29,6 +30,9 @@ TSKitTree::TSKitTree(TSKitTreeSequence& tree_sequence) : _tree_sequence(tree_seq
     ret = tsk_tree_position_init(&_tree_pos, &_tree_sequence.underlying(), 0);
     KASSERT(ret == 0, "Failed to initialize the tree position.", sfkit::assert::light);
 
+    // Also reserve a mark for tskit's virtual root, which has the node id max_node_id().
+    _invalidated_epochs.resize(max_node_id() + 1, 0);
+
     // Load the first tree
     first();
 }
@@ -76,10 +80,40 @@ bool TSKitTree::next() {
     return is_tree();
 }
 
+// Jump directly to the tree with the given index, e.g. to start processing in the middle of the tree sequence. The
+// in/out edges of the tree position afterwards describe the transition from tree_id - 1 to tree_id.
+bool TSKitTree::seek_index(tsk_id_t const tree_id) {
+    KASSERT(tree_id >= 0, "The tree index is negative.", sfkit::assert::light);
+    first();
+    if (tree_id == 0) {
+        return is_tree();
+    }
+
+    int const ret = tsk_tree_seek_index(&_tree, tree_id, 0);
+    KASSERT(ret == 0, "Failed to seek to the requested tree.", sfkit::assert::light);
+    _state   = ret == 0 ? TSK_TREE_OK : ret;
+    _tree_id = tree_id;
+
+    while (_tree_pos.index < tree_id) {
+        tsk_tree_position_next(&_tree_pos);
+    }
+    KASSERT(_tree_pos.index == _tree.index, "Tree and tree position are out of sync.", sfkit::assert::light);
+
+    return is_tree();
+}
+
 tsk_id_t TSKitTree::tree_id() const {
     return _tree_id;
 }
 
+double TSKitTree::left() const {
+    return _tree.interval.left;
+}
+
+double TSKitTree::right() const {
+    return _tree.interval.right;
+}
+
 bool TSKitTree::is_valid() const {
     return is_tree() || is_null();
 }
@@ -117,17 +151,19 @@ tsk_id_t TSKitTree::num_children(tsk_id_t node) const {
     return _tree.num_children[node];
 }
 
+// If the tree has a single root, this is the root. Otherwise -- e.g. if the samples did not coalesce or in the regions
+// not covered by any edge, where each sample is a root on its own -- this is tskit's virtual root, whose children are
+// the roots of the tree. This way, each tree has exactly one root and no special handling is required by the callers.
 tsk_id_t TSKitTree::root() const {
     KASSERT(is_valid(), "The tree is not valid.", sfkit::assert::light);
-    KASSERT(
-        tsk_tree_get_num_roots(&_tree) == 1ul,
-        "The tskit tree has more than one root. We do not support this yet."
-    );
     KASSERT(_tree.virtual_root != TSK_NULL);
-    KASSERT(_tree.right_child[_tree.virtual_root] != TSK_NULL);
-    KASSERT(_tree.left_child[_tree.virtual_root] == _tree.right_child[_tree.virtual_root]);
-    KASSERT(num_children(_tree.virtual_root) == 1);
-    return _tree.right_child[_tree.virtual_root];
+    KASSERT(_tree.left_child[_tree.virtual_root] != TSK_NULL, "The tree has no root.", sfkit::assert::light);
+    tsk_id_t const first_root = _tree.left_child[_tree.virtual_root];
+    return _tree.right_sib[first_root] == TSK_NULL ? first_root : _tree.virtual_root;
+}
+
+tsk_id_t TSKitTree::virtual_root() const {
+    return _tree.virtual_root;
 }
 
 bool TSKitTree::is_root(tsk_id_t const node) const {
@@ -141,7 +177,8 @@ std::span<tsk_id_t> TSKitTree::postorder() {
     int        ret;
     tsk_size_t num_nodes;
     _postorder_nodes_resize();
-    ret = tsk_tree_postorder(&_tree, _postorder_nodes.data(), &num_nodes);
+    // Starting at the virtual root includes it in the traversal; tsk_tree_postorder() would omit it.
+    ret = tsk_tree_postorder_from(&_tree, root(), _postorder_nodes.data(), &num_nodes);
     KASSERT(ret == 0, "Failed to get the postorder traversal of the tree.", sfkit::assert::light);
     KASSERT(
         num_nodes <= _postorder_nodes.size(),
@@ -151,56 +188,130 @@ std::span<tsk_id_t> TSKitTree::postorder() {
     return std::span{_postorder_nodes}.subspan(0, num_nodes);
 }
 
-tsl::hopscotch_set<tsk_id_t> TSKitTree::invalidated_nodes() const {
-    tsl::hopscotch_set<tsk_id_t> changed_nodes;
-
-    tsk_id_t const*       in_it   = _tree_pos.in.order + _tree_pos.in.start;
-    tsk_id_t const* const in_end  = _tree_pos.in.order + _tree_pos.in.stop;
-    tsk_id_t const*       out_it  = _tree_pos.out.order + _tree_pos.out.start;
-    tsk_id_t const* const out_end = _tree_pos.out.order + _tree_pos.out.stop;
+// The nodes whose subtree changed compared to the previous tree: the parents of all inserted or removed edges and
+// their ancestors. Some of these nodes might no longer be part of the current tree. We mark the nodes in a flat array
+// instead of inserting them into a hash set and reuse all buffers across trees, so this does not allocate memory in
+// the steady state.
+std::span<tsk_id_t const> TSKitTree::invalidated_nodes() {
+    _next_epoch();
+    _invalidated_nodes.clear();
+
+    auto const mark_invalidated = [this](tsk_id_t const node) {
+        if (!is_invalidated(node)) {
+            _invalidated_epochs[asserting_cast<size_t>(node)] = _epoch;
+            _invalidated_nodes.push_back(node);
+        }
+    };
 
+    tsk_id_t const* const edge_parents = _tree_pos.tree_sequence->tables->edges.parent;
     for (auto idx = _tree_pos.out.start; idx < _tree_pos.out.stop; ++idx) {
-        auto const e      = _tree_pos.out.order[idx];
-        auto const parent = _tree_pos.tree_sequence->tables->edges.parent[e];
-        changed_nodes.insert(parent);
+        mark_invalidated(edge_parents[_tree_pos.out.order[idx]]);
     }
 
     for (auto idx = _tree_pos.in.start; idx < _tree_pos.in.stop; ++idx) {
-        auto const e      = _tree_pos.in.order[idx];
-        auto const parent = _tree_pos.tree_sequence->tables->edges.parent[e];
-        changed_nodes.insert(parent);
+        mark_invalidated(edge_parents[_tree_pos.in.order[idx]]);
     }
 
     // TODO Assert there are no leaves
 
-    // Propagate the 'changed' tag upwards the tree
-    std::vector<tsk_id_t> queue;
-    queue.reserve(_tree.num_nodes);
-    std::copy(changed_nodes.begin(), changed_nodes.end(), std::back_inserter(queue));
-
-    auto node_it = queue.begin();
-    while (node_it != queue.end()) {
-        auto const node   = *node_it;
-        auto const parent = _tree.parent[node];
-
-        if (parent != TSK_NULL && !changed_nodes.contains(parent)) {
-            KASSERT(
-                queue.capacity() > queue.size() + 1,
-                "The queue would need to be resized, resulting in iterator invalidation.",
-                sfkit::assert::light
-            );
-            queue.push_back(parent);
-            changed_nodes.insert(parent);
+    // The virtual root is never the parent of an edge, but its children -- the roots of the tree -- might have changed.
+    // We thus always visit it if it is the root of this tree.
+    if (root() == _tree.virtual_root) {
+        mark_invalidated(_tree.virtual_root);
+    }
+
+    // Propagate the 'changed' tag upwards the tree. The list of invalidated nodes doubles as the queue. We can stop
+    // at nodes which are already invalidated, as their ancestors are (or will be) invalidated, too.
+    for (size_t idx = 0; idx < _invalidated_nodes.size(); ++idx) {
+        auto const parent = _tree.parent[_invalidated_nodes[idx]];
+        if (parent != TSK_NULL) {
+            mark_invalidated(parent);
         }
+    }
+
+    return std::span{_invalidated_nodes};
+}
+
+bool TSKitTree::is_invalidated(tsk_id_t const node) const {
+    KASSERT(asserting_cast<size_t>(node) < _invalidated_epochs.size(), "The node is not valid.", sfkit::assert::light);
+    return _invalidated_epochs[asserting_cast<size_t>(node)] == _epoch;
+}
 
-        ++node_it;
+// The number of nodes found by the last call to invalidated_nodes() or invalidated_postorder().
+size_t TSKitTree::num_invalidated_nodes() const {
+    return _invalidated_nodes.size();
+}
+
+// The root and the nodes of this tree whose subtree changed compared to the previous tree in postorder. As the
+// invalidated nodes are closed under taking the parent, this is the postorder of the tree restricted to these nodes.
+// In contrast to filtering postorder(), we descend only into invalidated subtrees; thus, the running time depends
+// only on the size of the edit between the two trees (and the degree of the invalidated nodes) but not on the size of
+// the tree.
+std::span<tsk_id_t> TSKitTree::invalidated_postorder() {
+    // Updates the marks used by is_invalidated().
+    std::ignore = invalidated_nodes();
+
+    _invalidated_postorder_nodes.clear();
+    _node_stack.clear();
+    _node_stack.push_back(root());
+
+    // Same scheme as tsk_tree_postorder(), but skipping all subtrees which did not change. If we popped a child of
+    // the node on top of the stack last, all of its (invalidated) children have been processed.
+    tsk_id_t postorder_parent = TSK_NULL;
+    while (!_node_stack.empty()) {
+        tsk_id_t const node       = _node_stack.back();
+        bool           descending = false;
+        if (node != postorder_parent) {
+            // Push the children right to left so we visit them left to right.
+            for (tsk_id_t child = _tree.right_child[node]; child != TSK_NULL; child = _tree.left_sib[child]) {
+                if (is_invalidated(child)) {
+                    _node_stack.push_back(child);
+                    descending = true;
+                }
+            }
+        }
+
+        if (!descending) {
+            _node_stack.pop_back();
+            // The roots of a tree with multiple roots have no parent in tskit; we started at the virtual root, though.
+            tsk_id_t const parent = _tree.parent[node];
+            postorder_parent      = parent != TSK_NULL ? parent : _tree.virtual_root;
+            _invalidated_postorder_nodes.push_back(node);
+        }
     }
 
-    return changed_nodes;
+    return std::span{_invalidated_postorder_nodes};
+}
+
+// Moving to this tree removed exactly the edges (parent -> child) it inserted; the tree is thus identical to the
+// previous one. This happens where an edge ends and an equivalent one starts, e.g. in unsimplified or inferred tree
+// sequences. The running time depends only on the number of edges changed and is thus much cheaper than computing the
+// invalidated nodes.
+bool TSKitTree::edge_diff_is_empty() {
+    KASSERT(is_tree(), "The tree is not valid.", sfkit::assert::light);
+    auto const num_out = _tree_pos.out.stop - _tree_pos.out.start;
+    auto const num_in  = _tree_pos.in.stop - _tree_pos.in.start;
+    if (num_out != num_in) {
+        return false;
+    }
+
+    tsk_edge_table_t const& edges = _tree_pos.tree_sequence->tables->edges;
+
+    auto const collect_edges = [&edges](std::vector<std::pair<tsk_id_t, tsk_id_t>>& diff, auto const& range) {
+        diff.clear();
+        for (auto idx = range.start; idx < range.stop; ++idx) {
+            tsk_id_t const edge = range.order[idx];
+            diff.emplace_back(edges.parent[edge], edges.child[edge]);
+        }
+        std::sort(diff.begin(), diff.end());
+    };
+    collect_edges(_edges_out, _tree_pos.out);
+    collect_edges(_edges_in, _tree_pos.in);
+    return _edges_out == _edges_in;
 }
 
 EulertourView TSKitTree::eulertour() const {
-    return EulertourView{_tree, _tree_sequence};
+    return EulertourView{_tree, _tree_sequence, root()};
 }
 
 Children TSKitTree::children(tsk_id_t const parent) {
@@ -213,6 +324,15 @@ tsk_id_t TSKitTree::parent(tsk_id_t const node) const {
     return _tree.parent[node];
 }
 
+// Invalidate all marks set so far.
+void TSKitTree::_next_epoch() {
+    if (_epoch == std::numeric_limits<decltype(_epoch)>::max()) [[unlikely]] {
+        std::fill(_invalidated_epochs.begin(), _invalidated_epochs.end(), 0);
+        _epoch = 0;
+    }
+    ++_epoch;
+}
+
 size_t TSKitTree::_current_tree_size_bound() const {
     return tsk_tree_get_size_bound(&_tree);
 }
@@ -414,6 +414,11 @@ std::span<double const> const TSKitTreeSequence::breakpoints() const {
     return std::span(breakpoints_ptr, num_trees());
 }
 
+std::span<double const> TSKitTreeSequence::site_positions() const {
+    tsk_site_table_t const& sites = _tree_sequence.tables->sites;
+    return std::span(sites.position, asserting_cast<size_t>(sites.num_rows));
+}
+
 double TSKitTreeSequence::position_of(tsk_id_t site_id) const {
     tsk_site_t ts_site;
     tsk_treeseq_get_site(&_tree_sequence, site_id, &ts_site);
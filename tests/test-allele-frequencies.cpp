@@ -1,3 +1,4 @@
+#include <array>
 #include <vector>
 
 #include <catch2/catch_test_macros.hpp>
@@ -232,5 +233,46 @@ TEST_CASE("AlleleFrequencies single-sample sample sets", "[AlleleFrequencies]")
         }
     );
 
+    // All four sample sets at once, using a runtime number of sample sets.
+    auto const freqs = forest.allele_frequencies(std::vector<SampleSet>{sample_0, sample_1, sample_2, sample_3});
+    std::array<std::vector<AlleleFrequency> const*, 4> const expected =
+        {&expected_0, &expected_1, &expected_2, &expected_3};
+    REQUIRE(freqs.size() == expected.size());
+    for (size_t set = 0; set < freqs.size(); ++set) {
+        idx = 0;
+        freqs[set].visit(
+            [&expected, set, &idx](auto&& state) {
+                CHECK(state == std::get<BiallelicFrequency>((*expected[set])[idx]));
+                idx++;
+            },
+            [&expected, set, &idx](auto&& state) {
+                CHECK(state == std::get<MultiallelicFrequency>((*expected[set])[idx]));
+                idx++;
+            }
+        );
+        CHECK(idx == expected[set]->size());
+    }
+
+    // Using the bitmaps of the samples below each mutation instead of traversing the DAG.
+    forest.build_descendant_bitmaps();
+    REQUIRE(forest.descendant_bitmaps_are_built());
+    std::array const sample_sets = {sample_0, sample_1, sample_2, sample_3};
+    for (size_t set = 0; set < sample_sets.size(); ++set) {
+        auto const freqs_from_bitmaps = forest.allele_frequencies_from_bitmaps(sample_sets[set]);
+        CHECK(freqs_from_bitmaps.num_samples_in_sample_set() == 1);
+        idx = 0;
+        freqs_from_bitmaps.visit(
+            [&expected, set, &idx](auto&& state) {
+                CHECK(state == std::get<BiallelicFrequency>((*expected[set])[idx]));
+                idx++;
+            },
+            [&expected, set, &idx](auto&& state) {
+                CHECK(state == std::get<MultiallelicFrequency>((*expected[set])[idx]));
+                idx++;
+            }
+        );
+        CHECK(idx == expected[set]->size());
+    }
+
     tsk_treeseq_free(&tskit_tree_sequence);
 }
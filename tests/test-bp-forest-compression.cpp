@@ -15,6 +15,8 @@
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/primitives.hpp"
 #include "sfkit/samples/NumSamplesBelowFactory.hpp"
+#include "sfkit/sequence/GenomicSequence.hpp"
+#include "sfkit/sequence/GenomicSequenceFactory.hpp"
 #include "sfkit/utils/concepts.hpp"
 #include "tskit-testlib/testlib.hpp"
 
@@ -26,6 +28,9 @@ using sfkit::dag::DAGCompressedForest;
 using sfkit::dag::DAGForestCompressor;
 using sfkit::samples::NumSamplesBelowFactory;
 using sfkit::samples::SampleSet;
+using sfkit::sequence::GenomicSequence;
+using sfkit::sequence::GenomicSequenceFactory;
+using sfkit::sequence::MutationId;
 using sfkit::tskit::TSKitTree;
 using sfkit::tskit::TSKitTreeSequence;
 
@@ -476,3 +481,177 @@ TEST_CASE("Compare BP-based compression to reference implementation", "[BPForest
     //     }
     // }
 }
+
+TEST_CASE("Joint BP and DAG compression", "[BPForestCompresion]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    BPForestCompressor     bp_forest_compressor(tree_sequence);
+    GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    BPCompressedForest     bp_forest   = bp_forest_compressor.compress(bp_sequence_factory);
+    GenomicSequence        bp_sequence = bp_sequence_factory.move_storage();
+
+    DAGForestCompressor    dag_forest_compressor(tree_sequence);
+    GenomicSequenceFactory dag_sequence_factory(tree_sequence);
+    DAGCompressedForest    dag_forest = dag_forest_compressor.compress(dag_sequence_factory);
+
+    BPForestCompressor     joint_forest_compressor(tree_sequence);
+    GenomicSequenceFactory joint_sequence_factory(tree_sequence);
+    auto [joint_bp_forest, joint_dag_forest] = joint_forest_compressor.compress_with_dag(joint_sequence_factory);
+    GenomicSequence joint_sequence           = joint_sequence_factory.move_storage();
+
+    // The BP-compressed forest and the genomic sequence are exactly the ones of the BP-only compression.
+    CHECK(joint_bp_forest == bp_forest);
+    REQUIRE(joint_sequence.num_sites() == bp_sequence.num_sites());
+    REQUIRE(joint_sequence.num_mutations() == bp_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < bp_sequence.num_mutations(); ++mutation_id) {
+        CHECK(joint_sequence.mutation_by_id(mutation_id) == bp_sequence.mutation_by_id(mutation_id));
+    }
+
+    // The DAG-compressed forest has the same shape as the one of the DAG-only compression, only duplicate roots are
+    // numbered differently.
+    CHECK(joint_dag_forest.num_nodes() == dag_forest.num_nodes());
+    CHECK(joint_dag_forest.num_edges() == dag_forest.num_edges());
+    CHECK(joint_dag_forest.num_trees() == dag_forest.num_trees());
+    CHECK_THAT(joint_dag_forest.leaves(), RangeEquals(dag_forest.leaves()));
+    CHECK(joint_dag_forest.postorder_edges().is_postorder());
+    CHECK(joint_dag_forest.postorder_edges().check_postorder());
+
+    // Both forests of the joint compression share their node ids, which is what allows them to share the mutations.
+    SampleSet  all_samples{bp_forest.all_samples()};
+    auto const bp_num_samples_below  = NumSamplesBelowFactory::build(joint_bp_forest, all_samples);
+    auto const dag_num_samples_below = NumSamplesBelowFactory::build(joint_dag_forest, all_samples);
+    for (NodeId node_id = 0; node_id < joint_bp_forest.num_nodes(); ++node_id) {
+        CHECK(bp_num_samples_below(node_id) == dag_num_samples_below(node_id));
+    }
+    for (NodeId const root: joint_dag_forest.roots()) {
+        CHECK(dag_num_samples_below(root) == joint_dag_forest.num_samples());
+    }
+}
+
+TEST_CASE("BP compression with and without skipping unchanged subtrees", "[BPForestCompresion]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    BPForestCompressor     skipping_compressor(tree_sequence);
+    GenomicSequenceFactory skipping_sequence_factory(tree_sequence);
+    BPCompressedForest     skipping_forest = skipping_compressor.compress(skipping_sequence_factory);
+
+    BPForestCompressor descending_compressor(tree_sequence);
+    descending_compressor.skip_unchanged_subtrees(false);
+    GenomicSequenceFactory descending_sequence_factory(tree_sequence);
+    BPCompressedForest     descending_forest = descending_compressor.compress(descending_sequence_factory);
+
+    // Skipping the unchanged subtrees is an optimization only; the encoding is bit by bit the same.
+    CHECK(descending_forest.balanced_parenthesis() == skipping_forest.balanced_parenthesis());
+    CHECK(descending_forest.is_reference() == skipping_forest.is_reference());
+    CHECK(descending_forest.references() == skipping_forest.references());
+    CHECK(descending_forest.leaves() == skipping_forest.leaves());
+    CHECK(descending_forest == skipping_forest);
+
+    SampleSet  all_samples{skipping_forest.all_samples()};
+    auto const skipping_num_samples_below   = NumSamplesBelowFactory::build(skipping_forest, all_samples);
+    auto const descending_num_samples_below = NumSamplesBelowFactory::build(descending_forest, all_samples);
+    REQUIRE(descending_forest.num_nodes() == skipping_forest.num_nodes());
+    for (NodeId node_id = 0; node_id < skipping_forest.num_nodes(); ++node_id) {
+        CHECK(descending_num_samples_below(node_id) == skipping_num_samples_below(node_id));
+    }
+}
+
+TEST_CASE("Excess of the bytes of a balanced parenthesis sequence", "[BPForestCompresion]") {
+    using sfkit::samples::internal::BP_BYTE_EXCESS;
+
+    // (((()))) has its maximum excess in the middle.
+    CHECK(BP_BYTE_EXCESS[0b00001111].excess == 0);
+    CHECK(BP_BYTE_EXCESS[0b00001111].max_prefix_excess == 4);
+    // ()()()() never gets deeper than one.
+    CHECK(BP_BYTE_EXCESS[0b01010101].excess == 0);
+    CHECK(BP_BYTE_EXCESS[0b01010101].max_prefix_excess == 1);
+    // ))))))))
+    CHECK(BP_BYTE_EXCESS[0b00000000].excess == -8);
+    CHECK(BP_BYTE_EXCESS[0b00000000].max_prefix_excess == -1);
+    // ((((((((
+    CHECK(BP_BYTE_EXCESS[0b11111111].excess == 8);
+    CHECK(BP_BYTE_EXCESS[0b11111111].max_prefix_excess == 8);
+    // )((((((( -- the first parenthesis is the least significant bit.
+    CHECK(BP_BYTE_EXCESS[0b11111110].excess == 6);
+    CHECK(BP_BYTE_EXCESS[0b11111110].max_prefix_excess == 6);
+}
+
+TEST_CASE("Parallel NumSamplesBelow on BP forests", "[BPForestCompresion]") {
+    using NumSamplesBelow = sfkit::samples::NumSamplesBelow<BPCompressedForest, 2>;
+    using SetOfSampleSets = sfkit::samples::SetOfSampleSets<2>;
+
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    BPForestCompressor    forest_compressor(tree_sequence);
+    Ts2SfMappingExtractor ts_2_sf_node(tree_sequence.num_trees(), tree_sequence.num_nodes());
+    BPCompressedForest    forest = forest_compressor.compress(ts_2_sf_node);
+
+    SampleSet all_samples{forest.all_samples()};
+    SampleSet even_samples(forest.num_samples());
+    for (SampleId sample = 0; sample < forest.num_samples(); sample += 2) {
+        even_samples.add(sample);
+    }
+    SetOfSampleSets const sample_sets{std::cref(all_samples), std::cref(even_samples)};
+    NumSamplesBelow const sequential(forest, sample_sets);
+
+    // Sample every tree start to get as many blocks (and thus references across blocks) as possible.
+    forest.build_tree_start_index(1);
+    auto const& tree_starts = forest.tree_starts();
+    REQUIRE(tree_starts.size() == forest.num_trees());
+    for (size_t idx = 0; idx < tree_starts.size(); idx++) {
+        CHECK(tree_starts[idx].tree_id == idx);
+        CHECK(forest.balanced_parenthesis()[tree_starts[idx].bp_idx] == BPCompressedForest::PARENS_OPEN);
+        if (idx > 0) {
+            CHECK(tree_starts[idx].bp_idx > tree_starts[idx - 1].bp_idx);
+            CHECK(tree_starts[idx].leaf_rank >= tree_starts[idx - 1].leaf_rank);
+            CHECK(tree_starts[idx].ref_rank >= tree_starts[idx - 1].ref_rank);
+            CHECK(tree_starts[idx].inner_node_id >= tree_starts[idx - 1].inner_node_id);
+        }
+    }
+
+    auto const num_threads = GENERATE(1ul, 2ul, 3ul, 8ul);
+    NumSamplesBelow const parallel(forest, sample_sets, num_threads);
+    for (NodeId node_id = 0; node_id < forest.num_nodes(); ++node_id) {
+        CHECK(parallel.num_samples_below(node_id, 0) == sequential.num_samples_below(node_id, 0));
+        CHECK(parallel.num_samples_below(node_id, 1) == sequential.num_samples_below(node_id, 1));
+    }
+}
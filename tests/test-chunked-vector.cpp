@@ -0,0 +1,50 @@
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_range_equals.hpp>
+
+#include "sfkit/utils/ChunkedVector.hpp"
+
+using namespace Catch::Matchers;
+
+using sfkit::utils::ChunkedVector;
+
+TEST_CASE("ChunkedVector", "[Utils]") {
+    ChunkedVector<uint64_t, 4> vector;
+    CHECK(vector.empty());
+    CHECK(vector.size() == 0);
+    CHECK(vector.memory_usage() == 0);
+
+    std::vector<uint64_t> reference;
+    for (uint64_t value = 0; value < 10; ++value) {
+        vector.push_back(value * value);
+        reference.push_back(value * value);
+    }
+    CHECK_FALSE(vector.empty());
+    CHECK(vector.size() == 10);
+    CHECK(vector.memory_usage() == 3 * 4 * sizeof(uint64_t));
+
+    // Elements are never relocated.
+    uint64_t const* first = &vector[0];
+    vector.emplace_back(100u);
+    reference.push_back(100);
+    CHECK(&vector[0] == first);
+
+    for (size_t idx = 0; idx < reference.size(); ++idx) {
+        CHECK(vector[idx] == reference[idx]);
+    }
+
+    std::vector<uint64_t> drained;
+    std::vector<size_t>   chunk_sizes;
+    vector.drain([&drained, &chunk_sizes](std::span<uint64_t const> const chunk) {
+        drained.insert(drained.end(), chunk.begin(), chunk.end());
+        chunk_sizes.push_back(chunk.size());
+    });
+    CHECK_THAT(drained, RangeEquals(reference));
+    CHECK_THAT(chunk_sizes, RangeEquals(std::vector<size_t>{4, 4, 3}));
+    CHECK(vector.empty());
+    CHECK(vector.memory_usage() == 0);
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
@@ -13,6 +14,7 @@
 #include "sfkit/assertion_levels.hpp"
 #include "sfkit/bp/BPForestCompressor.hpp"
 #include "sfkit/dag/DAGForestCompressor.hpp"
+#include "sfkit/dag/DAGNodeRelabeling.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/io/CompressedForestIO.hpp"
 #include "sfkit/samples/NumSamplesBelowFactory.hpp"
@@ -27,7 +29,9 @@ using sfkit::DAGSuccinctForest;
 using sfkit::bp::BPCompressedForest;
 using sfkit::bp::BPForestCompressor;
 using sfkit::dag::DAGCompressedForest;
+using sfkit::dag::DAGCompressorState;
 using sfkit::dag::DAGForestCompressor;
+using sfkit::dag::DAGNodeOrder;
 using sfkit::graph::NodeId;
 using sfkit::samples::NumSamplesBelowFactory;
 using sfkit::samples::SampleId;
@@ -35,12 +39,14 @@ using sfkit::samples::SampleSet;
 using sfkit::sequence::AlleleFrequencies;
 using sfkit::sequence::GenomicSequence;
 using sfkit::sequence::GenomicSequenceFactory;
+using sfkit::sequence::MutationId;
 using sfkit::sequence::SiteId;
 using sfkit::stats::AlleleFrequencySpectrum;
 using sfkit::tskit::TSKitTreeSequence;
 
 std::string const DAG_ARCHIVE_FILE_NAME = "tmp-test-f5f515340fa29c848db5ed746253f571c6c791bb.forest";
 std::string const BP_ARCHIVE_FILE_NAME  = "tmp-test-f5f515340fa29c848db5ed746253f571c6c791bb.bpforest";
+std::string const STATE_FILE_NAME       = "tmp-test-f5f515340fa29c848db5ed746253f571c6c791bb.forest-state";
 
 TEST_CASE("CompressedForest/GenomicSequenceStorage Serialization", "[Serialization]") {
     std::vector<std::string> const ts_files = {
@@ -60,6 +66,12 @@ TEST_CASE("CompressedForest/GenomicSequenceStorage Serialization", "[Serializati
     DAGCompressedForest    forest   = forest_compressor.compress(sequence_factory);
     GenomicSequence        sequence = sequence_factory.move_storage();
 
+    // Storing the levels is opt-in.
+    bool const store_levels = GENERATE(false, true);
+    if (store_levels) {
+        forest.compute_levels();
+    }
+
     // Serialize and deserialize the compressed forest and genome sequence storage
     sfkit::io::CompressedForestIO::save(DAG_ARCHIVE_FILE_NAME, forest, sequence);
 
@@ -76,6 +88,14 @@ TEST_CASE("CompressedForest/GenomicSequenceStorage Serialization", "[Serializati
     CHECK(forest_deserialized.num_edges() == forest.num_edges());
     CHECK(forest_deserialized.num_roots() == forest.num_roots());
     CHECK(forest_deserialized.roots() == forest.roots());
+    CHECK(forest_deserialized.sample_ids() == forest.sample_ids());
+    CHECK_THAT(forest_deserialized.postorder_edges(), RangeEquals(forest.postorder_edges()));
+    // The edges are stored in CSR encoding but only the decoded edge list is kept in memory.
+    CHECK_FALSE(forest_deserialized.csr_edges_are_computed());
+    REQUIRE(forest_deserialized.levels_are_computed() == store_levels);
+    if (store_levels) {
+        CHECK(forest_deserialized.levels() == forest.levels());
+    }
 
     auto const all_samples                    = forest.all_samples();
     auto const num_samples_below_deserialized = NumSamplesBelowFactory::build(forest_deserialized, all_samples);
@@ -195,6 +215,7 @@ TEST_CASE("BPCompressedForest/GenomicSequenceStorage Serialization", "[Serializa
     CHECK(forest_deserialized.num_nodes() == forest.num_nodes());
     CHECK(forest_deserialized.num_samples() == forest.num_samples());
     CHECK(forest_deserialized.num_trees() == forest.num_trees());
+    CHECK(forest_deserialized.sample_ids() == forest.sample_ids());
     // CHECK(forest_deserialized.num_edges() == forest.num_edges());
     // CHECK(forest_deserialized.num_roots() == forest.num_roots());
     // CHECK(forest_deserialized.roots() == forest.roots());
@@ -369,3 +390,264 @@ TEST_CASE("Statistics on .forest files", "[Serialization]") {
     CHECK(forest.postorder_edges().check_postorder());
     CHECK(forest.postorder_edges().check_no_duplicate_edges());
 }
+
+// Extract the genomic region [left, right) of the tree sequence, shifted such that it starts at position 0. The node
+// table is kept as is.
+TSKitTreeSequence slice_tree_sequence(TSKitTreeSequence const& tree_sequence, double const left, double const right) {
+    tsk_table_collection_t const& source = *tree_sequence.underlying().tables;
+    tsk_table_collection_t        tables;
+    REQUIRE(tsk_table_collection_copy(&source, &tables, 0) == 0);
+    REQUIRE(tsk_edge_table_clear(&tables.edges) == 0);
+    REQUIRE(tsk_site_table_clear(&tables.sites) == 0);
+    REQUIRE(tsk_mutation_table_clear(&tables.mutations) == 0);
+    tables.sequence_length = right - left;
+
+    for (tsk_size_t edge = 0; edge < source.edges.num_rows; ++edge) {
+        double const edge_left  = std::max(source.edges.left[edge], left);
+        double const edge_right = std::min(source.edges.right[edge], right);
+        if (edge_left < edge_right) {
+            tsk_id_t const ret = tsk_edge_table_add_row(
+                &tables.edges,
+                edge_left - left,
+                edge_right - left,
+                source.edges.parent[edge],
+                source.edges.child[edge],
+                NULL,
+                0
+            );
+            REQUIRE(ret >= 0);
+        }
+    }
+
+    std::vector<tsk_id_t> site_map(source.sites.num_rows, TSK_NULL);
+    for (tsk_size_t site = 0; site < source.sites.num_rows; ++site) {
+        double const position = source.sites.position[site];
+        if (position >= left && position < right) {
+            tsk_size_t const offset = source.sites.ancestral_state_offset[site];
+            site_map[site]          = tsk_site_table_add_row(
+                &tables.sites,
+                position - left,
+                source.sites.ancestral_state + offset,
+                source.sites.ancestral_state_offset[site + 1] - offset,
+                NULL,
+                0
+            );
+            REQUIRE(site_map[site] >= 0);
+        }
+    }
+
+    for (tsk_size_t mutation = 0; mutation < source.mutations.num_rows; ++mutation) {
+        tsk_id_t const site = site_map[static_cast<size_t>(source.mutations.site[mutation])];
+        if (site != TSK_NULL) {
+            tsk_size_t const offset = source.mutations.derived_state_offset[mutation];
+            tsk_id_t const   ret    = tsk_mutation_table_add_row(
+                &tables.mutations,
+                site,
+                source.mutations.node[mutation],
+                TSK_NULL,
+                source.mutations.time[mutation],
+                source.mutations.derived_state + offset,
+                source.mutations.derived_state_offset[mutation + 1] - offset,
+                NULL,
+                0
+            );
+            REQUIRE(ret >= 0);
+        }
+    }
+
+    REQUIRE(tsk_table_collection_sort(&tables, NULL, 0) == 0);
+    REQUIRE(tsk_table_collection_build_index(&tables, 0) == 0);
+    REQUIRE(tsk_table_collection_compute_mutation_parents(&tables, 0) == 0);
+
+    tsk_treeseq_t slice;
+    REQUIRE(tsk_treeseq_init(&slice, &tables, TSK_TS_INIT_BUILD_INDEXES) == 0);
+    tsk_table_collection_free(&tables);
+
+    return TSKitTreeSequence(std::move(slice));
+}
+
+TEST_CASE("Appending trees to a DAGCompressedForest", "[Serialization]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.num_trees() >= 3);
+
+    DAGForestCompressor    reference_compressor(tree_sequence);
+    GenomicSequenceFactory reference_sequence_factory(tree_sequence);
+    DAGCompressedForest    reference_forest   = reference_compressor.compress(reference_sequence_factory);
+    GenomicSequence        reference_sequence = reference_sequence_factory.move_storage();
+
+    // Split the tree sequence at two tree boundaries into three non-empty parts and compress the first part.
+    auto const   split_tree = GENERATE(1.0 / 3, 0.5, 0.9);
+    size_t const num_trees  = tree_sequence.num_trees();
+    size_t const first_split_tree =
+        std::clamp<size_t>(static_cast<size_t>(split_tree * static_cast<double>(num_trees)), 1, num_trees - 2);
+    size_t const second_split_tree = first_split_tree + std::max<size_t>(1, (num_trees - first_split_tree) / 2);
+    double const first_split       = tree_sequence.breakpoints()[first_split_tree];
+    double const second_split      = tree_sequence.breakpoints()[second_split_tree];
+    double const sequence_length   = tree_sequence.sequence_length();
+
+    TSKitTreeSequence head   = slice_tree_sequence(tree_sequence, 0, first_split);
+    TSKitTreeSequence middle = slice_tree_sequence(tree_sequence, first_split, second_split);
+    TSKitTreeSequence tail   = slice_tree_sequence(tree_sequence, second_split, sequence_length);
+    REQUIRE(head.num_trees() + middle.num_trees() + tail.num_trees() == num_trees);
+
+    {
+        DAGForestCompressor    head_compressor(head);
+        GenomicSequenceFactory head_sequence_factory(head);
+        DAGCompressedForest    head_forest   = head_compressor.compress(head_sequence_factory);
+        GenomicSequence        head_sequence = head_sequence_factory.move_storage();
+
+        sfkit::io::CompressedForestIO::save(DAG_ARCHIVE_FILE_NAME, head_forest, head_sequence);
+        sfkit::io::CompressedForestIO::save(STATE_FILE_NAME, head_compressor.release_state());
+    }
+
+    // Load the compressed first part and append the second one.
+    DAGCompressedForest forest;
+    GenomicSequence     sequence;
+    DAGCompressorState  state;
+    sfkit::io::CompressedForestIO::load(DAG_ARCHIVE_FILE_NAME, forest, sequence);
+    sfkit::io::CompressedForestIO::load(STATE_FILE_NAME, state);
+    std::filesystem::remove(DAG_ARCHIVE_FILE_NAME);
+    std::filesystem::remove(STATE_FILE_NAME);
+
+    DAGForestCompressor middle_compressor(middle, std::move(state));
+    middle_compressor.append(forest, sequence);
+    CHECK(forest.num_trees() == head.num_trees() + middle.num_trees());
+
+    // Trees can be appended repeatedly: append the third part using the state released after the second one.
+    DAGForestCompressor::State middle_state = middle_compressor.release_state();
+    CHECK(middle_state.subtree_to_sf_node.num_nodes() == forest.num_nodes());
+    DAGForestCompressor tail_compressor(tail, std::move(middle_state));
+    tail_compressor.append(forest, sequence);
+
+    // The result is the same as if we had compressed the whole tree sequence at once.
+    CHECK(forest.num_nodes() == reference_forest.num_nodes());
+    CHECK(forest.num_trees() == reference_forest.num_trees());
+    CHECK(forest.postorder_edges().check_postorder());
+    CHECK_THAT(forest.roots(), RangeEquals(reference_forest.roots()));
+    CHECK_THAT(forest.leaves(), RangeEquals(reference_forest.leaves()));
+    CHECK_THAT(forest.postorder_edges(), RangeEquals(reference_forest.postorder_edges()));
+
+    REQUIRE(sequence.num_sites() == reference_sequence.num_sites());
+    REQUIRE(sequence.num_mutations() == reference_sequence.num_mutations());
+    REQUIRE(sequence.mutation_indices_are_built());
+    for (SiteId site_id = 0; site_id < reference_sequence.num_sites(); ++site_id) {
+        CHECK(sequence.ancestral_state(site_id) == reference_sequence.ancestral_state(site_id));
+        CHECK_THAT(sequence.mutations_at_site(site_id), RangeEquals(reference_sequence.mutations_at_site(site_id)));
+    }
+
+    DAGSuccinctForest sf(std::move(forest), std::move(sequence));
+    DAGSuccinctForest reference_sf(std::move(reference_forest), std::move(reference_sequence));
+    auto const        afs           = sf.allele_frequency_spectrum(sf.all_samples());
+    auto const        reference_afs = reference_sf.allele_frequency_spectrum(reference_sf.all_samples());
+    CHECK(afs.num_samples() == reference_afs.num_samples());
+    CHECK_THAT(afs, RangeEquals(reference_afs));
+}
+
+TEST_CASE("Relabeling the nodes of a DAGCompressedForest in post-order", "[Serialization]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence      tree_sequence(ts_file);
+    DAGForestCompressor    compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest   = compressor.compress(sequence_factory);
+    GenomicSequence        sequence = sequence_factory.move_storage();
+    CHECK(forest.node_order() == DAGNodeOrder::FirstSeen);
+
+    DAGCompressedForest       reference_forest   = forest;
+    GenomicSequence const     reference_sequence = sequence;
+    std::vector<NodeId> const new_ids            = sfkit::dag::postorder_node_ids(forest.postorder_edges());
+    sfkit::dag::relabel_nodes_in_postorder(forest, sequence);
+    CHECK(forest.node_order() == DAGNodeOrder::Postorder);
+    CHECK(forest.postorder_edges().check_postorder());
+
+    // The new ids are a permutation of the old ones; the samples keep their ids.
+    REQUIRE(new_ids.size() == reference_forest.num_nodes());
+    std::vector<NodeId> sorted_new_ids = new_ids;
+    std::sort(sorted_new_ids.begin(), sorted_new_ids.end());
+    for (NodeId node_id = 0; node_id < sorted_new_ids.size(); node_id++) {
+        CHECK(sorted_new_ids[node_id] == node_id);
+    }
+    for (SampleId sample = 0; sample < forest.num_samples(); sample++) {
+        CHECK(new_ids[sample] == sample);
+    }
+    CHECK_THAT(forest.leaves(), RangeEquals(reference_forest.leaves()));
+
+    // The edges are mapped one by one, their parents now appear in increasing order, and each child has a smaller id
+    // than its parent.
+    REQUIRE(forest.num_edges() == reference_forest.num_edges());
+    NodeId previous_parent = 0;
+    auto   reference_edge  = reference_forest.postorder_edges().begin();
+    for (auto const& edge: forest.postorder_edges()) {
+        CHECK(edge.from() == new_ids[reference_edge->from()]);
+        CHECK(edge.to() == new_ids[reference_edge->to()]);
+        CHECK(edge.from() >= previous_parent);
+        CHECK(edge.to() < edge.from());
+        previous_parent = edge.from();
+        ++reference_edge;
+    }
+    REQUIRE(forest.roots().size() == reference_forest.roots().size());
+    for (size_t idx = 0; idx < forest.roots().size(); idx++) {
+        CHECK(forest.roots()[idx] == new_ids[reference_forest.roots()[idx]]);
+    }
+
+    // The mutations are mapped to the new ids ...
+    REQUIRE(sequence.num_mutations() == reference_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < sequence.num_mutations(); mutation_id++) {
+        NodeId const reference_node_id = reference_sequence.mutation_by_id(mutation_id).node_id();
+        CHECK(sequence.mutation_by_id(mutation_id).node_id() == new_ids[reference_node_id]);
+    }
+
+    // ... and thus, the subtree sizes and statistics do not change.
+    SampleSet sample_set(forest.num_samples());
+    for (SampleId sample = 0; sample < forest.num_samples(); sample += 2) {
+        sample_set.add(sample);
+    }
+    auto const num_samples_below           = NumSamplesBelowFactory::build(forest, sample_set);
+    auto const reference_num_samples_below = NumSamplesBelowFactory::build(reference_forest, sample_set);
+    for (NodeId node_id = 0; node_id < reference_forest.num_nodes(); node_id++) {
+        CHECK(num_samples_below(new_ids[node_id]) == reference_num_samples_below(node_id));
+    }
+
+    AlleleFrequencies const allele_frequencies(forest, sequence, forest.all_samples());
+    AlleleFrequencies const reference_allele_frequencies(reference_forest, reference_sequence, forest.all_samples());
+    AlleleFrequencySpectrum const afs(allele_frequencies);
+    AlleleFrequencySpectrum const reference_afs(reference_allele_frequencies);
+    for (size_t num_derived = 0; num_derived < reference_afs.num_samples(); num_derived++) {
+        CHECK(afs[num_derived] == reference_afs[num_derived]);
+    }
+
+    // The node order is stored in the archive.
+    sfkit::io::CompressedForestIO::save(DAG_ARCHIVE_FILE_NAME, forest, sequence);
+    DAGCompressedForest loaded_forest;
+    GenomicSequence     loaded_sequence;
+    sfkit::io::CompressedForestIO::load(DAG_ARCHIVE_FILE_NAME, loaded_forest, loaded_sequence);
+    std::filesystem::remove(DAG_ARCHIVE_FILE_NAME);
+
+    CHECK(loaded_forest.node_order() == DAGNodeOrder::Postorder);
+    CHECK_THAT(loaded_forest.postorder_edges(), RangeEquals(forest.postorder_edges()));
+    CHECK_THAT(loaded_forest.roots(), RangeEquals(forest.roots()));
+    REQUIRE(loaded_sequence.num_mutations() == sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < sequence.num_mutations(); mutation_id++) {
+        CHECK(loaded_sequence.mutation_by_id(mutation_id) == sequence.mutation_by_id(mutation_id));
+    }
+
+    // The compressor's state refers to the old node ids, we thus cannot append to the relabeled forest.
+    DAGForestCompressor appending_compressor(tree_sequence, compressor.release_state());
+    CHECK_THROWS_AS(appending_compressor.append(forest, sequence), std::runtime_error);
+}
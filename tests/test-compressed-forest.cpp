@@ -1,4 +1,8 @@
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/generators/catch_generators_range.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <kassert/kassert.hpp>
@@ -6,19 +10,31 @@
 #include "mocks/TsToSfMappingExtractor.hpp"
 #include "sfkit/SuccinctForest.hpp"
 #include "sfkit/assertion_levels.hpp"
+#include "sfkit/bp/BPForestCompressor.hpp"
 #include "sfkit/dag/DAGForestCompressor.hpp"
+#include "sfkit/dag/LowMemoryDAGForestCompressor.hpp"
 #include "sfkit/graph/AdjacencyArrayGraph.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/primitives.hpp"
+#include "sfkit/sequence/GenomicSequence.hpp"
+#include "sfkit/sequence/GenomicSequenceFactory.hpp"
 #include "sfkit/utils/concepts.hpp"
 #include "tskit-testlib/testlib.hpp"
 
 using namespace Catch::Matchers;
 
+using sfkit::bp::BPCompressedForest;
+using sfkit::bp::BPForestCompressor;
 using sfkit::dag::DAGCompressedForest;
 using sfkit::dag::DAGForestCompressor;
+using sfkit::dag::LowMemoryDAGForestCompressor;
+using sfkit::graph::HashCollisionHandling;
 using sfkit::graph::NodeId;
 using sfkit::samples::SampleId;
+using sfkit::samples::SampleSet;
+using sfkit::sequence::GenomicSequence;
+using sfkit::sequence::GenomicSequenceFactory;
+using sfkit::sequence::MutationId;
 using sfkit::tskit::TSKitTree;
 using sfkit::tskit::TSKitTreeSequence;
 
@@ -402,3 +418,578 @@ TEST_CASE("Subtrees are created only once Example I", "[CompresedForest]") {
 
     tsk_treeseq_free(&tree_sequence);
 }
+
+TEST_CASE("Parallel compression yields the same forest as the sequential one", "[CompressedForest]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const&  ts_file     = GENERATE_REF(from_range(ts_files));
+    size_t const num_threads = GENERATE(2ul, 3ul, 8ul);
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    DAGForestCompressor    sequential_compressor(tree_sequence);
+    GenomicSequenceFactory sequential_sequence_factory(tree_sequence);
+    DAGCompressedForest    sequential_forest   = sequential_compressor.compress(sequential_sequence_factory);
+    GenomicSequence        sequential_sequence = sequential_sequence_factory.move_storage();
+
+    DAGForestCompressor    parallel_compressor(tree_sequence);
+    GenomicSequenceFactory parallel_sequence_factory(tree_sequence);
+    DAGCompressedForest    parallel_forest   = parallel_compressor.compress(parallel_sequence_factory, num_threads);
+    GenomicSequence        parallel_sequence = parallel_sequence_factory.move_storage();
+
+    CHECK(parallel_forest.num_nodes() == sequential_forest.num_nodes());
+    CHECK(parallel_forest.postorder_edges().is_postorder());
+    CHECK_THAT(parallel_forest.roots(), RangeEquals(sequential_forest.roots()));
+    CHECK_THAT(parallel_forest.leaves(), RangeEquals(sequential_forest.leaves()));
+    CHECK_THAT(parallel_forest.postorder_edges(), RangeEquals(sequential_forest.postorder_edges()));
+
+    REQUIRE(parallel_sequence.num_sites() == sequential_sequence.num_sites());
+    REQUIRE(parallel_sequence.num_mutations() == sequential_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < sequential_sequence.num_mutations(); ++mutation_id) {
+        CHECK(parallel_sequence.mutation_by_id(mutation_id) == sequential_sequence.mutation_by_id(mutation_id));
+    }
+
+    // The parallel compression does not collect statistics.
+    if (tree_sequence.num_trees() > 1) {
+        DAGForestCompressor stats_compressor(tree_sequence);
+        stats_compressor.collect_stats();
+        GenomicSequenceFactory stats_sequence_factory(tree_sequence);
+        CHECK_THROWS_AS(stats_compressor.compress(stats_sequence_factory, num_threads), std::runtime_error);
+    }
+}
+
+TEST_CASE("Low-memory compression", "[CompressedForest]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    DAGForestCompressor reference_compressor(tree_sequence);
+    reference_compressor.collect_stats(false);
+    GenomicSequenceFactory reference_sequence_factory(tree_sequence);
+    DAGCompressedForest    reference_forest      = reference_compressor.compress(reference_sequence_factory);
+    GenomicSequence        reference_sequence    = reference_sequence_factory.move_storage();
+    size_t const           num_distinct_subtrees = reference_compressor.stats()->total().num_new_subtrees;
+
+    SECTION("The budget suffices to keep all subtrees") {
+        LowMemoryDAGForestCompressor compressor(tree_sequence, 16 * 1024 * 1024);
+        GenomicSequenceFactory       sequence_factory(tree_sequence);
+        DAGCompressedForest          forest   = compressor.compress(sequence_factory);
+        GenomicSequence              sequence = sequence_factory.move_storage();
+
+        CHECK(compressor.num_dropped_subtrees() == 0);
+        CHECK(forest.num_nodes() == reference_forest.num_nodes());
+        CHECK(forest.num_trees() == reference_forest.num_trees());
+        CHECK_THAT(forest.roots(), RangeEquals(reference_forest.roots()));
+        CHECK_THAT(forest.leaves(), RangeEquals(reference_forest.leaves()));
+        CHECK_THAT(forest.postorder_edges(), RangeEquals(reference_forest.postorder_edges()));
+
+        REQUIRE(sequence.num_mutations() == reference_sequence.num_mutations());
+        for (MutationId mutation_id = 0; mutation_id < reference_sequence.num_mutations(); ++mutation_id) {
+            CHECK(sequence.mutation_by_id(mutation_id) == reference_sequence.mutation_by_id(mutation_id));
+        }
+    }
+
+    SECTION("Subtrees are dropped") {
+        LowMemoryDAGForestCompressor compressor(tree_sequence, 4 * 1024);
+        GenomicSequenceFactory       sequence_factory(tree_sequence);
+        DAGCompressedForest          forest = compressor.compress(sequence_factory);
+
+        // Each distinct subtree is inserted into the current generation at least once. Filling more than two
+        // generations drops the oldest one.
+        REQUIRE(num_distinct_subtrees > 2 * compressor.subtree_map_generation_capacity());
+        CHECK(compressor.num_dropped_subtrees() > 0);
+        CHECK(compressor.subtree_map_memory_usage() <= 4 * 1024);
+        CHECK(forest.num_nodes() >= reference_forest.num_nodes());
+        CHECK(forest.num_trees() == reference_forest.num_trees());
+        CHECK(forest.postorder_edges().check_postorder());
+
+        // The forest still represents the same trees.
+        sfkit::DAGSuccinctForestNumeric succinct_forest(std::move(forest), sequence_factory.move_storage());
+        CHECK(succinct_forest.diversity() == Catch::Approx(tree_sequence.diversity()).epsilon(1e-6));
+        CHECK(
+            succinct_forest.num_segregating_sites()
+            == Catch::Approx(tree_sequence.num_segregating_sites()).epsilon(1e-6)
+        );
+    }
+}
+
+TEST_CASE("Pipelined compression yields the same forest as the sequential one", "[CompressedForest]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const&  ts_file        = GENERATE_REF(from_range(ts_files));
+    size_t const queue_capacity = GENERATE(1ul, 2ul, 16ul);
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    DAGForestCompressor sequential_compressor(tree_sequence);
+    sequential_compressor.collect_stats();
+    GenomicSequenceFactory sequential_sequence_factory(tree_sequence);
+    DAGCompressedForest    sequential_forest   = sequential_compressor.compress(sequential_sequence_factory);
+    GenomicSequence        sequential_sequence = sequential_sequence_factory.move_storage();
+
+    DAGForestCompressor pipelined_compressor(tree_sequence);
+    pipelined_compressor.collect_stats();
+    GenomicSequenceFactory pipelined_sequence_factory(tree_sequence);
+    DAGCompressedForest    pipelined_forest =
+        pipelined_compressor.compress_pipelined(pipelined_sequence_factory, queue_capacity);
+    GenomicSequence pipelined_sequence = pipelined_sequence_factory.move_storage();
+
+    CHECK(pipelined_forest.num_nodes() == sequential_forest.num_nodes());
+    CHECK(pipelined_forest.postorder_edges().is_postorder());
+    CHECK_THAT(pipelined_forest.roots(), RangeEquals(sequential_forest.roots()));
+    CHECK_THAT(pipelined_forest.leaves(), RangeEquals(sequential_forest.leaves()));
+    CHECK_THAT(pipelined_forest.postorder_edges(), RangeEquals(sequential_forest.postorder_edges()));
+
+    REQUIRE(pipelined_sequence.num_sites() == sequential_sequence.num_sites());
+    REQUIRE(pipelined_sequence.num_mutations() == sequential_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < sequential_sequence.num_mutations(); ++mutation_id) {
+        CHECK(pipelined_sequence.mutation_by_id(mutation_id) == sequential_sequence.mutation_by_id(mutation_id));
+    }
+
+    // Both compressions visit the same nodes of the same trees and add and reuse the same subtrees; in particular, both
+    // skip the trees which are identical to their predecessor.
+    REQUIRE(pipelined_compressor.stats().has_value());
+    auto const& pipelined_stats  = *pipelined_compressor.stats();
+    auto const& sequential_stats = *sequential_compressor.stats();
+    REQUIRE(pipelined_stats.num_trees() == sequential_stats.num_trees());
+    for (sfkit::graph::TreeId tree_id = 0; tree_id < sequential_stats.num_trees(); ++tree_id) {
+        auto const& pipelined_tree  = pipelined_stats.trees()[tree_id];
+        auto const& sequential_tree = sequential_stats.trees()[tree_id];
+        CHECK(pipelined_tree.tree_id == sequential_tree.tree_id);
+        CHECK(pipelined_tree.left == sequential_tree.left);
+        CHECK(pipelined_tree.right == sequential_tree.right);
+        CHECK(pipelined_tree.num_visited_nodes == sequential_tree.num_visited_nodes);
+        CHECK(pipelined_tree.num_invalidated_nodes == sequential_tree.num_invalidated_nodes);
+        CHECK(pipelined_tree.num_new_subtrees == sequential_tree.num_new_subtrees);
+        CHECK(pipelined_tree.num_reused_subtrees == sequential_tree.num_reused_subtrees);
+        CHECK(pipelined_tree.map_size == sequential_tree.map_size);
+    }
+}
+
+TEST_CASE("Verifying the subtree hashes does not change the compressed forest", "[CompressedForest]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file            = GENERATE_REF(from_range(ts_files));
+    auto const  collision_handling = GENERATE(HashCollisionHandling::Report, HashCollisionHandling::Resolve);
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    { // DAG
+        DAGForestCompressor    trusting_compressor(tree_sequence);
+        GenomicSequenceFactory trusting_sequence_factory(tree_sequence);
+        DAGCompressedForest    trusting_forest = trusting_compressor.compress(trusting_sequence_factory);
+
+        DAGForestCompressor    verifying_compressor(tree_sequence, collision_handling);
+        GenomicSequenceFactory verifying_sequence_factory(tree_sequence);
+        DAGCompressedForest    verifying_forest = verifying_compressor.compress(verifying_sequence_factory);
+
+        CHECK(verifying_compressor.num_hash_collisions() == 0);
+        CHECK(verifying_forest.num_nodes() == trusting_forest.num_nodes());
+        CHECK_THAT(verifying_forest.roots(), RangeEquals(trusting_forest.roots()));
+        CHECK_THAT(verifying_forest.postorder_edges(), RangeEquals(trusting_forest.postorder_edges()));
+
+        DAGForestCompressor    parallel_compressor(tree_sequence, collision_handling);
+        GenomicSequenceFactory parallel_sequence_factory(tree_sequence);
+        DAGCompressedForest    parallel_forest = parallel_compressor.compress(parallel_sequence_factory, 3);
+
+        CHECK(parallel_compressor.num_hash_collisions() == 0);
+        CHECK_THAT(parallel_forest.postorder_edges(), RangeEquals(trusting_forest.postorder_edges()));
+    }
+
+    { // BP
+        BPForestCompressor     trusting_compressor(tree_sequence);
+        GenomicSequenceFactory trusting_sequence_factory(tree_sequence);
+        BPCompressedForest     trusting_forest = trusting_compressor.compress(trusting_sequence_factory);
+
+        BPForestCompressor     verifying_compressor(tree_sequence, collision_handling);
+        GenomicSequenceFactory verifying_sequence_factory(tree_sequence);
+        BPCompressedForest     verifying_forest = verifying_compressor.compress(verifying_sequence_factory);
+
+        CHECK(verifying_compressor.num_hash_collisions() == 0);
+        CHECK(verifying_forest == trusting_forest);
+    }
+}
+
+TEMPLATE_TEST_CASE(
+    "All subtree hashing policies yield the same compressed forest",
+    "[CompressedForest]",
+    sfkit::graph::XXH3_128HashPolicy,
+    sfkit::graph::Mix128HashPolicy,
+    sfkit::graph::MultiplyXorShift64HashPolicy
+) {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    // The node ids are assigned in the order in which the subtrees are first encountered; they are thus independent of
+    // the hash values, as long as there are no collisions.
+    DAGForestCompressor    reference_compressor(tree_sequence);
+    GenomicSequenceFactory reference_sequence_factory(tree_sequence);
+    DAGCompressedForest    reference_forest   = reference_compressor.compress(reference_sequence_factory);
+    GenomicSequence        reference_sequence = reference_sequence_factory.move_storage();
+
+    sfkit::graph::ForestCompressor<DAGCompressedForest, TestType> dag_compressor(
+        tree_sequence,
+        HashCollisionHandling::Report
+    );
+    GenomicSequenceFactory dag_sequence_factory(tree_sequence);
+    DAGCompressedForest    dag_forest   = dag_compressor.compress(dag_sequence_factory);
+    GenomicSequence        dag_sequence = dag_sequence_factory.move_storage();
+
+    CHECK(dag_forest.num_nodes() == reference_forest.num_nodes());
+    CHECK_THAT(dag_forest.roots(), RangeEquals(reference_forest.roots()));
+    CHECK_THAT(dag_forest.postorder_edges(), RangeEquals(reference_forest.postorder_edges()));
+    REQUIRE(dag_sequence.num_mutations() == reference_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < reference_sequence.num_mutations(); ++mutation_id) {
+        CHECK(dag_sequence.mutation_by_id(mutation_id) == reference_sequence.mutation_by_id(mutation_id));
+    }
+
+    BPForestCompressor     reference_bp_compressor(tree_sequence);
+    GenomicSequenceFactory reference_bp_sequence_factory(tree_sequence);
+    BPCompressedForest     reference_bp_forest = reference_bp_compressor.compress(reference_bp_sequence_factory);
+
+    sfkit::graph::ForestCompressor<BPCompressedForest, TestType> bp_compressor(
+        tree_sequence,
+        HashCollisionHandling::Report
+    );
+    GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    BPCompressedForest     bp_forest = bp_compressor.compress(bp_sequence_factory);
+
+    CHECK(bp_forest == reference_bp_forest);
+}
+
+TEST_CASE("Compressors collect per-tree statistics", "[CompressedForest]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-zazu.trees",
+        "data/test-pumbaa.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    REQUIRE(tree_sequence.is_owning());
+
+    DAGForestCompressor dag_compressor(tree_sequence);
+    CHECK_FALSE(dag_compressor.stats().has_value());
+    dag_compressor.collect_stats();
+    GenomicSequenceFactory dag_sequence_factory(tree_sequence);
+    DAGCompressedForest    dag_forest = dag_compressor.compress(dag_sequence_factory);
+
+    BPForestCompressor bp_compressor(tree_sequence);
+    bp_compressor.collect_stats();
+    GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    std::ignore = bp_compressor.compress(bp_sequence_factory);
+
+    REQUIRE(dag_compressor.stats().has_value());
+    REQUIRE(bp_compressor.stats().has_value());
+    for (auto const& stats: {*dag_compressor.stats(), *bp_compressor.stats()}) {
+        REQUIRE(stats.num_trees() == dag_forest.num_trees());
+        REQUIRE(stats.trees().size() == dag_forest.num_trees());
+
+        // The trees cover the genome without gaps.
+        CHECK(stats.trees().front().left == 0);
+        CHECK(stats.trees().back().right == tree_sequence.sequence_length());
+
+        sfkit::graph::TreeCompressionStats sum;
+        for (sfkit::graph::TreeId tree_id = 0; tree_id < stats.num_trees(); ++tree_id) {
+            auto const& tree = stats.trees()[tree_id];
+            CHECK(tree.tree_id == tree_id);
+            CHECK(tree.left < tree.right);
+            if (tree_id > 0) {
+                CHECK(tree.left == stats.trees()[tree_id - 1].right);
+            }
+            CHECK(tree.num_new_subtrees + tree.num_reused_subtrees <= tree.num_visited_nodes);
+            sum += tree;
+        }
+        CHECK(sum.num_visited_nodes == stats.total().num_visited_nodes);
+        CHECK(sum.num_new_subtrees == stats.total().num_new_subtrees);
+        CHECK(sum.num_reused_subtrees == stats.total().num_reused_subtrees);
+        CHECK(stats.total().map_size == stats.trees().back().map_size);
+    }
+
+    // Both compressors add each distinct inner subtree exactly once. In the DAG, trees with identical roots get a new
+    // node for their root nonetheless.
+    auto const& dag_total = dag_compressor.stats()->total();
+    CHECK(dag_total.num_new_subtrees == bp_compressor.stats()->total().num_new_subtrees);
+    CHECK(dag_forest.num_samples() + dag_total.num_new_subtrees <= dag_forest.num_nodes());
+}
+
+TEST_CASE("Non-consecutive sample ids are remapped", "[CompressedForest]") {
+    // The same tree as single_tree_ex, but the samples are not the first nodes of the node table.
+    /*          0          */
+    /*         / \         */
+    /*        /   \        */
+    /*       /     \       */
+    /*      /       5      */
+    /*     2       / \     */
+    /*    / \     /   \    */
+    /*   1   3   4     6   */
+    char const* nodes = "0  3   -1   -1\n"
+                        "1  0   -1   -1\n"
+                        "0  1   -1   -1\n"
+                        "1  0   -1   -1\n"
+                        "1  0   -1   -1\n"
+                        "0  2   -1   -1\n"
+                        "1  0   -1   -1\n";
+    char const* edges = "0  1   2   1,3\n"
+                        "0  1   5   4,6\n"
+                        "0  1   0   2,5\n";
+    char const* sites = "0.25  0\n"
+                        "0.5   0\n";
+    char const* mutations = "0  4  1\n"
+                            "1  2  1\n";
+
+    // The same tree sequence with consecutive sample ids.
+    char const* consecutive_mutations = "0  2  1\n"
+                                        "1  4  1\n";
+
+    tsk_treeseq_t non_consecutive_ts;
+    tsk_treeseq_from_text(&non_consecutive_ts, 1, nodes, edges, NULL, sites, mutations, NULL, NULL, 0);
+    TSKitTreeSequence non_consecutive(std::move(non_consecutive_ts));
+    REQUIRE_FALSE(non_consecutive.sample_ids_are_consecutive());
+
+    tsk_treeseq_t consecutive_ts;
+    tsk_treeseq_from_text(
+        &consecutive_ts,
+        1,
+        single_tree_ex_nodes,
+        single_tree_ex_edges,
+        NULL,
+        sites,
+        consecutive_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence consecutive(std::move(consecutive_ts));
+    REQUIRE(consecutive.sample_ids_are_consecutive());
+
+    // DAG
+    DAGForestCompressor    reference_compressor(consecutive);
+    GenomicSequenceFactory reference_sequence_factory(consecutive);
+    DAGCompressedForest    reference_forest   = reference_compressor.compress(reference_sequence_factory);
+    GenomicSequence        reference_sequence = reference_sequence_factory.move_storage();
+
+    DAGForestCompressor    dag_compressor(non_consecutive);
+    GenomicSequenceFactory dag_sequence_factory(non_consecutive);
+    DAGCompressedForest    dag_forest   = dag_compressor.compress(dag_sequence_factory);
+    GenomicSequence        dag_sequence = dag_sequence_factory.move_storage();
+
+    CHECK(dag_forest.num_samples() == 4);
+    CHECK(dag_forest.num_nodes() == reference_forest.num_nodes());
+    CHECK_THAT(dag_forest.postorder_edges(), RangeEquals(reference_forest.postorder_edges()));
+    REQUIRE(dag_sequence.num_mutations() == reference_sequence.num_mutations());
+    for (MutationId mutation_id = 0; mutation_id < reference_sequence.num_mutations(); ++mutation_id) {
+        CHECK(dag_sequence.mutation_by_id(mutation_id) == reference_sequence.mutation_by_id(mutation_id));
+    }
+
+    // The mapping to the tskit node ids is stored in the forest.
+    CHECK(reference_forest.sample_ids().is_identity());
+    auto const& sample_ids = dag_forest.sample_ids();
+    CHECK_FALSE(sample_ids.is_identity());
+    CHECK_THAT(sample_ids.ts_node_ids(), RangeEquals(std::vector<tsk_id_t>{1, 3, 4, 6}));
+    for (SampleId sample_id = 0; sample_id < sample_ids.num_samples(); ++sample_id) {
+        CHECK(sample_ids.sample_id(sample_ids.ts_node_id(sample_id)) == sample_id);
+    }
+    CHECK_FALSE(sample_ids.is_sample(0));
+    CHECK_FALSE(sample_ids.is_sample(2));
+    CHECK(sample_ids.is_sample(6));
+
+    // BP
+    BPForestCompressor     reference_bp_compressor(consecutive);
+    GenomicSequenceFactory reference_bp_sequence_factory(consecutive);
+    BPCompressedForest     reference_bp_forest = reference_bp_compressor.compress(reference_bp_sequence_factory);
+
+    BPForestCompressor     bp_compressor(non_consecutive);
+    GenomicSequenceFactory bp_sequence_factory(non_consecutive);
+    BPCompressedForest     bp_forest = bp_compressor.compress(bp_sequence_factory);
+
+    CHECK(bp_forest.num_nodes() == reference_bp_forest.num_nodes());
+    CHECK(bp_forest.num_samples() == reference_bp_forest.num_samples());
+    CHECK(bp_forest.balanced_parenthesis() == reference_bp_forest.balanced_parenthesis());
+    CHECK(bp_forest.sample_ids() == sample_ids);
+}
+
+TEMPLATE_TEST_CASE(
+    "Trees with multiple roots", "[CompressedForest]", sfkit::DAGSuccinctForestNumeric, sfkit::BPSuccinctForestNumeric
+) {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        multi_root_ex_nodes,
+        multi_root_ex_edges,
+        NULL,
+        multi_root_ex_sites,
+        multi_root_ex_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence tree_sequence(std::move(tskit_tree_sequence));
+    REQUIRE(tree_sequence.num_trees() == 4);
+
+    // Trees with multiple roots are rooted at tskit's virtual root; each tree thus has exactly one root in the
+    // compressed forest, and the statistics are summed up over all roots of a tree.
+    TestType forest(tree_sequence);
+    CHECK(forest.num_trees() == 4);
+    CHECK(forest.num_samples() == 4);
+    CHECK(forest.num_sites() == 5);
+    CHECK(forest.num_segregating_sites() == Catch::Approx(tree_sequence.num_segregating_sites()));
+    CHECK(forest.diversity() == Catch::Approx(tree_sequence.diversity()));
+
+    SampleSet sample_set_0(4);
+    SampleSet sample_set_1(4);
+    sample_set_0.add(0);
+    sample_set_0.add(2);
+    sample_set_1.add(1);
+    sample_set_1.add(3);
+    CHECK(
+        forest.divergence(sample_set_0, sample_set_1)
+        == Catch::Approx(tree_sequence.divergence(sample_set_0, sample_set_1))
+    );
+}
+
+TEST_CASE("Trees with multiple roots have a single root in the DAG", "[CompressedForest]") {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        multi_root_ex_nodes,
+        multi_root_ex_edges,
+        NULL,
+        multi_root_ex_sites,
+        multi_root_ex_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence tree_sequence(std::move(tskit_tree_sequence));
+
+    DAGForestCompressor    dag_compressor(tree_sequence);
+    GenomicSequenceFactory dag_sequence_factory(tree_sequence);
+    DAGCompressedForest    dag_forest = dag_compressor.compress(dag_sequence_factory);
+
+    REQUIRE(dag_forest.num_roots() == 4);
+    CHECK(dag_forest.postorder_edges().check_postorder());
+
+    // The first and the last tree consist of the isolated samples only; their roots have the samples as children.
+    auto const children_of = [&dag_forest](NodeId const node) {
+        std::vector<NodeId> children;
+        for (auto const& edge: dag_forest.postorder_edges()) {
+            if (edge.from() == node) {
+                children.push_back(edge.to());
+            }
+        }
+        return children;
+    };
+    CHECK_THAT(children_of(dag_forest.roots()[0]), UnorderedRangeEquals(std::vector<NodeId>{0, 1, 2, 3}));
+    CHECK_THAT(children_of(dag_forest.roots()[3]), UnorderedRangeEquals(std::vector<NodeId>{0, 1, 2, 3}));
+    CHECK(children_of(dag_forest.roots()[1]).size() == 2);
+    CHECK(children_of(dag_forest.roots()[2]).size() == 2);
+
+    // The BP compressor builds the same DAG alongside.
+    BPForestCompressor     bp_compressor(tree_sequence);
+    GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    auto [bp_forest, joint_dag_forest] = bp_compressor.compress_with_dag(bp_sequence_factory);
+    CHECK(joint_dag_forest.num_roots() == 4);
+    CHECK(joint_dag_forest.postorder_edges().check_postorder());
+    CHECK(bp_forest.num_trees() == 4);
+}
+
+TEST_CASE("Identical consecutive trees share their root", "[CompressedForest]") {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        repeated_tree_ex_nodes,
+        repeated_tree_ex_edges,
+        NULL,
+        repeated_tree_ex_sites,
+        repeated_tree_ex_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence tree_sequence(std::move(tskit_tree_sequence));
+    REQUIRE(tree_sequence.num_trees() == 3);
+
+    DAGForestCompressor    dag_compressor(tree_sequence);
+    GenomicSequenceFactory dag_sequence_factory(tree_sequence);
+    DAGCompressedForest    dag_forest = dag_compressor.compress(dag_sequence_factory);
+
+    CHECK(dag_forest.num_trees() == 3);
+    REQUIRE(dag_forest.num_roots() == 2);
+    CHECK(dag_forest.root_run_length(0) == 2);
+    CHECK(dag_forest.root_run_length(1) == 1);
+    CHECK(dag_forest.root_of_tree(0) == dag_forest.roots()[0]);
+    CHECK(dag_forest.root_of_tree(1) == dag_forest.roots()[0]);
+    CHECK(dag_forest.root_of_tree(2) == dag_forest.roots()[1]);
+    CHECK(dag_forest.postorder_edges().check_postorder());
+
+    // 4 samples, 3 inner nodes in the first (and second) tree, 3 new inner nodes in the third one.
+    CHECK(dag_forest.num_nodes() == 10);
+
+    size_t const num_threads = GENERATE(2ul, 3ul);
+    DAGForestCompressor    parallel_compressor(tree_sequence);
+    GenomicSequenceFactory parallel_sequence_factory(tree_sequence);
+    DAGCompressedForest    parallel_forest = parallel_compressor.compress(parallel_sequence_factory, num_threads);
+    CHECK(parallel_forest.num_trees() == 3);
+    CHECK_THAT(parallel_forest.roots(), RangeEquals(dag_forest.roots()));
+    CHECK_THAT(parallel_forest.postorder_edges(), RangeEquals(dag_forest.postorder_edges()));
+
+    // The DAG built alongside the BP forest deduplicates the roots in the same way.
+    BPForestCompressor     bp_compressor(tree_sequence);
+    GenomicSequenceFactory bp_sequence_factory(tree_sequence);
+    auto [bp_forest, joint_dag_forest] = bp_compressor.compress_with_dag(bp_sequence_factory);
+    CHECK(bp_forest.num_trees() == 3);
+    CHECK(joint_dag_forest.num_trees() == 3);
+    CHECK(joint_dag_forest.num_roots() == 2);
+    CHECK(joint_dag_forest.num_nodes() == dag_forest.num_nodes());
+}
@@ -249,3 +249,33 @@ TEST_CASE("Diversity multi tree with multiple derived states", "[Diversity]") {
     CHECK(sequence_forest.diversity(sample_set_1) == Approx(reference_pi[0]).epsilon(1e-6));
     CHECK(sequence_forest.diversity(sample_set_2) == Approx(reference_pi[1]).epsilon(1e-6));
 }
+
+TEST_CASE("Diversity does not depend on the width of the subtree sizes", "[Diversity]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence       tree_sequence(ts_file);
+    sfkit::DAGSuccinctForest forest(tree_sequence);
+
+    // At most 255 samples, thus the diversity is computed using 8-bit subtree sizes.
+    SampleSet sample_set(forest.num_samples());
+    for (SampleId sample = 0; sample < std::min<SampleId>(forest.num_samples(), 255); sample++) {
+        sample_set.add(sample);
+    }
+    SampleId const num_samples = sample_set.popcount();
+
+    double const pi = forest.diversity(sample_set);
+    CHECK(pi == Approx(forest.diversity(num_samples, forest.allele_frequencies<uint16_t>(sample_set))).epsilon(1e-6));
+    CHECK(pi == Approx(forest.diversity(num_samples, forest.allele_frequencies<SampleId>(sample_set))).epsilon(1e-6));
+
+    SiteId const num_segregating_sites = forest.num_segregating_sites(sample_set);
+    CHECK(
+        num_segregating_sites
+        == forest.num_segregating_sites(num_samples, forest.allele_frequencies<SampleId>(sample_set))
+    );
+}
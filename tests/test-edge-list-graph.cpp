@@ -277,3 +277,34 @@ TEST_CASE("EdgeListGraph::sort() simple graph", "[EdgeListGraph]") {
         CHECK_FALSE(graph.edges_are_sorted(SortBy::FromVertex));
     }
 }
+
+TEST_CASE("EdgeListGraph stores runs of identical roots", "[EdgeListGraph]") {
+    EdgeListGraph graph;
+
+    graph.insert_root(5);
+    graph.insert_root(5);
+    graph.insert_root(7);
+    graph.insert_root(6);
+    graph.insert_root(8, 3);
+    graph.insert_root(8);
+
+    CHECK(graph.num_trees() == 7);
+    CHECK(graph.num_roots() == 4);
+    CHECK_THAT(graph.roots(), RangeEquals(std::vector<NodeId>{5, 7, 6, 8}));
+
+    CHECK(graph.root_run_start(0) == 0);
+    CHECK(graph.root_run_start(1) == 2);
+    CHECK(graph.root_run_start(2) == 3);
+    CHECK(graph.root_run_start(3) == 4);
+
+    CHECK(graph.root_run_length(0) == 2);
+    CHECK(graph.root_run_length(1) == 1);
+    CHECK(graph.root_run_length(2) == 1);
+    CHECK(graph.root_run_length(3) == 4);
+
+    std::vector<NodeId> roots_of_trees;
+    for (TreeId tree_id = 0; tree_id < graph.num_trees(); ++tree_id) {
+        roots_of_trees.push_back(graph.root_of_tree(tree_id));
+    }
+    CHECK_THAT(roots_of_trees, RangeEquals(std::vector<NodeId>{5, 5, 7, 6, 8, 8, 8}));
+}
@@ -9,6 +9,7 @@
 #include "mocks/TsToSfMappingExtractor.hpp"
 #include "sfkit/SuccinctForest.hpp"
 #include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCSREdges.hpp"
 #include "sfkit/dag/DAGForestCompressor.hpp"
 #include "sfkit/graph/EdgeListGraph.hpp"
 #include "sfkit/graph/primitives.hpp"
@@ -19,6 +20,7 @@
 using namespace Catch::Matchers;
 
 using sfkit::dag::DAGCompressedForest;
+using sfkit::dag::DAGCSREdges;
 using sfkit::dag::DAGForestCompressor;
 using sfkit::graph::NodeId;
 using sfkit::samples::SampleId;
@@ -99,6 +101,7 @@ TEST_CASE("CompressedForest::lca()", "[CompressedForest]") {
     DAGCompressedForest   forest = forest_compressor.compress(ts_2_sf_node);
     CHECK(ts_2_sf_node.finalize_called());
     CHECK(ts_2_sf_node.process_mutations_callcnt() == tree_sequence.num_trees());
+    DAGCSREdges const csr_edges(forest.postorder_edges());
 
     constexpr uint32_t n_trials = 100;
     for (uint32_t trial = 0; trial < n_trials; ++trial) {
@@ -118,5 +121,46 @@ TEST_CASE("CompressedForest::lca()", "[CompressedForest]") {
         for (TreeId tree_id = 0; tree_id < forest.num_trees(); ++tree_id) {
             CHECK(ts_2_sf_node(tree_id, asserting_cast<tsk_id_t>(tskit_lca[tree_id])) == sfkit_lca[tree_id]);
         }
+
+        DAGLowestCommonAncestor csr_lca(forest.postorder_edges(), csr_edges);
+        CHECK_THAT(csr_lca.lca(samples), RangeEquals(sfkit_lca));
+    }
+}
+
+TEST_CASE("CompressedForest::lca() with identical consecutive trees", "[CompressedForest]") {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        repeated_tree_ex_nodes,
+        repeated_tree_ex_edges,
+        NULL,
+        repeated_tree_ex_sites,
+        repeated_tree_ex_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence   tree_sequence(std::move(tskit_tree_sequence));
+    DAGForestCompressor forest_compressor(tree_sequence);
+
+    Ts2SfMappingExtractor ts_2_sf_node(tree_sequence.num_trees(), tree_sequence.num_nodes());
+    DAGCompressedForest   forest = forest_compressor.compress(ts_2_sf_node);
+    REQUIRE(forest.num_roots() < forest.num_trees());
+
+    auto const [u, v] = GENERATE(std::pair<tsk_id_t, tsk_id_t>{0, 1}, std::pair<tsk_id_t, tsk_id_t>{1, 3});
+    auto const tskit_lca = tree_sequence.lca(u, v);
+
+    sfkit::SampleSet samples(tree_sequence.num_samples());
+    samples.add(ts_2_sf_node(0, u));
+    samples.add(ts_2_sf_node(0, v));
+
+    DAGLowestCommonAncestor lca(forest.postorder_edges());
+    auto                    sfkit_lca = lca.lca(samples);
+
+    REQUIRE(sfkit_lca.size() == forest.num_trees());
+    REQUIRE(tskit_lca.size() == sfkit_lca.size());
+    for (TreeId tree_id = 0; tree_id < forest.num_trees(); ++tree_id) {
+        CHECK(ts_2_sf_node(tree_id, asserting_cast<tsk_id_t>(tskit_lca[tree_id])) == sfkit_lca[tree_id]);
     }
 }
@@ -27,6 +27,7 @@ using namespace ::Catch::Matchers;
 using sfkit::DAGSuccinctForest;
 using sfkit::graph::EdgeListGraph;
 using sfkit::graph::NodeId;
+using sfkit::graph::TreeId;
 using sfkit::samples::SampleId;
 using sfkit::sequence::SiteId;
 using sfkit::tskit::TSKitTree;
@@ -154,10 +155,18 @@ TEST_CASE("ForestCompressor", "[LoadFromTreeSequence]") {
 
     REQUIRE(dag.is_postorder());
     CHECK(dag.num_trees() == tree_sequence.num_trees());
-    CHECK(dag.num_roots() == tree_sequence.num_trees());
-    CHECK(dag.roots().size() == tree_sequence.num_trees());
+    // Consecutive identical trees share a single root.
+    CHECK(dag.num_roots() <= dag.num_trees());
+    CHECK(dag.roots().size() == dag.num_roots());
     CHECK(dag.num_leaves() == tree_sequence.num_samples());
 
+    TreeId num_trees_in_runs = 0;
+    for (size_t root_idx = 0; root_idx < dag.num_roots(); ++root_idx) {
+        CHECK(dag.root_run_length(root_idx) >= 1);
+        num_trees_in_runs += dag.root_run_length(root_idx);
+    }
+    CHECK(num_trees_in_runs == dag.num_trees());
+
     // Compute the number of samples below each root.
     std::vector<size_t> subtree_sizes(dag.num_nodes(), 0);
     for (NodeId leaf: dag.leaves()) {
@@ -176,6 +185,17 @@ TEST_CASE("ForestCompressor", "[LoadFromTreeSequence]") {
         CHECK(subtree_sizes[root] == dag.num_leaves());
     }
 
+    // A tree gets a new root unless it is identical to the previous one.
+    TSKitTree tree(tree_sequence);
+    for (tree.first(); tree.is_tree(); tree.next()) {
+        TreeId const tree_id = asserting_cast<TreeId>(tree.tree_id());
+        NodeId const root    = dag.root_of_tree(tree_id);
+        CHECK(subtree_sizes[root] == dag.num_leaves());
+        if (tree_id > 0) {
+            CHECK((root == dag.root_of_tree(tree_id - 1)) == tree.edge_diff_is_empty());
+        }
+    }
+
     // If the edge list is in postorder, then all in edges of a node will appear after all out edges of a node.
     std::vector<bool> pointed_to(dag.num_nodes(), false);
     for (auto& edge: dag) {
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <span>
+
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
 #include <catch2/generators/catch_generators_range.hpp>
@@ -8,22 +13,43 @@
 
 #include "mocks/TsToSfMappingExtractor.hpp"
 #include "sfkit/assertion_levels.hpp"
+#include "sfkit/dag/DAGCSREdges.hpp"
 #include "sfkit/dag/DAGCompressedForest.hpp"
+#include "sfkit/dag/DAGLevels.hpp"
+#include "sfkit/dag/DAGNodeRelabeling.hpp"
 #include "sfkit/io/CompressedForestIO.hpp"
+#include "sfkit/samples/DescendantBitmaps.hpp"
+#include "sfkit/samples/IncrementalNumSamplesBelow.hpp"
 #include "sfkit/samples/NumSamplesBelowFactory.hpp"
 #include "sfkit/samples/SampleSet.hpp"
+#include "sfkit/sequence/AlleleFrequencies.hpp"
 #include "sfkit/sequence/GenomicSequence.hpp"
 #include "tskit-testlib/testlib.hpp"
 
 using namespace ::Catch::Matchers;
 
 using sfkit::dag::DAGCompressedForest;
+using sfkit::dag::DAGCSREdges;
 using sfkit::dag::DAGForestCompressor;
+using sfkit::dag::DAGLevels;
+using sfkit::graph::Edge;
+using sfkit::graph::EdgeId;
+using sfkit::graph::EdgeListGraph;
 using sfkit::graph::NodeId;
+using sfkit::samples::DescendantBitmapNumSamplesBelow;
+using sfkit::samples::DescendantBitmaps;
+using sfkit::samples::DynamicSetOfSampleSets;
+using sfkit::samples::IncrementalNumSamplesBelow;
+using sfkit::samples::NumSamplesBelow;
+using sfkit::samples::NumSamplesBelowAccessor;
 using sfkit::samples::NumSamplesBelowFactory;
 using sfkit::samples::SampleId;
 using sfkit::samples::SampleSet;
+using sfkit::samples::SampleSetId;
+using sfkit::sequence::AlleleFrequencies;
+using sfkit::sequence::GenomicSequence;
 using sfkit::sequence::GenomicSequenceFactory;
+using sfkit::sequence::PerfectNumericHasher;
 using sfkit::sequence::SiteId;
 using sfkit::tskit::TSKitTreeSequence;
 
@@ -463,3 +489,359 @@ TEST_CASE("NumSamplesBelow Simultaneous Computation of Multiple Sample Sets Simu
         }
     }
 }
+
+TEST_CASE("NumSamplesBelow Runtime Number of Sample Sets Simulated", "[NumSamplesBelow]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    // Not a multiple of the number of SIMD lanes, thus the last block is only partially used.
+    size_t const num_sample_sets = GENERATE(1ul, 3ul, 16ul, 37ul);
+
+    TSKitTreeSequence tree_sequence(ts_file);
+
+    DAGForestCompressor    forest_compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest = forest_compressor.compress(sequence_factory);
+
+    // Assign the samples round-robin; the samples of each sample set are thus spread over the whole DAG.
+    std::vector<SampleSet> sample_sets(num_sample_sets, forest.num_samples());
+    size_t                 idx = 0;
+    for (SampleId sample: forest.leaves()) {
+        sample_sets[idx].add(sample);
+        idx = (idx + 1ul) % num_sample_sets;
+    }
+    DynamicSetOfSampleSets const sample_set_refs(sample_sets.begin(), sample_sets.end());
+
+    auto const num_samples_below_u32 =
+        NumSamplesBelowFactory::build<DAGCompressedForest, uint32_t>(forest, sample_set_refs);
+    auto const num_samples_below_u16 =
+        NumSamplesBelowFactory::build<DAGCompressedForest, uint16_t>(forest, sample_set_refs);
+    REQUIRE(num_samples_below_u32.size() == num_sample_sets);
+    REQUIRE(num_samples_below_u16.size() == num_sample_sets);
+
+    for (size_t set = 0; set < num_sample_sets; ++set) {
+        auto const num_samples_below_ref = NumSamplesBelowFactory::build(forest, sample_sets[set]);
+        CHECK(num_samples_below_u32[set].num_samples_in_sample_set() == sample_sets[set].popcount());
+        CHECK(num_samples_below_u16[set].num_samples_in_sample_set() == sample_sets[set].popcount());
+        for (NodeId node = 0; node < forest.num_nodes(); ++node) {
+            CHECK(num_samples_below_ref(node) == num_samples_below_u32[set](node));
+            CHECK(num_samples_below_ref(node) == num_samples_below_u16[set](node));
+        }
+    }
+
+    for (auto& root_node: forest.roots()) {
+        SampleId sum = 0;
+        for (auto const& num_samples_below: num_samples_below_u32) {
+            sum += num_samples_below(root_node);
+        }
+        CHECK(sum == forest.num_samples());
+    }
+}
+
+TEST_CASE("NumSamplesBelow Parallel Computation by Levels", "[NumSamplesBelow]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+
+    DAGForestCompressor    forest_compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest = forest_compressor.compress(sequence_factory);
+    EdgeListGraph const&   dag    = forest.postorder_edges();
+
+    SECTION("Levels") {
+        DAGLevels const levels(dag);
+        CHECK(levels.num_edges() == dag.num_edges());
+
+        // All children of a level are leaves or parents of an earlier level; the edges of each parent are adjacent.
+        std::vector<bool> finalized(forest.num_nodes(), false);
+        for (NodeId const leaf: forest.leaves()) {
+            finalized[leaf] = true;
+        }
+        std::vector<Edge> const edges(dag.begin(), dag.end());
+        size_t                  num_edges = 0;
+        for (size_t level = 0; level < levels.num_levels(); ++level) {
+            auto const first_edges = levels.level(level);
+            CHECK_FALSE(first_edges.empty());
+            std::vector<NodeId> parents;
+            for (EdgeId const first_edge: first_edges) {
+                REQUIRE(first_edge < edges.size());
+                NodeId const parent = edges[first_edge].from();
+                CHECK((first_edge == 0 || edges[first_edge - 1].from() != parent));
+                for (EdgeId edge_idx = first_edge; edge_idx < edges.size() && edges[edge_idx].from() == parent;
+                     ++edge_idx) {
+                    CHECK(finalized[edges[edge_idx].to()]);
+                    ++num_edges;
+                }
+                parents.push_back(parent);
+            }
+            for (NodeId const parent: parents) {
+                CHECK_FALSE(finalized[parent]);
+            }
+            for (NodeId const parent: parents) {
+                finalized[parent] = true;
+            }
+        }
+        CHECK(num_edges == dag.num_edges());
+        CHECK(std::all_of(finalized.begin(), finalized.end(), [](bool const f) { return f; }));
+    }
+
+    SECTION("Subtree sizes") {
+        SampleSet sample_set_0(forest.num_samples());
+        SampleSet sample_set_1(forest.num_samples());
+        bool      flip = false;
+        for (SampleId sample: forest.leaves()) {
+            (flip ? sample_set_0 : sample_set_1).add(sample);
+            flip = !flip;
+        }
+        using SetOfSampleSets = sfkit::samples::SetOfSampleSets<2>;
+        SetOfSampleSets const samples{std::cref(sample_set_0), std::cref(sample_set_1)};
+
+        NumSamplesBelow<DAGCompressedForest, 2, SampleId> const reference(forest, samples);
+
+        size_t const num_threads = GENERATE(1ul, 2ul, 4ul);
+        if (GENERATE(false, true)) {
+            forest.compute_levels();
+        }
+        NumSamplesBelow<DAGCompressedForest, 2, SampleId> const parallel(forest, samples, num_threads);
+
+        // Split even the smallest levels between the threads.
+        using NumSamplesBelowImpl = sfkit::samples::internal::DAGNumSamplesBelowImpl<2, SampleId>;
+        DAGLevels const           levels(dag);
+        NumSamplesBelowImpl const split_levels(dag, levels, samples, num_threads, 1);
+
+        for (NodeId node = 0; node < forest.num_nodes(); ++node) {
+            for (SampleSetId set = 0; set < 2; ++set) {
+                CHECK(parallel(node, set) == reference(node, set));
+                CHECK(split_levels(node, set) == reference(node, set));
+            }
+        }
+    }
+}
+
+TEST_CASE("NumSamplesBelow on CSR-Encoded Edges", "[NumSamplesBelow]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence      tree_sequence(ts_file);
+    DAGForestCompressor    forest_compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest   = forest_compressor.compress(sequence_factory);
+    GenomicSequence        sequence = sequence_factory.move_storage();
+
+    // After relabeling the nodes in post-order, the parents are consecutive and not stored.
+    bool const relabel = GENERATE(false, true);
+    if (relabel) {
+        sfkit::dag::relabel_nodes_in_postorder(forest, sequence);
+    }
+    EdgeListGraph const& dag = forest.postorder_edges();
+    DAGCSREdges const    csr_edges(dag);
+    CHECK(csr_edges.num_edges() == dag.num_edges());
+    CHECK(csr_edges.num_nodes() == dag.num_nodes());
+    if (relabel) {
+        CHECK(csr_edges.parents_are_implicit());
+    }
+
+    // The groups yield the edges in their original order.
+    auto edge_it = dag.begin();
+    csr_edges.for_each_parent([&edge_it, &dag](NodeId const parent, std::span<NodeId const> const children) {
+        CHECK_FALSE(children.empty());
+        for (NodeId const child: children) {
+            REQUIRE(edge_it != dag.end());
+            CHECK(edge_it->from() == parent);
+            CHECK(edge_it->to() == child);
+            ++edge_it;
+        }
+    });
+    CHECK(edge_it == dag.end());
+
+    SampleSet sample_set_0(forest.num_samples());
+    SampleSet sample_set_1(forest.num_samples());
+    bool      flip = false;
+    for (SampleId sample: forest.leaves()) {
+        (flip ? sample_set_0 : sample_set_1).add(sample);
+        flip = !flip;
+    }
+    using SetOfSampleSets = sfkit::samples::SetOfSampleSets<2>;
+    SetOfSampleSets const samples{std::cref(sample_set_0), std::cref(sample_set_1)};
+
+    NumSamplesBelow<EdgeListGraph, 2, SampleId> const reference(dag, samples);
+    forest.compute_csr_edges();
+    NumSamplesBelow<DAGCompressedForest, 2, SampleId> const from_csr_edges(forest, samples);
+    for (NodeId node = 0; node < forest.num_nodes(); ++node) {
+        for (SampleSetId set = 0; set < 2; ++set) {
+            CHECK(from_csr_edges(node, set) == reference(node, set));
+        }
+    }
+}
+
+TEST_CASE("DescendantBitmaps", "[NumSamplesBelow]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+
+    DAGForestCompressor    forest_compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest   = forest_compressor.compress(sequence_factory);
+    GenomicSequence        sequence = sequence_factory.move_storage();
+
+    auto const mutation_nodes = sequence.subtrees_with_mutations();
+    auto const bitmaps        = std::make_shared<DescendantBitmaps const>(forest.postorder_edges(), mutation_nodes);
+    CHECK(bitmaps->num_bitmaps() == mutation_nodes.size());
+    CHECK(bitmaps->num_samples() == forest.num_samples());
+
+    // Every k-th sample, with a varying offset.
+    size_t const k      = GENERATE(1ul, 2ul, 7ul);
+    size_t const offset = GENERATE(0ul, 3ul);
+    SampleSet    samples(forest.num_samples());
+    for (SampleId sample = 0; sample < forest.num_samples(); ++sample) {
+        if (sample % k == offset % k) {
+            samples.add(sample);
+        }
+    }
+
+    auto const                            reference = NumSamplesBelowFactory::build(forest, samples);
+    DescendantBitmapNumSamplesBelow const num_samples_below(bitmaps, samples);
+    CHECK(num_samples_below.num_samples_in_sample_set() == reference.num_samples_in_sample_set());
+    CHECK(num_samples_below.num_samples_in_dag() == reference.num_samples_in_dag());
+    for (NodeId const node: mutation_nodes) {
+        CHECK(num_samples_below(node) == reference(node));
+    }
+}
+
+TEST_CASE("IncrementalNumSamplesBelow", "[NumSamplesBelow]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+        "data/test-simba.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+
+    DAGForestCompressor    forest_compressor(tree_sequence);
+    GenomicSequenceFactory sequence_factory(tree_sequence);
+    DAGCompressedForest    forest   = forest_compressor.compress(sequence_factory);
+    GenomicSequence        sequence = sequence_factory.move_storage();
+
+    // Start with all samples in the first sample set and an empty second one.
+    SampleSet sample_set_0 = forest.all_samples();
+    SampleSet sample_set_1(forest.num_samples());
+
+    auto const [num_samples_below, accessors] = NumSamplesBelowFactory::build_incremental(
+        forest,
+        DynamicSetOfSampleSets{std::cref(sample_set_0), std::cref(sample_set_1)}
+    );
+    REQUIRE(accessors.size() == 2);
+    auto const& num_samples_below_0 = accessors[0];
+    auto const& num_samples_below_1 = accessors[1];
+
+    // The allele frequencies computed from the incrementally updated subtree sizes and from freshly computed ones.
+    using IncrementalAlleleFrequencies = AlleleFrequencies<
+        DAGCompressedForest,
+        PerfectNumericHasher,
+        NumSamplesBelowAccessor<IncrementalNumSamplesBelow>>;
+    using ReferenceAlleleFrequencies = AlleleFrequencies<DAGCompressedForest, PerfectNumericHasher>;
+    auto const check_allele_frequencies = [&](auto const& accessor, SampleSet const& sample_set) {
+        IncrementalAlleleFrequencies const allele_frequencies(forest, sequence, accessor);
+        ReferenceAlleleFrequencies const   reference(forest, sequence, sample_set);
+        CHECK(allele_frequencies.num_samples_in_sample_set() == reference.num_samples_in_sample_set());
+
+        SiteId num_sites    = 0;
+        auto   reference_it = reference.begin();
+        for (auto const& allele_frequency: allele_frequencies) {
+            REQUIRE(reference_it != reference.end());
+            CHECK(allele_frequency == *reference_it);
+            ++reference_it;
+            ++num_sites;
+        }
+        CHECK(reference_it == reference.end());
+        CHECK(num_sites == sequence.num_sites());
+    };
+
+    auto const check_against_full_computation = [&]() {
+        auto const reference_0 = NumSamplesBelowFactory::build(forest, sample_set_0);
+        auto const reference_1 = NumSamplesBelowFactory::build(forest, sample_set_1);
+        CHECK(num_samples_below_0.num_samples_in_sample_set() == sample_set_0.popcount());
+        CHECK(num_samples_below_1.num_samples_in_sample_set() == sample_set_1.popcount());
+        for (NodeId node = 0; node < forest.num_nodes(); ++node) {
+            CHECK(num_samples_below_0(node) == reference_0(node));
+            CHECK(num_samples_below_1(node) == reference_1(node));
+        }
+        check_allele_frequencies(num_samples_below_0, sample_set_0);
+        check_allele_frequencies(num_samples_below_1, sample_set_1);
+    };
+    check_against_full_computation();
+
+    std::mt19937                            generator(ts_file.size());
+    std::uniform_int_distribution<SampleId> pick_sample(0, forest.num_samples() - 1);
+    for (size_t step = 0; step < 20; ++step) {
+        SampleId const sample = pick_sample(generator);
+        switch (step % 3) {
+            case 0: // Move the sample to the other sample set.
+                if (sample_set_0[sample]) {
+                    num_samples_below->move(sample, 0, 1);
+                    sample_set_0.remove(sample);
+                    sample_set_1.add(sample);
+                } else {
+                    num_samples_below->move(sample, 1, 0);
+                    sample_set_1.remove(sample);
+                    sample_set_0.add(sample);
+                }
+                break;
+            case 1: // Toggle the sample in the second sample set.
+                if (sample_set_1[sample]) {
+                    num_samples_below->remove(sample, 1);
+                    sample_set_1.remove(sample);
+                } else if (!sample_set_0[sample]) {
+                    num_samples_below->add(sample, 1);
+                    sample_set_1.add(sample);
+                }
+                break;
+            default: // Toggle the sample in the first sample set.
+                if (sample_set_0[sample]) {
+                    num_samples_below->remove(sample, 0);
+                    sample_set_0.remove(sample);
+                } else if (!sample_set_1[sample]) {
+                    num_samples_below->add(sample, 0);
+                    sample_set_0.add(sample);
+                }
+                break;
+        }
+        if (step % 5 == 4) {
+            check_against_full_computation();
+        }
+    }
+}
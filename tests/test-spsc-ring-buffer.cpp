@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include "sfkit/utils/SPSCRingBuffer.hpp"
+
+using sfkit::utils::SPSCRingBuffer;
+
+TEST_CASE("SPSCRingBuffer single thread", "[Utils]") {
+    SPSCRingBuffer<uint64_t> buffer(3);
+    CHECK(buffer.capacity() == 4);
+    CHECK(buffer.try_readable_slot() == nullptr);
+
+    // Fill the buffer completely.
+    for (uint64_t value = 0; value < buffer.capacity(); ++value) {
+        uint64_t* slot = buffer.try_writable_slot();
+        REQUIRE(slot != nullptr);
+        *slot = value;
+        buffer.commit_write();
+    }
+    CHECK(buffer.try_writable_slot() == nullptr);
+
+    // Free one slot and wrap around.
+    uint64_t* slot = buffer.try_readable_slot();
+    REQUIRE(slot != nullptr);
+    CHECK(*slot == 0);
+    buffer.release_read();
+
+    slot = buffer.try_writable_slot();
+    REQUIRE(slot != nullptr);
+    *slot = 4;
+    buffer.commit_write();
+    CHECK(buffer.try_writable_slot() == nullptr);
+
+    for (uint64_t value = 1; value <= 4; ++value) {
+        slot = buffer.try_readable_slot();
+        REQUIRE(slot != nullptr);
+        CHECK(*slot == value);
+        buffer.release_read();
+    }
+    CHECK(buffer.try_readable_slot() == nullptr);
+}
+
+TEST_CASE("SPSCRingBuffer producer and consumer thread", "[Utils]") {
+    size_t const   capacity   = GENERATE(1ul, 2ul, 64ul);
+    uint64_t const num_values = 100'000;
+
+    SPSCRingBuffer<std::vector<uint64_t>> buffer(capacity);
+
+    std::thread producer([&buffer, num_values]() {
+        for (uint64_t value = 0; value < num_values; ++value) {
+            std::vector<uint64_t>* slot;
+            while ((slot = buffer.try_writable_slot()) == nullptr) {
+                std::this_thread::yield();
+            }
+            slot->assign(value % 4, value);
+            buffer.commit_write();
+        }
+    });
+
+    bool all_correct = true;
+    for (uint64_t value = 0; value < num_values; ++value) {
+        std::vector<uint64_t>* slot;
+        while ((slot = buffer.try_readable_slot()) == nullptr) {
+            std::this_thread::yield();
+        }
+        all_correct &= *slot == std::vector<uint64_t>(value % 4, value);
+        buffer.release_read();
+    }
+    producer.join();
+
+    CHECK(all_correct);
+    CHECK(buffer.try_readable_slot() == nullptr);
+}
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/matchers/catch_matchers.hpp>
+#include <catch2/matchers/catch_matchers_range_equals.hpp>
+#include <kassert/kassert.hpp>
+
+#include "sfkit/assertion_levels.hpp"
+#include "sfkit/graph/BoundedSubtreeHashToNodeMapper.hpp"
+#include "sfkit/graph/ConcurrentSubtreeHashToNodeMapper.hpp"
+#include "sfkit/graph/SubtreeCollisionVerifier.hpp"
+#include "sfkit/graph/SubtreeHashToNodeMapper.hpp"
+#include "sfkit/graph/SubtreeHasher.hpp"
+
+using namespace ::Catch::Matchers;
+
+using sfkit::graph::BasicBoundedSubtreeHashToNodeMapper;
+using sfkit::graph::BasicConcurrentSubtreeHashToNodeMapper;
+using sfkit::graph::BasicSubtreeHasher;
+using sfkit::graph::BasicSubtreeHashToNodeMapper;
+using sfkit::graph::ConcurrentSubtreeHashToNodeMapper;
+using sfkit::graph::NodeId;
+using sfkit::graph::SubtreeCollisionVerifier;
+using sfkit::graph::SubtreeHash;
+using sfkit::graph::SubtreeHasher;
+using sfkit::graph::SubtreeHashToNodeMapper;
+
+TEMPLATE_TEST_CASE(
+    "ConcurrentSubtreeHashToNodeMapper behaves like SubtreeHashToNodeMapper",
+    "[SubtreeHashToNodeMapper]",
+    sfkit::graph::XXH3_128HashPolicy,
+    sfkit::graph::MultiplyXorShift64HashPolicy
+) {
+    using Hasher = BasicSubtreeHasher<TestType>;
+    using Hash   = typename Hasher::SubtreeHash;
+
+    size_t const num_shards = GENERATE(1ul, 3ul, 64ul);
+
+    Hasher                                       hasher;
+    BasicSubtreeHashToNodeMapper<Hash>           mapper;
+    BasicConcurrentSubtreeHashToNodeMapper<Hash> concurrent_mapper(num_shards);
+    CHECK(concurrent_mapper.num_shards() >= num_shards);
+
+    for (uint32_t sample = 0; sample < 100; ++sample) {
+        Hash const subtree_id = hasher.hash_sample(sample);
+        CHECK_FALSE(concurrent_mapper.contains(subtree_id));
+        CHECK(concurrent_mapper.insert_node(subtree_id) == mapper.insert_node(subtree_id));
+        CHECK(concurrent_mapper.contains(subtree_id));
+    }
+
+    Hash const root_id = hasher.hash_sample(42u);
+    CHECK(concurrent_mapper.insert_or_update_node(root_id) == mapper.insert_or_update_node(root_id));
+    CHECK(concurrent_mapper[root_id] == mapper[root_id]);
+    CHECK(concurrent_mapper.insert_root() == mapper.insert_root());
+    CHECK(concurrent_mapper.num_nodes() == mapper.num_nodes());
+
+    auto const [node_id, inserted] = concurrent_mapper.insert_or_get_node(root_id);
+    CHECK_FALSE(inserted);
+    CHECK(node_id == mapper[root_id]);
+    CHECK_FALSE(concurrent_mapper.try_map(hasher.hash_sample(1000u)).has_value());
+}
+
+TEST_CASE("ConcurrentSubtreeHashToNodeMapper concurrent insertions", "[SubtreeHashToNodeMapper]") {
+    constexpr size_t   num_threads  = 8;
+    constexpr uint32_t num_subtrees = 10'000;
+
+    SubtreeHasher            hasher;
+    std::vector<SubtreeHash> subtree_ids;
+    for (uint32_t subtree = 0; subtree < num_subtrees; ++subtree) {
+        subtree_ids.push_back(hasher.hash_sample(subtree));
+    }
+
+    // All threads try to insert all subtrees; each subtree has to be inserted exactly once.
+    ConcurrentSubtreeHashToNodeMapper mapper;
+    std::vector<std::vector<NodeId>>  node_ids(num_threads, std::vector<NodeId>(num_subtrees));
+    std::vector<size_t>               num_inserted(num_threads, 0);
+    std::vector<std::thread>          threads;
+    for (size_t thread = 0; thread < num_threads; ++thread) {
+        threads.emplace_back([&, thread]() {
+            for (uint32_t subtree = 0; subtree < num_subtrees; ++subtree) {
+                // Start at different offsets to provoke contention on different shards.
+                uint32_t const idx             = (subtree + static_cast<uint32_t>(thread) * 1237u) % num_subtrees;
+                auto const [node_id, inserted] = mapper.insert_or_get_node(subtree_ids[idx]);
+                node_ids[thread][idx]          = node_id;
+                num_inserted[thread] += inserted;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    size_t overall_num_inserted = 0;
+    for (auto const count: num_inserted) {
+        overall_num_inserted += count;
+    }
+    CHECK(overall_num_inserted == num_subtrees);
+    CHECK(mapper.num_nodes() == num_subtrees);
+
+    // All threads agree on the node ids and the node ids are a permutation of [0, num_subtrees).
+    for (size_t thread = 1; thread < num_threads; ++thread) {
+        CHECK_THAT(node_ids[thread], RangeEquals(node_ids[0]));
+    }
+    std::vector<NodeId> sorted_node_ids = node_ids[0];
+    std::sort(sorted_node_ids.begin(), sorted_node_ids.end());
+    for (uint32_t idx = 0; idx < num_subtrees; ++idx) {
+        CHECK(sorted_node_ids[idx] == idx);
+        CHECK(mapper[subtree_ids[idx]] == node_ids[0][idx]);
+    }
+}
+
+TEST_CASE("SubtreeCollisionVerifier compares the multisets of children", "[SubtreeHashToNodeMapper]") {
+    SubtreeCollisionVerifier verifier;
+    CHECK(verifier.num_nodes() == 0);
+
+    verifier.add_node(0, {});
+    verifier.add_node(1, {});
+    verifier.add_node(2, std::vector<NodeId>{1, 0});
+    verifier.add_node(3, std::vector<NodeId>{2, 0, 2});
+    CHECK(verifier.num_nodes() == 4);
+
+    CHECK(verifier.matches(0, {}));
+    CHECK_FALSE(verifier.matches(0, std::vector<NodeId>{1}));
+
+    CHECK(verifier.matches(2, std::vector<NodeId>{0, 1}));
+    CHECK(verifier.matches(2, std::vector<NodeId>{1, 0}));
+    CHECK_FALSE(verifier.matches(2, std::vector<NodeId>{0, 0}));
+    CHECK_FALSE(verifier.matches(2, std::vector<NodeId>{0, 1, 1}));
+
+    CHECK(verifier.matches(3, std::vector<NodeId>{0, 2, 2}));
+    CHECK(verifier.matches(3, std::vector<NodeId>{2, 2, 0}));
+    CHECK_FALSE(verifier.matches(3, std::vector<NodeId>{0, 0, 2}));
+    CHECK_FALSE(verifier.matches(3, std::vector<NodeId>{0, 2}));
+}
+
+TEST_CASE("SubtreeHasher probes yield distinct hashes", "[SubtreeHashToNodeMapper]") {
+    SubtreeHasher     hasher;
+    SubtreeHash const subtree_hash = hasher.hash_sample(42);
+
+    CHECK(hasher.probe(subtree_hash, 1) == hasher.probe(subtree_hash, 1));
+    CHECK_FALSE(hasher.probe(subtree_hash, 1) == subtree_hash);
+    CHECK_FALSE(hasher.probe(subtree_hash, 1) == hasher.probe(subtree_hash, 2));
+}
+
+TEMPLATE_TEST_CASE(
+    "SubtreeHasher policies",
+    "[SubtreeHashToNodeMapper]",
+    sfkit::graph::XXH3_128HashPolicy,
+    sfkit::graph::Mix128HashPolicy,
+    sfkit::graph::MultiplyXorShift64HashPolicy
+) {
+    using Hasher = BasicSubtreeHasher<TestType>;
+    using Hash   = typename Hasher::SubtreeHash;
+
+    Hasher     hasher;
+    Hash const sample_0 = hasher.hash_sample(0);
+    Hash const sample_1 = hasher.hash_sample(1);
+    CHECK_FALSE(sample_0 == sample_1);
+
+    // A node with a single child does not get the child's hash.
+    hasher.reset();
+    hasher.append_child(sample_0);
+    Hash const parent_0 = hasher.hash();
+    CHECK_FALSE(parent_0 == sample_0);
+
+    // The order of the children does not matter.
+    hasher.reset();
+    hasher.append_child(sample_0);
+    hasher.append_child(sample_1);
+    Hash const parent_01 = hasher.hash();
+    hasher.reset();
+    hasher.append_child(sample_1);
+    hasher.append_child(sample_0);
+    CHECK(hasher.hash() == parent_01);
+    CHECK_FALSE(parent_01 == parent_0);
+
+    // The hashes can be used as keys of the mapper.
+    BasicSubtreeHashToNodeMapper<Hash> mapper;
+    CHECK(mapper.insert_node(sample_0) == 0);
+    CHECK(mapper.insert_node(sample_1) == 1);
+    CHECK(mapper.insert_node(parent_01) == 2);
+    CHECK(mapper[sample_1] == 1);
+    CHECK_FALSE(mapper.contains(parent_0));
+    CHECK(mapper.memory_usage() >= 3 * sizeof(Hash));
+}
+
+TEST_CASE("BoundedSubtreeHashToNodeMapper", "[SubtreeHashToNodeMapper]") {
+    SubtreeHasher            hasher;
+    std::vector<SubtreeHash> subtree_ids;
+    for (uint32_t sample = 0; sample < 10; ++sample) {
+        subtree_ids.push_back(hasher.hash_sample(sample));
+    }
+
+    SECTION("Large enough budget") {
+        BasicBoundedSubtreeHashToNodeMapper<SubtreeHash> mapper(1024 * 1024);
+        CHECK(mapper.insert_unmapped_node() == 0);
+        for (NodeId node_id = 1; node_id <= subtree_ids.size(); ++node_id) {
+            CHECK(mapper.insert_node(subtree_ids[node_id - 1]) == node_id);
+        }
+        for (NodeId node_id = 1; node_id <= subtree_ids.size(); ++node_id) {
+            CHECK(mapper.find(subtree_ids[node_id - 1]) == node_id);
+        }
+        CHECK(mapper.insert_or_update_node(subtree_ids[0]) == 11);
+        CHECK(mapper.find(subtree_ids[0]) == 11);
+        CHECK(mapper.find(hasher.hash_sample(42u)) == std::nullopt);
+        CHECK(mapper.num_nodes() == 12);
+        CHECK(mapper.size() == subtree_ids.size());
+        CHECK(mapper.num_dropped() == 0);
+    }
+
+    SECTION("Generations of a single subtree") {
+        BasicBoundedSubtreeHashToNodeMapper<SubtreeHash> mapper(0);
+        for (NodeId node_id = 0; node_id < subtree_ids.size(); ++node_id) {
+            CHECK(mapper.insert_node(subtree_ids[node_id]) == node_id);
+            CHECK(mapper.size() <= 2);
+        }
+        // Inserting each subtree started a new generation, dropping the second to last one.
+        CHECK(mapper.num_dropped() == subtree_ids.size() - 2);
+
+        // The last two subtrees are still there, finding one of them keeps it for another generation.
+        CHECK(mapper.find(subtree_ids[8]) == 8);
+        CHECK(mapper.find(subtree_ids[9]) == 9);
+        CHECK(mapper.find(subtree_ids[8]) == 8);
+
+        // A dropped subtree gets a new node id.
+        CHECK(mapper.find(subtree_ids[0]) == std::nullopt);
+        CHECK(mapper.insert_node(subtree_ids[0]) == 10);
+        CHECK(mapper.find(subtree_ids[0]) == 10);
+        CHECK(mapper.num_nodes() == 11);
+    }
+}
@@ -1,10 +1,16 @@
 
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/generators/catch_generators.hpp>
 #include <catch2/generators/catch_generators_range.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <kassert/kassert.hpp>
+#include <sfkit/include-redirects/cereal.hpp>
 #include <tskit.h>
 
 #include "sfkit/assertion_levels.hpp"
@@ -16,10 +22,12 @@
 using namespace ::Catch::Matchers;
 
 using sfkit::graph::NodeId;
+using sfkit::graph::TreeId;
 using sfkit::samples::SampleId;
 using sfkit::sequence::SiteId;
 using sfkit::sequence::TSKitSiteToTreeMapper;
 using sfkit::tskit::TSKitTreeSequence;
+using sfkit::utils::asserting_cast;
 
 // This test case is taken from the tskit test suite (the only test case for the AFS in there that checks values).
 TEST_CASE("TSKitSiteToTreeMapper example multi tree no back no recurrent", "[TSKitSiteToTreeMapper]") {
@@ -101,3 +109,45 @@ TEST_CASE("TSKitSiteToTreeMapper example multi tree back recurrent", "[TSKitSite
     CHECK(site2tree(1) == 1);
     CHECK(site2tree(2) == 2);
 }
+
+TEST_CASE("TSKitSiteToTreeMapper matches the trees' intervals", "[TSKitSiteToTreeMapper]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-banzai.trees",
+        "data/test-ed.trees",
+    };
+    auto const&       ts_file = GENERATE_REF(from_range(ts_files));
+    TSKitTreeSequence tree_sequence(ts_file);
+
+    TSKitSiteToTreeMapper site2tree(tree_sequence);
+    REQUIRE(site2tree.num_sites() == tree_sequence.num_sites());
+
+    // The tree of a site is the last one starting at or before the site's position.
+    auto const breakpoints = tree_sequence.breakpoints();
+    for (SiteId site_id = 0; site_id < tree_sequence.num_sites(); ++site_id) {
+        double const position = tree_sequence.position_of(site_id);
+        auto const   next_it  = std::upper_bound(breakpoints.begin(), breakpoints.end(), position);
+        CHECK(site2tree(site_id) == asserting_cast<TreeId>(next_it - breakpoints.begin() - 1));
+    }
+
+    // Round trip through both serialization interfaces.
+    std::stringstream stream;
+    site2tree.save(stream);
+    TSKitSiteToTreeMapper loaded;
+    loaded.load(stream);
+    CHECK(loaded == site2tree);
+
+    std::stringstream cereal_stream;
+    {
+        cereal::BinaryOutputArchive archive(cereal_stream);
+        archive(site2tree);
+    }
+    TSKitSiteToTreeMapper cereal_loaded;
+    {
+        cereal::BinaryInputArchive archive(cereal_stream);
+        archive(cereal_loaded);
+    }
+    CHECK(cereal_loaded == site2tree);
+}
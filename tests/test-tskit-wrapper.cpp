@@ -1,8 +1,11 @@
 #include "tskit/trees.h"
 #include <debug/vector>
 #include <string>
+#include <tuple>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/generators/catch_generators_range.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
 #include <stddef.h>
@@ -61,6 +64,71 @@ TEST_CASE("TSKitTree::eulertour() Example I", "[TSKitTree]") {
     CHECK_THAT(tree.eulertour(), RangeEquals(std::vector<NodeId>{7, 0, 5, 1, 4, 2, 3, 4, 5, 7}));
 }
 
+TEST_CASE("EulertourView::iterator::skip_subtree()", "[TSKitTree]") {
+    //     8   ┊         ┊         ┊
+    //   ┏━┻━┓ ┊         ┊         ┊
+    //   ┃   ┃ ┊         ┊   7     ┊
+    //   ┃   ┃ ┊         ┊ ┏━┻━┓   ┊
+    //   6   ┃ ┊   6     ┊ ┃   ┃   ┊
+    // ┏━┻┓  ┃ ┊ ┏━┻━┓   ┊ ┃   ┃   ┊
+    // ┃  5  ┃ ┊ ┃   5   ┊ ┃   5   ┊
+    // ┃ ┏┻┓ ┃ ┊ ┃ ┏━┻┓  ┊ ┃ ┏━┻┓  ┊
+    // ┃ ┃ ┃ ┃ ┊ ┃ ┃  4  ┊ ┃ ┃  4  ┊
+    // ┃ ┃ ┃ ┃ ┊ ┃ ┃ ┏┻┓ ┊ ┃ ┃ ┏┻┓ ┊
+    // 0 1 3 2 ┊ 0 1 2 3 ┊ 0 1 2 3 ┊
+
+    tsk_treeseq_t tskit_tree_sequence;
+
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        paper_ex_nodes,
+        paper_ex_edges,
+        NULL,
+        paper_ex_sites,
+        paper_ex_mutations,
+        paper_ex_individuals,
+        NULL,
+        0
+    );
+
+    TSKitTreeSequence sfkit_tree_sequence(std::move(tskit_tree_sequence));
+    REQUIRE(sfkit_tree_sequence.is_owning());
+
+    TSKitTree tree{sfkit_tree_sequence};
+    tree.first();
+
+    // Walk the Euler tour of the first tree and skip the subtree of the given node on its first visit.
+    auto const eulertour_skipping = [&tree](tsk_id_t const skipped_node) {
+        std::vector<tsk_id_t> visited;
+        auto                  eulertour = tree.eulertour();
+        for (auto it = eulertour.begin(); it != eulertour.end(); ++it) {
+            visited.push_back(it.node_id());
+            if (it.node_id() == skipped_node && it.first_visit()) {
+                it.skip_subtree();
+            }
+        }
+        return visited;
+    };
+
+    SECTION("Skipping a leaf changes nothing") {
+        CHECK_THAT(eulertour_skipping(2), RangeEquals(std::vector<NodeId>{8, 2, 6, 0, 5, 1, 3, 5, 6, 8}));
+        CHECK_THAT(eulertour_skipping(1), RangeEquals(std::vector<NodeId>{8, 2, 6, 0, 5, 1, 3, 5, 6, 8}));
+    }
+
+    SECTION("Skipping an inner node continues with its parent") {
+        CHECK_THAT(eulertour_skipping(5), RangeEquals(std::vector<NodeId>{8, 2, 6, 0, 5, 6, 8}));
+    }
+
+    SECTION("Skipping the last child of the root ends the tour at the root") {
+        CHECK_THAT(eulertour_skipping(6), RangeEquals(std::vector<NodeId>{8, 2, 6, 8}));
+    }
+
+    SECTION("Skipping the root ends the tour") {
+        CHECK_THAT(eulertour_skipping(8), RangeEquals(std::vector<NodeId>{8}));
+    }
+}
+
 TEST_CASE("TSKitTree::eulertour() Example II", "[TSKitTree]") {
     /*          6          */
     /*         / \         */
@@ -340,3 +408,175 @@ TEST_CASE("TSKitTree::invalidated_nodes() Zazu", "[BPForestCompression]") {
     tree.next();
     CHECK_THAT(tree.invalidated_nodes(), UnorderedRangeEquals(std::vector<NodeId>{7, 8, 9}));
 }
+
+TEST_CASE("TSKitTree::invalidated_postorder() Zazu", "[TSKitTree]") {
+    // test-zazu.trees, see the drawing in the TSKitTree::invalidated_nodes() Zazu test above.
+
+    TSKitTreeSequence tree_sequence("data/test-zazu.trees");
+    REQUIRE(tree_sequence.is_owning());
+
+    TSKitTree tree{tree_sequence};
+
+    tree.first();
+
+    // Only the invalidated nodes which are part of the current tree are reported; always including the root.
+    // Tree 0 -> 1
+    tree.next();
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{6}));
+
+    // Tree 1 -> 2
+    tree.next();
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{8}));
+
+    // Tree 2 -> 3 (the drawing does not necessarily reflect the order of the children in tskit)
+    tree.next();
+    CHECK_THAT(tree.invalidated_postorder(), UnorderedRangeEquals(std::vector<tsk_id_t>{5, 7, 8}));
+    CHECK(tree.invalidated_postorder().back() == 8);
+
+    // Tree 3 -> 4
+    tree.next();
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{8, 9}));
+}
+
+TEST_CASE("TSKitTree::invalidated_postorder() is the filtered postorder", "[TSKitTree]") {
+    std::vector<std::string> const ts_files = {
+        "data/test-sarafina.trees",
+        "data/test-scar.trees",
+        "data/test-shenzi.trees",
+        "data/test-ed.trees",
+    };
+    auto const& ts_file = GENERATE_REF(from_range(ts_files));
+
+    TSKitTreeSequence tree_sequence(ts_file);
+    TSKitTree         tree{tree_sequence};
+
+    tree.first();
+    for (tree.next(); tree.is_tree(); tree.next()) {
+        std::ignore = tree.invalidated_nodes();
+
+        std::vector<tsk_id_t> expected;
+        for (auto const node: tree.postorder()) {
+            if (tree.is_invalidated(node) || tree.is_root(node)) {
+                expected.push_back(node);
+            }
+        }
+        CHECK_THAT(tree.invalidated_postorder(), RangeEquals(expected));
+    }
+}
+
+TEST_CASE("TSKitTree::invalidated_postorder() with multiple roots in the leading trees", "[TSKitTree]") {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        multi_root_leading_ex_nodes,
+        multi_root_leading_ex_edges,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence tree_sequence(std::move(tskit_tree_sequence));
+    REQUIRE(tree_sequence.num_trees() == 3);
+
+    TSKitTree      tree{tree_sequence};
+    tsk_id_t const virtual_root = 8;
+    REQUIRE(tree.virtual_root() == virtual_root);
+
+    tree.first();
+    CHECK(tree.num_roots() == 2);
+    CHECK(tree.root() == virtual_root);
+
+    // The real roots have no parent in tskit; the traversal has to return to the virtual root nonetheless.
+    tree.next();
+    CHECK(tree.num_roots() == 2);
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{6, virtual_root}));
+
+    tree.next();
+    CHECK(tree.num_roots() == 1);
+    CHECK(tree.root() == 7);
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{7}));
+
+    // The same as filtering the postorder.
+    tree.first();
+    for (tree.next(); tree.is_tree(); tree.next()) {
+        std::ignore = tree.invalidated_nodes();
+
+        std::vector<tsk_id_t> expected;
+        for (auto const node: tree.postorder()) {
+            if (tree.is_invalidated(node) || tree.is_root(node)) {
+                expected.push_back(node);
+            }
+        }
+        CHECK_THAT(tree.invalidated_postorder(), RangeEquals(expected));
+    }
+}
+
+TEST_CASE("TSKitTree with multiple roots", "[TSKitTree]") {
+    tsk_treeseq_t tskit_tree_sequence;
+    tsk_treeseq_from_text(
+        &tskit_tree_sequence,
+        10,
+        multi_root_ex_nodes,
+        multi_root_ex_edges,
+        NULL,
+        multi_root_ex_sites,
+        multi_root_ex_mutations,
+        NULL,
+        NULL,
+        0
+    );
+    TSKitTreeSequence tree_sequence(std::move(tskit_tree_sequence));
+    REQUIRE(tree_sequence.num_trees() == 4);
+
+    TSKitTree      tree{tree_sequence};
+    tsk_id_t const virtual_root = 7;
+    REQUIRE(tree.virtual_root() == virtual_root);
+
+    auto const eulertour = [&tree]() {
+        std::vector<tsk_id_t> nodes;
+        for (auto const node: tree.eulertour()) {
+            nodes.push_back(node);
+        }
+        return nodes;
+    };
+
+    // Not covered by any edge: each sample is a root. The order of the roots is up to tskit.
+    tree.first();
+    CHECK(tree.num_roots() == 4);
+    CHECK(tree.root() == virtual_root);
+    CHECK(tree.is_root(virtual_root));
+    CHECK_FALSE(tree.is_root(0));
+    CHECK_THAT(tree.postorder(), UnorderedRangeEquals(std::vector<tsk_id_t>{0, 1, 2, 3, virtual_root}));
+    CHECK(tree.postorder().back() == virtual_root);
+    CHECK_THAT(eulertour(), UnorderedRangeEquals(std::vector<tsk_id_t>{7, 0, 1, 2, 3, 7}));
+    CHECK(eulertour().front() == virtual_root);
+
+    // Two roots
+    tree.next();
+    CHECK(tree.num_roots() == 2);
+    CHECK(tree.root() == virtual_root);
+    CHECK_FALSE(tree.is_root(4));
+    CHECK_THAT(tree.postorder(), UnorderedRangeEquals(std::vector<tsk_id_t>{0, 1, 2, 3, 4, 5, virtual_root}));
+    CHECK(tree.postorder().back() == virtual_root);
+    CHECK_THAT(eulertour(), UnorderedRangeEquals(std::vector<tsk_id_t>{7, 4, 0, 1, 4, 5, 2, 3, 5, 7}));
+    CHECK(eulertour().front() == virtual_root);
+    CHECK_THAT(tree.invalidated_postorder(), UnorderedRangeEquals(std::vector<tsk_id_t>{4, 5, virtual_root}));
+    CHECK(tree.invalidated_postorder().back() == virtual_root);
+
+    // A single root; the virtual root is not part of the tree.
+    tree.next();
+    CHECK(tree.num_roots() == 1);
+    CHECK(tree.root() == 6);
+    CHECK_FALSE(tree.is_root(virtual_root));
+    CHECK_THAT(eulertour(), UnorderedRangeEquals(std::vector<tsk_id_t>{6, 4, 0, 1, 4, 5, 2, 3, 5, 6}));
+    CHECK(eulertour().front() == 6);
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{6}));
+
+    // Back to isolated samples; the virtual root is visited even though it is not the parent of any changed edge.
+    tree.next();
+    CHECK(tree.root() == virtual_root);
+    CHECK_THAT(tree.invalidated_postorder(), RangeEquals(std::vector<tsk_id_t>{virtual_root}));
+}
@@ -240,6 +240,87 @@ char const* single_tree_multi_derived_states_mutations = "0    1     1   -1\n"
 // node 2: derived state 2
 // node 3: derived state 2
 
+// Trees with multiple roots and regions not covered by any edge, in which every sample is a root on its own.
+/*
+3.00┊         ┊         ┊    6    ┊         ┊
+    ┊         ┊         ┊  ┏━┻━┓  ┊         ┊
+2.00┊         ┊      5  ┊  ┃   5  ┊         ┊
+    ┊         ┊     ┏┻┓ ┊  ┃  ┏┻┓ ┊         ┊
+1.00┊         ┊  4  ┃ ┃ ┊  4  ┃ ┃ ┊         ┊
+    ┊         ┊ ┏┻┓ ┃ ┃ ┊ ┏┻┓ ┃ ┃ ┊         ┊
+0.00┊ 0 1 2 3 ┊ 0 1 2 3 ┊ 0 1 2 3 ┊ 0 1 2 3 ┊
+  0.00      2.00      6.00      8.00      10.00
+*/
+char const* multi_root_ex_nodes = "1  0   -1   -1\n"
+                                  "1  0   -1   -1\n"
+                                  "1  0   -1   -1\n"
+                                  "1  0   -1   -1\n"
+                                  "0  1   -1   -1\n"
+                                  "0  2   -1   -1\n"
+                                  "0  3   -1   -1\n";
+
+char const* multi_root_ex_edges = "2  8   4  0,1\n"
+                                  "2  8   5  2,3\n"
+                                  "6  8   6  4,5\n";
+
+char const* multi_root_ex_sites = "1      0\n"
+                                  "3      0\n"
+                                  "5      0\n"
+                                  "7      0\n"
+                                  "9      0\n";
+
+/* site, node, derived_state, [parent, time] */
+char const* multi_root_ex_mutations = "0    0   1  -1\n"  // on a sample which is a root on its own
+                                      "1    4   1  -1\n"  // on one of the two roots
+                                      "2    5   1  -1\n"  // on the other one
+                                      "2    2   0   2\n"  // back to the ancestral state
+                                      "3    5   1  -1\n"  // below the single root
+                                      "4    3   1  -1\n"; // on a sample which is a root on its own
+
+// Three trees on [0, 3), [3, 6), and [6, 10). The first two have two roots each, 4 = (0,1) and 5 = (2,3) or 6 = (2,3),
+// respectively. In the third tree, both subtrees are joined below the single root 7.
+char const* multi_root_leading_ex_nodes = "1  0   -1   -1\n"
+                                          "1  0   -1   -1\n"
+                                          "1  0   -1   -1\n"
+                                          "1  0   -1   -1\n"
+                                          "0  1   -1   -1\n"
+                                          "0  1   -1   -1\n"
+                                          "0  1   -1   -1\n"
+                                          "0  2   -1   -1\n";
+
+char const* multi_root_leading_ex_edges = "0  10  4  0,1\n"
+                                          "0  3   5  2,3\n"
+                                          "3  10  6  2,3\n"
+                                          "6  10  7  4,6\n";
+
+// Three trees on [0, 4), [4, 7), and [7, 10). The first two are identical, ((0,1)4,(2,3)5)6, but tskit nevertheless
+// reports a breakpoint at 4 because the edges are split there. The third tree is ((0,2)4,(1,3)5)6.
+char const* repeated_tree_ex_nodes = "1  0   -1   -1\n"
+                                     "1  0   -1   -1\n"
+                                     "1  0   -1   -1\n"
+                                     "1  0   -1   -1\n"
+                                     "0  1   -1   -1\n"
+                                     "0  1   -1   -1\n"
+                                     "0  2   -1   -1\n";
+
+char const* repeated_tree_ex_edges = "0  4   4  0,1\n"
+                                     "4  7   4  0,1\n"
+                                     "7  10  4  0,2\n"
+                                     "0  4   5  2,3\n"
+                                     "4  7   5  2,3\n"
+                                     "7  10  5  1,3\n"
+                                     "0  4   6  4,5\n"
+                                     "4  10  6  4,5\n";
+
+char const* repeated_tree_ex_sites = "1      0\n"
+                                     "5      0\n"
+                                     "8      0\n";
+
+/* site, node, derived_state, [parent, time] */
+char const* repeated_tree_ex_mutations = "0    4   1  -1\n"
+                                         "1    4   1  -1\n"
+                                         "2    4   1  -1\n";
+
 /* Simple utilities to parse text so we can write declarative
  * tests. This is not intended as a robust general input mechanism.
  */
@@ -93,4 +93,17 @@ extern char const* single_tree_multi_derived_states_edges;
 extern char const* single_tree_multi_derived_states_sites;
 extern char const* single_tree_multi_derived_states_mutations;
 
+extern char const* multi_root_ex_nodes;
+extern char const* multi_root_ex_edges;
+extern char const* multi_root_ex_sites;
+extern char const* multi_root_ex_mutations;
+
+extern char const* multi_root_leading_ex_nodes;
+extern char const* multi_root_leading_ex_edges;
+
+extern char const* repeated_tree_ex_nodes;
+extern char const* repeated_tree_ex_edges;
+extern char const* repeated_tree_ex_sites;
+extern char const* repeated_tree_ex_mutations;
+
 #endif